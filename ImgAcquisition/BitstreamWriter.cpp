@@ -0,0 +1,212 @@
+#include "BitstreamWriter.h"
+#include "writeHandler.h"
+#include "ThreadPlacement.h"
+#include "settings/Settings.h"
+#include "settings/ParamNames.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace {
+    const size_t PAGE_BYTES = 4096;
+
+    double msSince(const std::chrono::steady_clock::time_point &start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+namespace beeCompress {
+
+BitstreamWriter::BitstreamWriter(size_t batchBytes, int queueDepth, const std::string &name) :
+    _Name(name), _Busy(false), _Stop(false), _WriteMsSum(0) {
+    _BatchBytes = std::max(PAGE_BYTES, (batchBytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES);
+    queueDepth = std::max(queueDepth, 2);
+
+    _Batches.resize(queueDepth);
+    for (Batch &batch : _Batches) {
+        void *data = nullptr;
+        if (posix_memalign(&data, PAGE_BYTES, _BatchBytes) != 0) {
+            throw std::bad_alloc();
+        }
+        batch = Batch { nullptr, static_cast<uint8_t*>(data), 0 };
+        _Free.push_back(&batch);
+    }
+    memset(&_Stats, 0, sizeof(_Stats));
+
+    _Thread = std::thread(&BitstreamWriter::run, this);
+}
+
+std::unique_ptr<BitstreamWriter> BitstreamWriter::fromSettings(const std::string &name) {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    int depth = set->maybeGetValueOfParam<int>(IMACQUISITION::WRITER_QUEUE_DEPTH).get_value_or(8);
+    int batchKb = set->maybeGetValueOfParam<int>(IMACQUISITION::WRITER_BATCH_KB).get_value_or(4096);
+    if (depth <= 0) {
+        return nullptr;
+    }
+    return std::unique_ptr<BitstreamWriter>(
+               new BitstreamWriter(static_cast<size_t>(std::max(batchKb, 1)) * 1024, depth, name));
+}
+
+BitstreamWriter::~BitstreamWriter() {
+    submitAll();
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Stop = true;
+    }
+    _Queued.notify_one();
+    _Thread.join();
+
+    for (Batch &batch : _Batches) {
+        free(batch.data);
+    }
+}
+
+bool BitstreamWriter::write(FILE *file, const uint8_t *data, size_t size) {
+    std::vector<Batch*>::iterator it = std::find_if(_Current.begin(), _Current.end(),
+                                                    [file](Batch *b) { return b->file == file; });
+    Batch *batch = it != _Current.end() ? *it : nullptr;
+
+    while (size > 0) {
+        if (batch == nullptr) {
+            batch = acquireBatch();
+            batch->file = file;
+            batch->size = 0;
+            _Current.push_back(batch);
+        }
+
+        size_t n = std::min(size, _BatchBytes - batch->size);
+        memcpy(batch->data + batch->size, data, n);
+        batch->size += n;
+        data += n;
+        size -= n;
+
+        if (batch->size == _BatchBytes) {
+            submitCurrent(file);
+            batch = nullptr;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_Mutex);
+    return std::find(_FailedFiles.begin(), _FailedFiles.end(), file) == _FailedFiles.end();
+}
+
+void BitstreamWriter::close(std::unique_ptr<writeHandler> wh) {
+    submitCurrent(wh->_video);
+    enqueue(Job { nullptr, wh.release() });
+}
+
+BitstreamWriter::Stats BitstreamWriter::takeStats() {
+    std::lock_guard<std::mutex> lock(_Mutex);
+    Stats stats = _Stats;
+    stats.queueDepth = _Jobs.size() + (_Busy ? 1 : 0);
+    stats.avgWriteMs = stats.batches > 0 ? _WriteMsSum / stats.batches : 0;
+
+    memset(&_Stats, 0, sizeof(_Stats));
+    _Stats.maxQueueDepth = stats.queueDepth;
+    _WriteMsSum = 0;
+    return stats;
+}
+
+BitstreamWriter::Batch *BitstreamWriter::acquireBatch() {
+    std::unique_lock<std::mutex> lock(_Mutex);
+    if (_Free.empty() && _Jobs.empty() && !_Busy) {
+        //All batches are being filled for other files; nothing would free one
+        lock.unlock();
+        submitAll();
+        lock.lock();
+    }
+    if (_Free.empty()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _Freed.wait(lock, [this] { return !_Free.empty(); });
+        _Stats.stalls++;
+        _Stats.stallMs += msSince(start);
+    }
+    Batch *batch = _Free.back();
+    _Free.pop_back();
+    return batch;
+}
+
+void BitstreamWriter::enqueue(const Job &job) {
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Jobs.push_back(job);
+        _Stats.maxQueueDepth = std::max(_Stats.maxQueueDepth, _Jobs.size() + (_Busy ? 1 : 0));
+    }
+    _Queued.notify_one();
+}
+
+void BitstreamWriter::submitCurrent(FILE *file) {
+    std::vector<Batch*>::iterator it = std::find_if(_Current.begin(), _Current.end(),
+                                                    [file](Batch *b) { return b->file == file; });
+    if (it == _Current.end()) {
+        return;
+    }
+    Batch *batch = *it;
+    _Current.erase(it);
+    if (batch->size > 0) {
+        enqueue(Job { batch, nullptr });
+    } else {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Free.push_back(batch);
+        _Freed.notify_one();
+    }
+}
+
+void BitstreamWriter::submitAll() {
+    while (!_Current.empty()) {
+        submitCurrent(_Current.front()->file);
+    }
+}
+
+void BitstreamWriter::run() {
+    ThreadPlacement::apply(ThreadPlacement::get(IMACQUISITION::THREADS_ENCODER), _Name);
+
+    std::unique_lock<std::mutex> lock(_Mutex);
+    while (true) {
+        _Queued.wait(lock, [this] { return _Stop || !_Jobs.empty(); });
+        if (_Jobs.empty()) {
+            break;
+        }
+        Job job = _Jobs.front();
+        _Jobs.pop_front();
+        _Busy = true;
+        lock.unlock();
+
+        if (job.batch != nullptr) {
+            Batch *batch = job.batch;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bool ok = fwrite(batch->data, 1, batch->size, batch->file) == batch->size;
+            double writeMs = msSince(start);
+            if (!ok) {
+                std::cout << _Name << ": could not write " << batch->size << " bytes of video." << std::endl;
+            }
+
+            lock.lock();
+            if (!ok && std::find(_FailedFiles.begin(), _FailedFiles.end(), batch->file) == _FailedFiles.end()) {
+                _FailedFiles.push_back(batch->file);
+            }
+            _Stats.batches++;
+            _Stats.bytes += batch->size;
+            _Stats.maxWriteMs = std::max(_Stats.maxWriteMs, writeMs);
+            _WriteMsSum += writeMs;
+            _Free.push_back(batch);
+            _Freed.notify_one();
+        } else {
+            //Everything of the segment is written; closing moves the files.
+            //The FILE* may be reused once closed, so it is forgotten before.
+            lock.lock();
+            _FailedFiles.erase(std::remove(_FailedFiles.begin(), _FailedFiles.end(), job.closing->_video),
+                               _FailedFiles.end());
+            lock.unlock();
+            delete job.closing;
+            lock.lock();
+        }
+        _Busy = false;
+    }
+}
+
+} /* namespace beeCompress */
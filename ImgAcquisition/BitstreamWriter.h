@@ -0,0 +1,137 @@
+#ifndef BITSTREAMWRITER_H_
+#define BITSTREAMWRITER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace beeCompress {
+
+class writeHandler;
+
+/**
+ * @brief Writes the encoded bitstream to disk on a thread of its own.
+ *
+ * The encoder thread copies its output into large batches, one per open
+ * file. Full batches are queued and written by the writer thread while
+ * the next one fills, so the encoder thread only waits for storage if
+ * all batches are in flight. Such waits are counted as stalls. Batches are page aligned and
+ * a whole number of pages, so the video is written in aligned blocks.
+ *
+ * Settings (IMACQUISITION.WRITER.*):
+ * BATCH_KB     Size of a batch. Default 4096.
+ * QUEUE_DEPTH  Number of batches. Default 8. 0 writes on the encoder thread.
+ *
+ * write and close must be called from a single thread.
+ */
+class BitstreamWriter {
+public:
+
+    struct Stats {
+        //! Batches queued or being written right now
+        size_t      queueDepth;
+        //! Most batches queued or being written at once
+        size_t      maxQueueDepth;
+        uint64_t    batches;
+        uint64_t    bytes;
+        //! Time of writing one batch, in ms
+        double      avgWriteMs;
+        double      maxWriteMs;
+        //! Number of times write waited for a free batch
+        uint64_t    stalls;
+        //! Total time write waited, in ms
+        double      stallMs;
+    };
+
+    /**
+     * @brief Allocates the batches and starts the writer thread.
+     *
+     * @param Size of a batch in bytes, rounded up to whole pages
+     * @param Number of batches, at least 2
+     * @param Name of the thread for messages
+     */
+    BitstreamWriter(size_t batchBytes, int queueDepth, const std::string &name);
+
+    //! Creates a writer as configured. nullptr if QUEUE_DEPTH is 0.
+    static std::unique_ptr<BitstreamWriter> fromSettings(const std::string &name);
+
+    //! Writes everything queued, closes the handlers passed to close and stops the thread.
+    ~BitstreamWriter();
+
+    /**
+     * @brief Appends data to a file. Returns once the data is copied.
+     *
+     * @return false if writing to the file failed before
+     */
+    bool write(FILE *file, const uint8_t *data, size_t size);
+
+    /**
+     * @brief Finishes a segment without waiting for the disk.
+     *
+     * The handler is destroyed (which closes and moves its files) by the
+     * writer thread after everything written before.
+     */
+    void close(std::unique_ptr<writeHandler> wh);
+
+    //! Queue depth and the figures since the previous call
+    Stats takeStats();
+
+private:
+
+    struct Batch {
+        FILE        *file;
+        uint8_t     *data;
+        size_t      size;
+    };
+
+    //! Either a batch to write or a handler to close
+    struct Job {
+        Batch           *batch;
+        writeHandler    *closing;
+    };
+
+    void run();
+
+    //! Takes a free batch, waiting for the writer thread if there is none
+    Batch *acquireBatch();
+
+    void enqueue(const Job &job);
+
+    //! Queues the batch being filled for a file, if any
+    void submitCurrent(FILE *file);
+
+    //! Queues the batches being filled for all files
+    void submitAll();
+
+    std::string             _Name;
+    size_t                  _BatchBytes;
+    std::vector<Batch>      _Batches;
+
+    //! Batches being filled by write, one per file. Only touched by the calling thread.
+    std::vector<Batch*>     _Current;
+
+    std::mutex              _Mutex;
+    std::condition_variable _Queued;
+    std::condition_variable _Freed;
+    std::deque<Job>         _Jobs;
+    std::vector<Batch*>     _Free;
+    //! Whether the writer thread is working on a job
+    bool                    _Busy;
+    bool                    _Stop;
+    //! Files a write failed for, each until its handler is closed
+    std::vector<FILE*>      _FailedFiles;
+    Stats                   _Stats;
+    double                  _WriteMsSum;
+
+    std::thread             _Thread;
+};
+
+} /* namespace beeCompress */
+
+#endif /* BITSTREAMWRITER_H_ */
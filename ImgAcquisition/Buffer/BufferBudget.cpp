@@ -0,0 +1,98 @@
+#include "BufferBudget.h"
+#include "MutexBuffer.h"
+#include "../settings/Settings.h"
+#include "../settings/ParamNames.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace beeCompress {
+
+BufferBudget::BufferBudget(uint64_t limit) :
+	_Limit(limit), _Used(0), _Waiters(0) {
+}
+
+BufferBudget *BufferBudget::getInstance() {
+	//Deliberately leaked: buffers may unregister during exit.
+	static BufferBudget *instance = []() {
+		SettingsIAC *set = SettingsIAC::getInstance();
+		int mb = set->maybeGetValueOfParam<int>(IMACQUISITION::BUFFER_BUDGET_MB).get_value_or(5000);
+		return new BufferBudget(static_cast<uint64_t>(std::max(mb, 1)) * 1024 * 1024);
+	}();
+	return instance;
+}
+
+void BufferBudget::logStats() {
+	BufferBudget *b = getInstance();
+	std::cout << "Buffer budget: " << b->used() / 1024 / 1024 << "/"
+			<< b->limit() / 1024 / 1024 << " MB used" << std::endl;
+
+	std::lock_guard<std::mutex> lock(b->_BufferAccess);
+	for (MutexBuffer *buffer : b->_Buffers) {
+		if (buffer->name().empty()) {
+			continue;
+		}
+		buffer->logStats();
+	}
+}
+
+bool BufferBudget::tryAcquire(uint64_t bytes) {
+	uint64_t used = _Used.load(std::memory_order_relaxed);
+	do {
+		if (used + bytes > _Limit) {
+			return false;
+		}
+	} while (!_Used.compare_exchange_weak(used, used + bytes));
+	return true;
+}
+
+bool BufferBudget::acquireFor(uint64_t bytes, int timeoutMs) {
+	if (tryAcquire(bytes)) {
+		return true;
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	std::unique_lock<std::mutex> lock(_WaitAccess);
+	_Waiters++;
+	bool acquired = false;
+	while (!(acquired = tryAcquire(bytes))) {
+		if (_Released.wait_until(lock, deadline) == std::cv_status::timeout) {
+			acquired = tryAcquire(bytes);
+			break;
+		}
+	}
+	_Waiters--;
+	return acquired;
+}
+
+void BufferBudget::release(uint64_t bytes) {
+	_Used -= bytes;
+
+	//Only pay for the lock if a producer is actually blocked
+	if (_Waiters.load() > 0) {
+		std::lock_guard<std::mutex> lock(_WaitAccess);
+		_Released.notify_all();
+	}
+}
+
+bool BufferBudget::dropPreviewFrame(const MutexBuffer *except) {
+	std::lock_guard<std::mutex> lock(_BufferAccess);
+	for (MutexBuffer *buffer : _Buffers) {
+		if (buffer != except && buffer->isPreview() && buffer->dropOldest()) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void BufferBudget::registerBuffer(MutexBuffer *buffer) {
+	std::lock_guard<std::mutex> lock(_BufferAccess);
+	_Buffers.push_back(buffer);
+}
+
+void BufferBudget::unregisterBuffer(MutexBuffer *buffer) {
+	std::lock_guard<std::mutex> lock(_BufferAccess);
+	_Buffers.erase(std::remove(_Buffers.begin(), _Buffers.end(), buffer), _Buffers.end());
+}
+
+} /* namespace beeCompress */
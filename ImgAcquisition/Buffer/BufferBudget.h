@@ -0,0 +1,79 @@
+#ifndef BUFFERBUDGET_H_
+#define BUFFERBUDGET_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace beeCompress {
+
+class MutexBuffer;
+
+/**
+ * @brief Byte budget shared by all frame buffers of the process.
+ *
+ * Every queued frame holds width*height bytes of the budget until it is
+ * popped or dropped. The budget is read once from BUFFER_BUDGET_MB.
+ * What a buffer does when the budget is used up is decided by its
+ * OverflowPolicy (see MutexBuffer).
+ *
+ * Buffers register themselves so the budget can evict preview frames on
+ * behalf of any producer.
+ */
+class BufferBudget {
+public:
+
+	//! Gets the process wide budget. Creates it on first use.
+	static BufferBudget *getInstance();
+
+	//! Prints the usage and the dropped frames of all buffers to stdout.
+	static void logStats();
+
+	/**
+	 * @brief Takes bytes from the budget if they are available. Never blocks.
+	 */
+	bool tryAcquire(uint64_t bytes);
+
+	/**
+	 * @brief Takes bytes from the budget, waiting up to timeoutMs for them.
+	 */
+	bool acquireFor(uint64_t bytes, int timeoutMs);
+
+	//! Gives bytes back and wakes up blocked producers.
+	void release(uint64_t bytes);
+
+	/**
+	 * @brief Drops the oldest frame of one registered preview buffer.
+	 *
+	 * @param Buffer to leave alone (usually the caller)
+	 * @return Whether a frame was dropped
+	 */
+	bool dropPreviewFrame(const MutexBuffer *except);
+
+	void registerBuffer(MutexBuffer *buffer);
+	void unregisterBuffer(MutexBuffer *buffer);
+
+	uint64_t used() const { return _Used; }
+	uint64_t limit() const { return _Limit; }
+
+private:
+	BufferBudget(uint64_t limit);
+
+	const uint64_t			_Limit;
+	std::atomic<uint64_t>	_Used;
+
+	//! Only used to let producers wait for released bytes
+	std::mutex				_WaitAccess;
+	std::condition_variable	_Released;
+	std::atomic<int>		_Waiters;
+
+	//! _BufferAccess Mutex to modify the list of registered buffers
+	std::mutex					_BufferAccess;
+	std::vector<MutexBuffer*>	_Buffers;
+};
+
+} /* namespace beeCompress */
+
+#endif /* BUFFERBUDGET_H_ */
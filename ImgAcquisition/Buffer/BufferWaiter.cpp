@@ -0,0 +1,87 @@
+#include "BufferWaiter.h"
+#include "MutexBuffer.h"
+#include <atomic>
+#include <chrono>
+
+namespace beeCompress {
+
+BufferWaiter::BufferWaiter() :
+	_Generation(0) {
+}
+
+void BufferWaiter::notify() {
+	std::lock_guard<std::mutex> lock(_Access);
+	_Generation++;
+	_Notified.notify_all();
+}
+
+uint64_t BufferWaiter::generation() {
+	std::lock_guard<std::mutex> lock(_Access);
+	return _Generation;
+}
+
+bool BufferWaiter::waitSince(uint64_t seen, int timeoutMs) {
+	std::unique_lock<std::mutex> lock(_Access);
+	if (timeoutMs < 0) {
+		_Notified.wait(lock, [&]{ return _Generation != seen; });
+		return true;
+	}
+	return _Notified.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+			[&]{ return _Generation != seen; });
+}
+
+static int firstReady(const std::vector<MutexBuffer*> &buffers) {
+	for (size_t i = 0; i < buffers.size(); i++) {
+		if (buffers[i] != nullptr && buffers[i]->size() > 0) {
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+
+int waitAny(const std::vector<MutexBuffer*> &buffers, int timeoutMs) {
+	int ready = firstReady(buffers);
+	if (ready >= 0 || timeoutMs == 0) {
+		return ready;
+	}
+
+	BufferWaiter waiter;
+	for (MutexBuffer *buffer : buffers) {
+		if (buffer != nullptr) {
+			buffer->addWaiter(&waiter);
+		}
+	}
+	//Pairs with notifyWaiters: either the pusher sees us or we see its frame
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	while (true) {
+		uint64_t seen = waiter.generation();
+		ready = firstReady(buffers);
+		if (ready >= 0) {
+			break;
+		}
+
+		int remaining = -1;
+		if (timeoutMs > 0) {
+			remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+					deadline - std::chrono::steady_clock::now()).count());
+			if (remaining <= 0) {
+				break;
+			}
+		}
+		if (!waiter.waitSince(seen, remaining)) {
+			ready = firstReady(buffers);
+			break;
+		}
+	}
+
+	for (MutexBuffer *buffer : buffers) {
+		if (buffer != nullptr) {
+			buffer->removeWaiter(&waiter);
+		}
+	}
+	return ready;
+}
+
+} /* namespace beeCompress */
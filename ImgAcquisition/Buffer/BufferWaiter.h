@@ -0,0 +1,58 @@
+#ifndef BUFFERWAITER_H_
+#define BUFFERWAITER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace beeCompress {
+
+class MutexBuffer;
+
+/**
+ * @brief Lets one thread sleep until any of several buffers receives a frame.
+ *
+ * A waiter registers with each buffer, which calls notify on every push.
+ * Use waitAny rather than this class directly.
+ */
+class BufferWaiter {
+public:
+
+	BufferWaiter();
+
+	//! Called by the buffers on push. Wakes up the waiting thread.
+	void notify();
+
+	/**
+	 * @brief Sleeps until notify is called after "seen" or the timeout passes.
+	 *
+	 * @param Value of generation() before checking the buffers
+	 * @param Timeout in ms. Negative waits forever.
+	 * @return false on timeout
+	 */
+	bool waitSince(uint64_t seen, int timeoutMs);
+
+	//! Number of notifications so far
+	uint64_t generation();
+
+private:
+	std::mutex				_Access;
+	std::condition_variable	_Notified;
+	uint64_t				_Generation;
+};
+
+/**
+ * @brief Waits until one of the buffers holds a frame.
+ *
+ * Does not pop anything. Returns immediately if a buffer is not empty.
+ *
+ * @param Buffers to watch. nullptr entries are ignored.
+ * @param Timeout in ms. Negative waits forever.
+ * @return Index of the first non-empty buffer or -1 on timeout
+ */
+int waitAny(const std::vector<MutexBuffer*> &buffers, int timeoutMs);
+
+} /* namespace beeCompress */
+
+#endif /* BUFFERWAITER_H_ */
@@ -0,0 +1,192 @@
+#include "FramePool.h"
+#include "../settings/Settings.h"
+#include "../settings/ParamNames.h"
+#include "../ThreadPlacement.h"
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace beeCompress {
+
+namespace {
+	//Page alignment suits mlock and aligned SIMD access alike
+	const size_t POOL_ALIGNMENT = 4096;
+
+	std::mutex &registryAccess() {
+		static std::mutex m;
+		return m;
+	}
+
+	//Deliberately leaked: capture threads may still hold frames during exit.
+	std::map<std::tuple<int, int, int>, FramePool*> &registry() {
+		static auto *pools = new std::map<std::tuple<int, int, int>, FramePool*>();
+		return *pools;
+	}
+}
+
+FramePool::FramePool(int width, int height, int node) :
+	_Width(width), _Height(height), _Node(node),
+	_SlotSize(static_cast<size_t>(width) * static_cast<size_t>(height)),
+	_Capacity(0), _LowWatermark(0), _Locked(false),
+	_Hits(0), _Misses(0), _Exhaustions(0) {
+}
+
+FramePool::~FramePool() {
+	std::lock_guard<std::mutex> lock(_Access);
+	for (uint8_t *slot : _Free) {
+		freeSlot(slot);
+	}
+	_Free.clear();
+}
+
+FramePool *FramePool::getPool(int width, int height, int node) {
+	std::lock_guard<std::mutex> lock(registryAccess());
+	FramePool *&pool = registry()[std::make_tuple(width, height, node)];
+	if (pool == nullptr) {
+		pool = new FramePool(width, height, node);
+	}
+	return pool;
+}
+
+FramePool *FramePool::reserve(int width, int height, size_t count, int node) {
+	SettingsIAC *set = SettingsIAC::getInstance();
+	bool prefault = set->maybeGetValueOfParam<int>(IMACQUISITION::FRAMEPOOL_PREFAULT).get_value_or(1) != 0;
+	bool lock = set->maybeGetValueOfParam<int>(IMACQUISITION::FRAMEPOOL_MLOCK).get_value_or(0) != 0;
+
+	FramePool *pool = getPool(width, height, node);
+	pool->reserve(count, prefault, lock);
+	return pool;
+}
+
+void FramePool::logStats() {
+	std::lock_guard<std::mutex> lock(registryAccess());
+	for (auto &entry : registry()) {
+		FramePool *pool = entry.second;
+		Stats s = pool->getStats();
+		std::cout << "Frame pool " << pool->width() << "x" << pool->height();
+		if (pool->node() >= 0) {
+			std::cout << " on node " << pool->node();
+		}
+		std::cout << ": hits " << s.hits
+				<< ", misses " << s.misses
+				<< ", exhausted " << s.exhaustions
+				<< ", idle " << s.available << "/" << s.capacity
+				<< " (lowest " << s.lowWatermark << ")" << std::endl;
+	}
+}
+
+uint8_t *FramePool::allocateSlot() {
+	void *mem = nullptr;
+	if (posix_memalign(&mem, POOL_ALIGNMENT, _SlotSize) != 0) {
+		std::cout << "ERROR: Frame pool could not allocate " << _SlotSize << " bytes." << std::endl;
+		throw std::bad_alloc();
+	}
+	uint8_t *slot = static_cast<uint8_t*>(mem);
+	if (_Locked && mlock(slot, _SlotSize) != 0) {
+		perror("mlock");
+	}
+	return slot;
+}
+
+void FramePool::freeSlot(uint8_t *slot) {
+	if (_Locked) {
+		munlock(slot, _SlotSize);
+	}
+	free(slot);
+}
+
+void FramePool::reserve(size_t count, bool prefault, bool lock) {
+	if (_SlotSize == 0 || count == 0) {
+		return;
+	}
+
+	std::vector<uint8_t*> slots;
+	slots.reserve(count);
+
+	_Access.lock();
+	_Locked = _Locked || lock;
+	_Access.unlock();
+
+	//Pages are placed on the node of the CPU which touches them first
+	ThreadPlacement::runOnNode(_Node, [this, count, prefault, &slots]() {
+		for (size_t i = 0; i < count; i++) {
+			uint8_t *slot = allocateSlot();
+			if (prefault) {
+				//Writing one byte per page is enough to map the page
+				for (size_t p = 0; p < _SlotSize; p += POOL_ALIGNMENT) {
+					slot[p] = 0;
+				}
+			}
+			slots.push_back(slot);
+		}
+	});
+
+	std::lock_guard<std::mutex> guard(_Access);
+	_Free.insert(_Free.end(), slots.begin(), slots.end());
+	_Capacity += count;
+	_LowWatermark = _Free.size();
+}
+
+std::shared_ptr<ImageBuffer> FramePool::acquire(const FrameMetadata &meta) {
+	uint8_t *slot = nullptr;
+
+	_Access.lock();
+	if (!_Free.empty()) {
+		slot = _Free.back();
+		_Free.pop_back();
+		if (_Free.size() < _LowWatermark) {
+			_LowWatermark = _Free.size();
+		}
+		if (_Free.empty()) {
+			_Exhaustions++;
+		}
+	}
+	_Access.unlock();
+
+	if (slot != nullptr) {
+		_Hits++;
+	} else {
+		_Misses++;
+		slot = allocateSlot();
+	}
+
+	return std::shared_ptr<ImageBuffer>(
+			new ImageBuffer(_Width, _Height, meta, slot),
+			[this, slot](ImageBuffer *b) {
+				delete b;
+				release(slot);
+			});
+}
+
+void FramePool::release(uint8_t *slot) {
+	_Access.lock();
+	if (_Free.size() < _Capacity) {
+		_Free.push_back(slot);
+		slot = nullptr;
+	}
+	_Access.unlock();
+
+	//The pool is full, give surplus memory back
+	if (slot != nullptr) {
+		freeSlot(slot);
+	}
+}
+
+FramePool::Stats FramePool::getStats() {
+	Stats s;
+	s.hits 			= _Hits;
+	s.misses 		= _Misses;
+	s.exhaustions 	= _Exhaustions;
+
+	std::lock_guard<std::mutex> lock(_Access);
+	s.capacity 		= _Capacity;
+	s.available 	= _Free.size();
+	s.lowWatermark 	= _LowWatermark;
+	return s;
+}
+
+} /* namespace beeCompress */
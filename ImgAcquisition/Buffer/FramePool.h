@@ -0,0 +1,121 @@
+#ifndef FRAMEPOOL_H_
+#define FRAMEPOOL_H_
+
+#include "MutexBuffer.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Recycles the pixel storage of frames of one resolution.
+ *
+ * Allocating a fresh 12 MB buffer for every captured frame churns through
+ * malloc/mmap and takes a page fault on every page of it. The pool keeps
+ * a number of page aligned buffers around and hands them out as
+ * ImageBuffers whose deleter returns the storage to the pool.
+ *
+ * If no buffer is free a new one is allocated (a "miss"). At most
+ * "capacity" idle buffers are kept, surplus buffers are freed on release.
+ * Pools live until the process exits.
+ *
+ * Pools are kept per NUMA node, so a camera pinned to one socket gets
+ * buffers in that socket's memory. Node -1 leaves placement to the kernel.
+ */
+class FramePool {
+public:
+
+	/**
+	 * @brief Counters to size the pool per camera.
+	 */
+	struct Stats {
+		//! Frames served from an idle buffer
+		uint64_t	hits;
+		//! Frames for which a new buffer had to be allocated
+		uint64_t	misses;
+		//! How often the last idle buffer was handed out
+		uint64_t	exhaustions;
+		//! Number of idle buffers the pool retains
+		size_t		capacity;
+		//! Number of idle buffers right now
+		size_t		available;
+		//! Lowest number of idle buffers seen since the last reserve
+		size_t		lowWatermark;
+	};
+
+	/**
+	 * @brief Gets the pool for the given resolution and NUMA node. Creates it if required.
+	 */
+	static FramePool *getPool(int width, int height, int node = -1);
+
+	/**
+	 * @brief Grows the pool of the given resolution and NUMA node by count buffers.
+	 *
+	 * Whether the buffers are pre-faulted and locked into RAM is read from
+	 * the FRAMEPOOL_PREFAULT and FRAMEPOOL_MLOCK settings. Buffers of a
+	 * node are pre-faulted by a thread running on that node, so the kernel
+	 * places them there.
+	 *
+	 * @return The pool
+	 */
+	static FramePool *reserve(int width, int height, size_t count, int node = -1);
+
+	//! Prints the counters of all pools to stdout.
+	static void logStats();
+
+	/**
+	 * @brief Allocates count buffers up front and retains them.
+	 *
+	 * @param Number of buffers to add
+	 * @param Touch every page so no page fault happens while capturing
+	 * @param mlock() the buffers so they are never swapped out
+	 */
+	void reserve(size_t count, bool prefault, bool lock);
+
+	/**
+	 * @brief Gets a frame backed by pooled storage.
+	 *
+	 * The storage goes back to the pool once the last reference is dropped.
+	 */
+	std::shared_ptr<ImageBuffer> acquire(const FrameMetadata &meta);
+
+	Stats getStats();
+
+	int width() const { return _Width; }
+	int height() const { return _Height; }
+	int node() const { return _Node; }
+	//! Bytes of storage behind every frame of the pool
+	size_t slotSize() const { return _SlotSize; }
+
+	virtual ~FramePool();
+
+private:
+	FramePool(int width, int height, int node);
+
+	uint8_t *allocateSlot();
+	void freeSlot(uint8_t *slot);
+	void release(uint8_t *slot);
+
+	const int		_Width;
+	const int		_Height;
+	const int		_Node;
+	const size_t	_SlotSize;
+
+	//! _Access Mutex to modify the list of idle buffers
+	std::mutex				_Access;
+	std::vector<uint8_t*>	_Free;
+	size_t					_Capacity;
+	size_t					_LowWatermark;
+	bool					_Locked;
+
+	std::atomic<uint64_t>	_Hits;
+	std::atomic<uint64_t>	_Misses;
+	std::atomic<uint64_t>	_Exhaustions;
+};
+
+} /* namespace beeCompress */
+
+#endif /* FRAMEPOOL_H_ */
@@ -0,0 +1,156 @@
+#include "MutexBuffer.h"
+#include "BufferBudget.h"
+#include "BufferWaiter.h"
+#include <algorithm>
+#include "../settings/utility.h"
+#include <iostream>
+
+namespace beeCompress {
+
+//Report the first drop of a buffer and then every DROP_REPORT_INTERVAL drops
+static const uint64_t DROP_REPORT_INTERVAL = 1000;
+
+OverflowPolicy parseOverflowPolicy(const std::string &name) {
+	if (name == "dropoldest") {
+		return OverflowPolicy::DropOldest;
+	}
+	if (name == "dropnewest") {
+		return OverflowPolicy::DropNewest;
+	}
+	if (name == "block") {
+		return OverflowPolicy::Block;
+	}
+	if (name != "droppreviewfirst") {
+		std::cout << "Warning: unknown overflow policy '" << name << "', using droppreviewfirst." << std::endl;
+	}
+	return OverflowPolicy::DropPreviewFirst;
+}
+
+MutexBuffer::MutexBuffer() :
+	_DroppedFrames(0),
+	_Policy(OverflowPolicy::DropPreviewFirst),
+	_BlockTimeoutMs(0),
+	_IsPreview(false),
+	_WaiterCount(0) {
+	BufferBudget::getInstance()->registerBuffer(this);
+}
+
+MutexBuffer::~MutexBuffer() {
+	BufferBudget::getInstance()->unregisterBuffer(this);
+}
+
+void MutexBuffer::configure(const std::string &name, OverflowPolicy policy,
+		int blockTimeoutMs, bool isPreview) {
+	_Name 			= name;
+	_Policy 		= policy;
+	_BlockTimeoutMs = blockTimeoutMs;
+	_IsPreview 		= isPreview;
+}
+
+bool MutexBuffer::admit(const ImageBuffer &img) {
+	BufferBudget *budget = BufferBudget::getInstance();
+	const uint64_t bytes = static_cast<uint64_t>(img.width) * static_cast<uint64_t>(img.height);
+
+	if (budget->tryAcquire(bytes)) {
+		return true;
+	}
+
+	switch (_Policy) {
+	case OverflowPolicy::DropPreviewFirst:
+		while (budget->dropPreviewFrame(this)) {
+			if (budget->tryAcquire(bytes)) {
+				return true;
+			}
+		}
+		//No preview frames left: fall through to dropping our own
+	case OverflowPolicy::DropOldest:
+		while (dropOldest()) {
+			if (budget->tryAcquire(bytes)) {
+				return true;
+			}
+		}
+		break;
+	case OverflowPolicy::Block:
+		if (budget->acquireFor(bytes, _BlockTimeoutMs)) {
+			return true;
+		}
+		break;
+	case OverflowPolicy::DropNewest:
+		break;
+	}
+
+	//Nothing could be freed: the new frame is dropped
+	uint64_t dropped = ++_DroppedFrames;
+	if (dropped == 1 || dropped % DROP_REPORT_INTERVAL == 0) {
+		std::string msg = "Warning: Buffer budget (" + std::to_string(budget->limit() / 1024 / 1024)
+				+ " MB) exhausted. Buffer " + _Name + " dropped " + std::to_string(dropped) + " frames.";
+		std::cout << msg << std::endl;
+		if (dropped == 1) {
+			slackpost(msg, 1);
+		}
+	}
+	return false;
+}
+
+std::vector<std::shared_ptr<ImageBuffer>> MutexBuffer::popBatch(size_t maxFrames, int timeoutMs) {
+	std::vector<std::shared_ptr<ImageBuffer>> frames;
+	if (maxFrames == 0) {
+		return frames;
+	}
+	std::shared_ptr<ImageBuffer> img = timeoutMs < 0 ? pop() : pop(timeoutMs);
+	while (img) {
+		frames.push_back(std::move(img));
+		if (frames.size() >= maxFrames) {
+			break;
+		}
+		img = tryPop();
+	}
+	return frames;
+}
+
+void MutexBuffer::pushBatch(const std::vector<std::shared_ptr<ImageBuffer>> &frames) {
+	for (const std::shared_ptr<ImageBuffer> &img : frames) {
+		push(img);
+	}
+}
+
+void MutexBuffer::addWaiter(BufferWaiter *waiter) {
+	std::lock_guard<std::mutex> lock(_WaiterAccess);
+	_Waiters.push_back(waiter);
+	_WaiterCount = static_cast<int>(_Waiters.size());
+}
+
+void MutexBuffer::removeWaiter(BufferWaiter *waiter) {
+	std::lock_guard<std::mutex> lock(_WaiterAccess);
+	_Waiters.erase(std::remove(_Waiters.begin(), _Waiters.end(), waiter), _Waiters.end());
+	_WaiterCount = static_cast<int>(_Waiters.size());
+}
+
+void MutexBuffer::notifyWaiters() {
+	//Pairs with addWaiter: either we see the waiter or it sees our frame
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (_WaiterCount.load(std::memory_order_relaxed) == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(_WaiterAccess);
+	for (BufferWaiter *waiter : _Waiters) {
+		waiter->notify();
+	}
+}
+
+void MutexBuffer::logStats() {
+	std::cout << "Buffer " << _Name << ": " << size()
+			<< " queued, " << droppedFrames() << " dropped" << std::endl;
+}
+
+void MutexBuffer::release(const ImageBuffer &img) {
+	releaseBytes(static_cast<uint64_t>(img.width) * static_cast<uint64_t>(img.height));
+}
+
+void MutexBuffer::releaseBytes(uint64_t bytes) {
+	if (bytes > 0) {
+		BufferBudget::getInstance()->release(bytes);
+	}
+}
+
+} /* namespace beeCompress */
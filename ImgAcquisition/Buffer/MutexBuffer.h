@@ -8,45 +8,169 @@
 #ifndef MUTEXBUFFER_H_
 #define MUTEXBUFFER_H_
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <mutex>
 #include <string>
 #include <memory>
+#include <vector>
 #include "Semaphore.h"
 
-//Hard limit in MB a buffer shall never exceed
-#define BUFFER_HARDLIMIT	5000
-
 namespace beeCompress {
 
+class BufferWaiter;
+
+/**
+ * @brief What a buffer does when the shared byte budget is used up.
+ *
+ * DropOldest		Drop the oldest queued frame of this buffer.
+ * DropNewest		Drop the frame being pushed.
+ * DropPreviewFirst	Drop the oldest frames of preview buffers, then DropOldest.
+ * Block			Wait up to the configured time for space, then DropNewest.
+ */
+enum class OverflowPolicy {
+	DropOldest,
+	DropNewest,
+	DropPreviewFirst,
+	Block
+};
+
+/**
+ * @brief Parses "dropoldest", "dropnewest", "droppreviewfirst" or "block".
+ *
+ * Unknown names yield DropPreviewFirst.
+ */
+OverflowPolicy parseOverflowPolicy(const std::string &name);
+
+/**
+ * @brief Fixed size description of a captured frame.
+ *
+ * Plain data so it can be copied and stored without allocations. Use
+ * format_utc_time (settings/utility.h) to get an ISO 8601 string.
+ */
+struct FrameMetadata {
+	int32_t		camId;
+	//! Raw camera clock in ns. 0 if unknown.
+	uint64_t	cameraTimestampNs;
+	//! Capture time in ns since the UNIX epoch (UTC). This is what gets logged.
+	uint64_t	wallClockNs;
+	//! Frame counter of the camera
+	uint64_t	sequence;
+	//! Exposure time in us. 0 if unknown.
+	float		exposureUs;
+	//! Gain in dB. 0 if unknown.
+	float		gainDb;
+};
+
+/**
+ * @brief An 8 bit grayscale frame.
+ *
+ * Row y starts at data + y * stride. A view (see makeView) is a region of
+ * another frame: it shares the storage and keeps its parent alive.
+ */
 class ImageBuffer {
 public:
-	std::string timestamp;
+	FrameMetadata meta;
 	int width;
 	int height;
 	int camid;
+	//! First pixel of the frame
 	uint8_t *data;
 
-	ImageBuffer(int w, int h, int cid, std::string t){
-		timestamp 	= t;
+	//! Bytes from the start of one row to the next
+	int stride;
+
+	//! Byte offset of data into the parent's storage. 0 without a parent.
+	size_t offset;
+
+	//! Frame owning the storage of a view. nullptr otherwise.
+	std::shared_ptr<ImageBuffer> parent;
+
+	//! False if data is borrowed (e.g. from a FramePool) and must not be freed here
+	bool ownsData;
+
+	ImageBuffer(int w, int h, const FrameMetadata &m){
+		meta 		= m;
 		height 		= h;
 		width 		= w;
-		camid 		= cid;
+		camid 		= m.camId;
+		data 		= nullptr;
+		stride 		= w;
+		offset 		= 0;
+		ownsData 	= true;
 		if (w>0 && h>0){
 			data = new uint8_t[w*h];
 			//TODO malloc data ok?
 		}
 	}
 
+	/**
+	 * @brief Wraps externally managed storage of at least w*h bytes.
+	 *
+	 * The storage is not freed by the destructor.
+	 */
+	ImageBuffer(int w, int h, const FrameMetadata &m, uint8_t *storage){
+		meta 		= m;
+		height 		= h;
+		width 		= w;
+		camid 		= m.camId;
+		data 		= storage;
+		stride 		= w;
+		offset 		= 0;
+		ownsData 	= false;
+	}
+
 	ImageBuffer(const beeCompress::ImageBuffer &b){
-		timestamp 	= b.timestamp;
+		meta 		= b.meta;
 		height 		= b.height;
 		width 		= b.width;
 		camid 		= b.camid;
 		data 		= b.data;
+		stride 		= b.stride;
+		offset 		= b.offset;
+		parent 		= b.parent;
+		ownsData 	= false;
 	}
 
 	~ImageBuffer(){
-        delete[] data;
+		if (ownsData) {
+			delete[] data;
+		}
+	}
+
+	/**
+	 * @brief Creates a view of the region (x, y, w, h) of a frame. Nothing is copied.
+	 *
+	 * The region must lie within the frame. Views of views refer to the
+	 * frame owning the storage.
+	 */
+	static std::shared_ptr<ImageBuffer> makeView(const std::shared_ptr<ImageBuffer> &frame,
+			int x, int y, int w, int h){
+		const std::shared_ptr<ImageBuffer> &owner = frame->parent ? frame->parent : frame;
+		const size_t delta = static_cast<size_t>(y) * frame->stride + x;
+
+		std::shared_ptr<ImageBuffer> view = std::make_shared<ImageBuffer>(w, h, frame->meta, frame->data + delta);
+		view->stride 	= frame->stride;
+		view->offset 	= frame->offset + delta;
+		view->parent 	= owner;
+		return view;
+	}
+
+	//! Whether the rows follow each other without gaps
+	bool isContiguous() const {
+		return stride == width;
+	}
+
+	//! Copies the pixels into dst without row gaps (width * height bytes).
+	void copyTo(uint8_t *dst) const {
+		if (isContiguous()) {
+			memcpy(dst, data, static_cast<size_t>(width) * height);
+			return;
+		}
+		for (int y = 0; y < height; y++) {
+			memcpy(dst + static_cast<size_t>(y) * width, data + static_cast<size_t>(y) * stride, width);
+		}
 	}
 };
 
@@ -59,11 +183,117 @@ public:
 
 	virtual std::shared_ptr<beeCompress::ImageBuffer> pop() = 0;
 
+	/**
+	 * @brief Waits up to timeoutMs for a frame.
+	 *
+	 * @return The frame or nullptr on timeout
+	 */
+	virtual std::shared_ptr<beeCompress::ImageBuffer> pop(int timeoutMs) = 0;
+
+	//! Gets a frame if one is queued. Never blocks. nullptr otherwise.
+	virtual std::shared_ptr<beeCompress::ImageBuffer> tryPop() = 0;
+
+	/**
+	 * @brief Takes up to maxFrames frames in one go, oldest first.
+	 *
+	 * Waits up to timeoutMs (forever if negative) for the first frame,
+	 * but not for further ones.
+	 *
+	 * @return The frames. Empty on timeout.
+	 */
+	virtual std::vector<std::shared_ptr<ImageBuffer>> popBatch(size_t maxFrames, int timeoutMs);
+
+	//! Pushes several frames in order. Frames may be dropped as for push.
+	virtual void pushBatch(const std::vector<std::shared_ptr<ImageBuffer>> &frames);
+
 	virtual int size() = 0;
 
-	MutexBuffer(){};
+	/**
+	 * @brief Capture time (FrameMetadata::wallClockNs) of the oldest queued frame.
+	 *
+	 * Only call this from the consumer side, i.e. while nobody pops.
+	 *
+	 * @return 0 if the buffer is empty or the implementation does not know
+	 */
+	virtual uint64_t oldestFrameNs(){ return 0; }
+
+	//! Registers a waiter to be notified on every push (see waitAny).
+	void addWaiter(BufferWaiter *waiter);
+	void removeWaiter(BufferWaiter *waiter);
+
+	/**
+	 * @brief Sets how the buffer behaves when the byte budget is exhausted.
+	 *
+	 * @param Name used in statistics
+	 * @param The policy
+	 * @param Maximum time in ms to block the producer (Block only)
+	 * @param Whether the buffer holds preview frames (see DropPreviewFirst)
+	 */
+	void configure(const std::string &name, OverflowPolicy policy,
+			int blockTimeoutMs, bool isPreview);
+
+	//! Name used in statistics
+	const std::string &name() const { return _Name; }
+
+	//! Whether the buffer holds preview frames
+	bool isPreview() const { return _IsPreview; }
+
+	//! Number of frames dropped from or rejected by this buffer
+	uint64_t droppedFrames() const { return _DroppedFrames; }
+
+	//! Counts frames a consumer took from the buffer but had to discard
+	void countDropped(uint64_t frames) { _DroppedFrames += frames; }
+
+	/**
+	 * @brief Drops the oldest queued frame and releases its budget.
+	 *
+	 * Implementations which cannot do this safely return false.
+	 *
+	 * @return Whether a frame was dropped
+	 */
+	virtual bool dropOldest(){ return false; }
+
+	//! Prints the counters of the buffer to stdout.
+	virtual void logStats();
+
+	MutexBuffer();
+
+	virtual ~MutexBuffer();
+
+protected:
+	/**
+	 * @brief Reserves budget for a frame about to be pushed.
+	 *
+	 * Applies the overflow policy if the budget is exhausted.
+	 * Must be called without holding the buffer's own lock.
+	 *
+	 * @return false if the frame has to be dropped
+	 */
+	bool admit(const ImageBuffer &img);
+
+	//! Returns the budget of a frame leaving the buffer.
+	void release(const ImageBuffer &img);
+
+	//! Returns the budget of several frames at once.
+	void releaseBytes(uint64_t bytes);
+
+	//! Wakes up waitAny callers. Call after a frame became visible to pop.
+	void notifyWaiters();
+
+	//! Counts frames dropped by this buffer
+	std::atomic<uint64_t> _DroppedFrames;
+
+private:
+	std::string		_Name;
+	OverflowPolicy	_Policy;
+	int				_BlockTimeoutMs;
+	bool			_IsPreview;
 
-	virtual ~MutexBuffer(){};
+	//! _WaiterAccess Mutex to modify the list of waiters
+	std::mutex					_WaiterAccess;
+	std::vector<BufferWaiter*>	_Waiters;
+	//! Lets push skip the lock while nobody waits
+	std::atomic<int>			_WaiterCount;
 };
 
 } /* namespace beeCompress */
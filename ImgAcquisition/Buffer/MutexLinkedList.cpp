@@ -6,52 +6,335 @@
  */
 
 #include "MutexLinkedList.h"
-#include "../settings/utility.h"
+#include "FramePool.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <fcntl.h>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace beeCompress {
 
-MutexLinkedList::MutexLinkedList() {
-	// Nothing to do here: Auto-generated constructor stub
+//Report the first and then every SPILL_FULL_REPORT_INTERVAL frames dropped on a full spill file
+static const uint64_t SPILL_FULL_REPORT_INTERVAL = 1000;
+
+MutexLinkedList::MutexLinkedList() :
+	_SpillFd(-1), _SpillMap(nullptr),
+	_SpillSlotSize(0), _SpillSlots(0), _SpillHighWatermark(0),
+	_SpillHead(0), _SpillTail(0) {
+	memset(&_SpillStats, 0, sizeof(_SpillStats));
 }
 
 MutexLinkedList::~MutexLinkedList() {
-	// Nothing to do here: Auto-generated destructor stub
+	if (_SpillMap != nullptr) {
+		munmap(_SpillMap, _SpillSlotSize * _SpillSlots);
+	}
+	if (_SpillFd >= 0) {
+		close(_SpillFd);
+	}
 }
 
-void MutexLinkedList::push(std::shared_ptr<ImageBuffer> imbuffer){
+bool MutexLinkedList::enableSpill(const std::string &path, int width, int height,
+		size_t frames, size_t highWatermark){
+	if (width <= 0 || height <= 0 || frames == 0) {
+		return false;
+	}
+
+	//Slots are page aligned so they can be written back and dropped individually
+	const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	const size_t slotSize = (static_cast<size_t>(width) * height + page - 1) / page * page;
+	const size_t fileSize = slotSize * frames;
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror(("Could not create spill file " + path).c_str());
+		return false;
+	}
+	//Nobody else needs the file; this way it is also gone after a crash
+	unlink(path.c_str());
+
+	//Reserve the blocks now so a full disk shows up at startup, not during a stall
+	int err = posix_fallocate(fd, 0, fileSize);
+	if (err != 0) {
+		std::cout << "ERROR: Could not preallocate " << fileSize / 1024 / 1024
+				<< " MB for spill file " << path << ": " << strerror(err) << std::endl;
+		close(fd);
+		return false;
+	}
+
+	void *map = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror(("Could not map spill file " + path).c_str());
+		close(fd);
+		return false;
+	}
+
 	_Access.lock();
+	_SpillFd 				= fd;
+	_SpillMap 				= static_cast<uint8_t*>(map);
+	_SpillSlotSize 			= slotSize;
+	_SpillSlots 			= frames;
+	_SpillHighWatermark 	= highWatermark;
+	_SpillStats.capacity 	= frames;
+	_Access.unlock();
+	return true;
+}
+
+void MutexLinkedList::push(std::shared_ptr<ImageBuffer> imbuffer){
+	if (_SpillMap != nullptr) {
+		const size_t bytes = static_cast<size_t>(imbuffer->width) * imbuffer->height;
+
+		_Access.lock();
+		//Once spilling started, every frame goes to disk until the file is
+		//drained. This keeps the frames in order.
+		bool spill = _SpillTail != _SpillHead || images.size() >= _SpillHighWatermark;
+		bool full = _SpillTail - _SpillHead >= _SpillSlots || bytes > _SpillSlotSize;
+		size_t slot = _SpillTail;
+		if (spill && !full) {
+			_SpillTail++;
+		}
+		_Access.unlock();
+
+		if (spill) {
+			if (!full) {
+				writeSpill(slot, *imbuffer);
+				waiting.notify();
+				notifyWaiters();
+				return;
+			}
+			uint64_t dropped = ++_DroppedFrames;
+			if (dropped == 1 || dropped % SPILL_FULL_REPORT_INTERVAL == 0) {
+				std::cout << "Warning: Spill file of buffer " << name() << " is full ("
+						<< _SpillSlots << " frames), dropped " << dropped << " frames." << std::endl;
+			}
+			return;
+		}
+	}
+
+	//May drop queued frames, so it has to run before we take the lock
+	if (!admit(*imbuffer)){
+		return;
+	}
 
+	_Access.lock();
 	images.push_back(imbuffer);
-	unsigned long s = images.size();
-	unsigned long w = imbuffer->width;
-	unsigned long h = imbuffer->height;
-	if (s*w*h/1024/1024 > BUFFER_HARDLIMIT){
-		std::cout << "ERROR: Buffer exceeds hardlimit (" << BUFFER_HARDLIMIT << " MB). Exiting. " << std::endl;
-		slackpost("ERROR: Buffer exceeds hardlimit (" + std::to_string(BUFFER_HARDLIMIT) + " MB). Exiting. ", 1);
-		std::exit(1);
+	_Access.unlock();
+	waiting.notify();
+	notifyWaiters();
+}
+
+void MutexLinkedList::pushBatch(const std::vector<std::shared_ptr<ImageBuffer>> &frames){
+	//With a spill file every frame has to decide on its own where it goes
+	if (_SpillMap != nullptr) {
+		MutexBuffer::pushBatch(frames);
+		return;
+	}
+
+	std::vector<std::shared_ptr<ImageBuffer>> admitted;
+	admitted.reserve(frames.size());
+	for (const std::shared_ptr<ImageBuffer> &img : frames) {
+		if (admit(*img)) {
+			admitted.push_back(img);
+		}
+	}
+	if (admitted.empty()) {
+		return;
 	}
 
+	_Access.lock();
+	images.insert(images.end(), admitted.begin(), admitted.end());
 	_Access.unlock();
-	waiting.notify(); 
+	waiting.notify(static_cast<int>(admitted.size()));
+	notifyWaiters();
+}
+
+bool MutexLinkedList::dropOldest(){
+	//Claim the count first so pop never waits for a frame which is gone
+	if (!waiting.tryWait()){
+		return false;
+	}
+	_Access.lock();
+	if(images.size()>0){
+		std::shared_ptr<ImageBuffer> img = images.front();
+		images.pop_front();
+		_Access.unlock();
+		release(*img);
+		_DroppedFrames++;
+		return true;
+	}
+	_Access.unlock();
+
+	//Only spilled frames are left. They do not hold any budget.
+	waiting.notify();
+	return false;
 }
 
 std::shared_ptr<beeCompress::ImageBuffer> MutexLinkedList::pop(){
 	waiting.wait();
+	return takeFront();
+}
+
+std::shared_ptr<beeCompress::ImageBuffer> MutexLinkedList::pop(int timeoutMs){
+	if (!waiting.waitFor(timeoutMs)){
+		return nullptr;
+	}
+	return takeFront();
+}
+
+std::shared_ptr<beeCompress::ImageBuffer> MutexLinkedList::tryPop(){
+	if (!waiting.tryWait()){
+		return nullptr;
+	}
+	return takeFront();
+}
+
+std::vector<std::shared_ptr<ImageBuffer>> MutexLinkedList::popBatch(size_t maxFrames, int timeoutMs){
+	std::vector<std::shared_ptr<ImageBuffer>> frames;
+	if (maxFrames == 0) {
+		return frames;
+	}
+	const size_t count = static_cast<size_t>(waiting.waitSome(
+			static_cast<int>(std::min<size_t>(maxFrames, INT_MAX)), timeoutMs));
+	if (count == 0) {
+		return frames;
+	}
+	frames.reserve(count);
+
+	std::vector<SpillEntry> spilled;
+	uint64_t bytes = 0;
+	_Access.lock();
+	while (frames.size() < count && images.size() > 0) {
+		bytes += static_cast<uint64_t>(images.front()->width) * images.front()->height;
+		frames.push_back(std::move(images.front()));
+		images.pop_front();
+	}
+	while (frames.size() + spilled.size() < count && _Spilled.size() > 0) {
+		spilled.push_back(std::move(_Spilled.front()));
+		_Spilled.pop_front();
+	}
+	_Access.unlock();
+	releaseBytes(bytes);
+
+	for (const SpillEntry &entry : spilled) {
+		frames.push_back(readSpill(entry));
+	}
+	return frames;
+}
+
+std::shared_ptr<ImageBuffer> MutexLinkedList::takeFront(){
 	_Access.lock();
 	if(images.size()>0){
 		std::shared_ptr<ImageBuffer> img = images.front();
 		images.pop_front();
 		_Access.unlock();
+		release(*img);
 		return img;
 	}
+	if(_Spilled.size()>0){
+		SpillEntry entry = _Spilled.front();
+		_Spilled.pop_front();
+		_Access.unlock();
+		return readSpill(entry);
+	}
 	_Access.unlock();
 
 	std::cout << "Warning: pop used on an empty buffer"<<std::endl;
-	std::shared_ptr<ImageBuffer> dummy(new beeCompress::ImageBuffer(0,0,0,""));
+	std::shared_ptr<ImageBuffer> dummy(new beeCompress::ImageBuffer(0,0,FrameMetadata()));
 	return dummy;
 }
 
+void MutexLinkedList::writeSpill(size_t slot, const ImageBuffer &img){
+	auto start = std::chrono::steady_clock::now();
+
+	const size_t bytes = static_cast<size_t>(img.width) * img.height;
+	const off_t offset = static_cast<off_t>((slot % _SpillSlots) * _SpillSlotSize);
+	img.copyTo(_SpillMap + offset);
+	//Start writeback right away so dirty pages do not pile up in RAM
+	sync_file_range(_SpillFd, offset, _SpillSlotSize, SYNC_FILE_RANGE_WRITE);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	SpillEntry entry;
+	entry.meta 		= img.meta;
+	entry.width 	= img.width;
+	entry.height 	= img.height;
+	entry.slot 		= slot;
+
+	_Access.lock();
+	_Spilled.push_back(entry);
+	_SpillStats.spilledFrames++;
+	_SpillStats.spilledBytes += bytes;
+	_SpillStats.spillSeconds += seconds;
+	if (_SpillTail - _SpillHead > _SpillStats.maxDepth) {
+		_SpillStats.maxDepth = _SpillTail - _SpillHead;
+	}
+	_Access.unlock();
+}
+
+std::shared_ptr<ImageBuffer> MutexLinkedList::readSpill(const SpillEntry &entry){
+	auto start = std::chrono::steady_clock::now();
+
+	const size_t bytes = static_cast<size_t>(entry.width) * entry.height;
+	const off_t offset = static_cast<off_t>((entry.slot % _SpillSlots) * _SpillSlotSize);
+	std::shared_ptr<ImageBuffer> img =
+			FramePool::getPool(entry.width, entry.height)->acquire(entry.meta);
+	memcpy(img->data, _SpillMap + offset, bytes);
+	//The slot is read exactly once, no need to keep it cached
+	posix_fadvise(_SpillFd, offset, _SpillSlotSize, POSIX_FADV_DONTNEED);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	_Access.lock();
+	//There is only one consumer, so slots are freed in order
+	_SpillHead++;
+	_SpillStats.reloadedFrames++;
+	_SpillStats.reloadedBytes += bytes;
+	_SpillStats.reloadSeconds += seconds;
+	_Access.unlock();
+	return img;
+}
+
+MutexLinkedList::SpillStats MutexLinkedList::getSpillStats(){
+	std::lock_guard<std::mutex> lock(_Access);
+	SpillStats s = _SpillStats;
+	s.depth = _SpillTail - _SpillHead;
+	return s;
+}
+
+uint64_t MutexLinkedList::oldestFrameNs(){
+	std::lock_guard<std::mutex> lock(_Access);
+	if (!images.empty()) {
+		return images.front()->meta.wallClockNs;
+	}
+	if (!_Spilled.empty()) {
+		return _Spilled.front().meta.wallClockNs;
+	}
+	return 0;
+}
+
+void MutexLinkedList::logStats(){
+	MutexBuffer::logStats();
+	if (_SpillMap == nullptr) {
+		return;
+	}
+
+	SpillStats s = getSpillStats();
+	std::cout << "Buffer " << name() << " spill: depth " << s.depth << "/" << s.capacity
+			<< " (max " << s.maxDepth << ")"
+			<< ", spilled " << s.spilledFrames << " frames";
+	if (s.spillSeconds > 0) {
+		std::cout << " at " << s.spilledBytes / 1024.0 / 1024.0 / s.spillSeconds << " MB/s";
+	}
+	std::cout << ", reloaded " << s.reloadedFrames << " frames";
+	if (s.reloadSeconds > 0) {
+		std::cout << " at " << s.reloadedBytes / 1024.0 / 1024.0 / s.reloadSeconds << " MB/s";
+	}
+	std::cout << std::endl;
+}
+
 } /* namespace beeCompress */
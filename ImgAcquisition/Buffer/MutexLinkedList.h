@@ -9,6 +9,7 @@
 #define MUTEXLINKEDLIST_H_
 
 #include "MutexBuffer.h"
+#include <deque>
 #include <list>
 #include <memory>
 
@@ -18,6 +19,26 @@ class MutexLinkedList: public MutexBuffer {
 
 public:
 
+	/**
+	 * @brief Counters of the spill file (see enableSpill).
+	 */
+	struct SpillStats {
+		uint64_t	spilledFrames;
+		uint64_t	reloadedFrames;
+		uint64_t	spilledBytes;
+		uint64_t	reloadedBytes;
+		//! Time spent copying into the spill file
+		double		spillSeconds;
+		//! Time spent copying out of the spill file
+		double		reloadSeconds;
+		//! Frames in the spill file right now
+		size_t		depth;
+		//! Most frames ever held in the spill file
+		size_t		maxDepth;
+		//! Number of frames the spill file can hold
+		size_t		capacity;
+	};
+
 	std::list<std::shared_ptr<ImageBuffer>> images;
 
 	/**
@@ -29,19 +50,91 @@ public:
 
 	virtual std::shared_ptr<beeCompress::ImageBuffer> pop();
 
+	virtual std::shared_ptr<beeCompress::ImageBuffer> pop(int timeoutMs);
+
+	virtual std::shared_ptr<beeCompress::ImageBuffer> tryPop();
+
+	//Takes one semaphore wait and one lock for the whole batch
+	virtual std::vector<std::shared_ptr<ImageBuffer>> popBatch(size_t maxFrames, int timeoutMs);
+
+	//Takes one lock and one semaphore notify for the whole batch
+	virtual void pushBatch(const std::vector<std::shared_ptr<ImageBuffer>> &frames);
+
+	virtual bool dropOldest();
+
 	//Simple function to get the current size of the buffer in elements.
-	//Locks the data structure.
+	//Includes spilled frames. Locks the data structure.
 	virtual int size(){
 		int tsize = 0;
 		_Access.lock();
-		tsize = images.size();
+		tsize = images.size() + _Spilled.size();
 		_Access.unlock();
 		return tsize;
 	}
 
+	//Includes spilled frames, which are all newer than those in RAM
+	virtual uint64_t oldestFrameNs();
+
+	virtual void logStats();
+
+	/**
+	 * @brief Moves frames to a file on disk once too many are held in RAM.
+	 *
+	 * When highWatermark frames are queued in RAM, further frames are copied
+	 * into a preallocated, memory mapped file. They are loaded back into
+	 * pooled buffers in FIFO order once the RAM frames are consumed. Spilled
+	 * frames do not count against the BufferBudget. When the file is full,
+	 * new frames are dropped.
+	 *
+	 * Warning: only valid for buffers with a single producer.
+	 *
+	 * @param Path of the file. It is unlinked right after creation.
+	 * @param Width of the frames
+	 * @param Height of the frames
+	 * @param Number of frames the file can hold
+	 * @param Number of frames in RAM before spilling starts
+	 * @return false if the file could not be created
+	 */
+	bool enableSpill(const std::string &path, int width, int height,
+			size_t frames, size_t highWatermark);
+
+	SpillStats getSpillStats();
+
 	MutexLinkedList();
 
 	virtual ~MutexLinkedList();
+
+private:
+	//! Removes the oldest frame. The caller must hold a count of "waiting".
+	std::shared_ptr<ImageBuffer> takeFront();
+
+	//! Metadata of a spilled frame. The pixels are in slot "slot".
+	struct SpillEntry {
+		FrameMetadata	meta;
+		int				width;
+		int				height;
+		size_t			slot;
+	};
+
+	//! Copies a frame into a reserved slot and queues it.
+	void writeSpill(size_t slot, const ImageBuffer &img);
+
+	//! Loads a spilled frame into a pooled buffer and frees its slot.
+	std::shared_ptr<ImageBuffer> readSpill(const SpillEntry &entry);
+
+	int			_SpillFd;
+	uint8_t		*_SpillMap;
+	size_t		_SpillSlotSize;
+	size_t		_SpillSlots;
+	size_t		_SpillHighWatermark;
+
+	//! Slots [_SpillHead, _SpillTail) are in use. Guarded by _Access.
+	size_t		_SpillHead;
+	size_t		_SpillTail;
+
+	//! Spilled frames, all newer than the ones in images. Guarded by _Access.
+	std::deque<SpillEntry>	_Spilled;
+	SpillStats				_SpillStats;
 };
 
 } /* namespace beeCompress */
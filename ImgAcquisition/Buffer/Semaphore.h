@@ -8,6 +8,7 @@
 #ifndef SEMAPHORE_H_
 #define SEMAPHORE_H_
 
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 
@@ -25,6 +26,18 @@ public:
         cv.notify_one();
     }
 
+    //! Adds n counts with a single lock.
+    inline void notify(int n)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        count += n;
+        if(n == 1){
+            cv.notify_one();
+        } else {
+            cv.notify_all();
+        }
+    }
+
     inline void wait()
     {
         std::unique_lock<std::mutex> lock(mtx);
@@ -35,6 +48,48 @@ public:
         count--;
     }
 
+    //! Takes one count if available. Never blocks.
+    inline bool tryWait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        if(count == 0){
+            return false;
+        }
+        count--;
+        return true;
+    }
+
+    //! Waits up to timeoutMs for a count. Returns false on timeout.
+    inline bool waitFor(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        if(!cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return count > 0; })){
+            return false;
+        }
+        count--;
+        return true;
+    }
+
+    /**
+     * Waits up to timeoutMs (forever if negative) for a count and
+     * then takes as many as available, but no more than max.
+     * Returns the number of counts taken, 0 on timeout.
+     */
+    inline int waitSome(int max, int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+
+        if(timeoutMs < 0){
+            cv.wait(lock, [this]{ return count > 0; });
+        } else if(!cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return count > 0; })){
+            return 0;
+        }
+        int taken = count < max ? count : max;
+        count -= taken;
+        return taken;
+    }
+
 private:
     std::mutex mtx;
     std::condition_variable cv;
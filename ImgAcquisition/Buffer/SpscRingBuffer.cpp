@@ -0,0 +1,163 @@
+#include "SpscRingBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+namespace beeCompress {
+
+//Number of polls before the consumer goes to sleep
+static const int SPIN_COUNT = 64;
+
+//Report the first and then every FULL_REPORT_INTERVAL frames dropped on a full ring
+static const uint64_t FULL_REPORT_INTERVAL = 1000;
+
+SpscRingBuffer::SpscRingBuffer(size_t capacity) :
+	_Capacity(capacity > 0 ? capacity : 1),
+	_Slots(_Capacity) {
+	_Producer.tail 			= 0;
+	_Producer.cachedHead 	= 0;
+	_Consumer.head 			= 0;
+	_Consumer.cachedTail 	= 0;
+	_Consumer.sleeping 		= false;
+}
+
+SpscRingBuffer::~SpscRingBuffer() {
+	// Nothing to do here: the slots release their frames
+}
+
+void SpscRingBuffer::push(std::shared_ptr<ImageBuffer> imbuffer){
+	//Only the consumer may advance head, so dropOldest is not available
+	//and the DropOldest policy degrades to dropping the new frame.
+	if (!admit(*imbuffer)) {
+		return;
+	}
+
+	const size_t tail = _Producer.tail.load(std::memory_order_relaxed);
+
+	if (tail - _Producer.cachedHead >= _Capacity) {
+		_Producer.cachedHead = _Consumer.head.load(std::memory_order_acquire);
+		if (tail - _Producer.cachedHead >= _Capacity) {
+			release(*imbuffer);
+			uint64_t dropped = ++_DroppedFrames;
+			if (dropped == 1 || dropped % FULL_REPORT_INTERVAL == 0) {
+				std::cout << "Warning: Ring buffer " << name() << " is full (" << _Capacity
+						<< " frames), dropped " << dropped << " frames." << std::endl;
+			}
+			return;
+		}
+	}
+
+	_Slots[tail % _Capacity] = std::move(imbuffer);
+	_Producer.tail.store(tail + 1, std::memory_order_release);
+
+	//Pairs with the store to "sleeping" in pop: either the consumer sees
+	//the new tail or we see that it is sleeping.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (_Consumer.sleeping.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(_SleepAccess);
+		_WakeUp.notify_one();
+	}
+	notifyWaiters();
+}
+
+std::shared_ptr<beeCompress::ImageBuffer> SpscRingBuffer::pop(){
+	const size_t head = _Consumer.head.load(std::memory_order_relaxed);
+	waitForData(head, -1);
+	return take(head);
+}
+
+std::shared_ptr<beeCompress::ImageBuffer> SpscRingBuffer::pop(int timeoutMs){
+	const size_t head = _Consumer.head.load(std::memory_order_relaxed);
+	if (!waitForData(head, timeoutMs)) {
+		return nullptr;
+	}
+	return take(head);
+}
+
+std::shared_ptr<beeCompress::ImageBuffer> SpscRingBuffer::tryPop(){
+	const size_t head = _Consumer.head.load(std::memory_order_relaxed);
+	if (!waitForData(head, 0)) {
+		return nullptr;
+	}
+	return take(head);
+}
+
+std::vector<std::shared_ptr<ImageBuffer>> SpscRingBuffer::popBatch(size_t maxFrames, int timeoutMs){
+	std::vector<std::shared_ptr<ImageBuffer>> frames;
+	const size_t head = _Consumer.head.load(std::memory_order_relaxed);
+	if (maxFrames == 0 || !waitForData(head, timeoutMs)) {
+		return frames;
+	}
+
+	const size_t count = std::min(maxFrames, _Consumer.cachedTail - head);
+	frames.reserve(count);
+	uint64_t bytes = 0;
+	for (size_t i = 0; i < count; i++) {
+		std::shared_ptr<ImageBuffer> &slot = _Slots[(head + i) % _Capacity];
+		bytes += static_cast<uint64_t>(slot->width) * slot->height;
+		frames.push_back(std::move(slot));
+	}
+	_Consumer.head.store(head + count, std::memory_order_release);
+	releaseBytes(bytes);
+	return frames;
+}
+
+bool SpscRingBuffer::waitForData(size_t head, int timeoutMs){
+	if (head != _Consumer.cachedTail) {
+		return true;
+	}
+	_Consumer.cachedTail = _Producer.tail.load(std::memory_order_acquire);
+	if (head != _Consumer.cachedTail) {
+		return true;
+	}
+	if (timeoutMs == 0) {
+		return false;
+	}
+
+	for (int i = 0; i < SPIN_COUNT && head == _Consumer.cachedTail; i++) {
+		std::this_thread::yield();
+		_Consumer.cachedTail = _Producer.tail.load(std::memory_order_acquire);
+	}
+
+	//Still empty: sleep until the producer wakes us up
+	if (head == _Consumer.cachedTail) {
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+		std::unique_lock<std::mutex> lock(_SleepAccess);
+		_Consumer.sleeping.store(true, std::memory_order_seq_cst);
+		while ((_Consumer.cachedTail = _Producer.tail.load(std::memory_order_seq_cst)) == head) {
+			if (timeoutMs < 0) {
+				_WakeUp.wait(lock);
+			} else if (_WakeUp.wait_until(lock, deadline) == std::cv_status::timeout) {
+				_Consumer.cachedTail = _Producer.tail.load(std::memory_order_seq_cst);
+				break;
+			}
+		}
+		_Consumer.sleeping.store(false, std::memory_order_relaxed);
+	}
+	return head != _Consumer.cachedTail;
+}
+
+std::shared_ptr<ImageBuffer> SpscRingBuffer::take(size_t head){
+	std::shared_ptr<ImageBuffer> img = std::move(_Slots[head % _Capacity]);
+	_Consumer.head.store(head + 1, std::memory_order_release);
+	release(*img);
+	return img;
+}
+
+int SpscRingBuffer::size(){
+	const size_t head = _Consumer.head.load(std::memory_order_acquire);
+	const size_t tail = _Producer.tail.load(std::memory_order_acquire);
+	return tail > head ? static_cast<int>(tail - head) : 0;
+}
+
+uint64_t SpscRingBuffer::oldestFrameNs(){
+	//The slot at head is not touched by the producer until head advances
+	const size_t head = _Consumer.head.load(std::memory_order_relaxed);
+	if (head == _Producer.tail.load(std::memory_order_acquire)) {
+		return 0;
+	}
+	return _Slots[head % _Capacity]->meta.wallClockNs;
+}
+
+} /* namespace beeCompress */
@@ -0,0 +1,99 @@
+#ifndef SPSCRINGBUFFER_H_
+#define SPSCRINGBUFFER_H_
+
+#include "MutexBuffer.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Bounded lock-free FIFO for exactly one producer and one consumer.
+ *
+ * Every camera to encoder path has a single producer (the camera thread)
+ * and a single consumer (the encoder glue). push and pop only touch two
+ * atomic positions which live on separate cache lines. A mutex and a
+ * condition variable are used only when the consumer has to sleep on an
+ * empty ring.
+ *
+ * Warning: push must only ever be called from one thread, and pop from
+ * one (possibly different) thread.
+ */
+class SpscRingBuffer: public MutexBuffer {
+
+public:
+
+	virtual void push(std::shared_ptr<ImageBuffer> imbuffer);
+
+	virtual std::shared_ptr<beeCompress::ImageBuffer> pop();
+
+	virtual std::shared_ptr<beeCompress::ImageBuffer> pop(int timeoutMs);
+
+	virtual std::shared_ptr<beeCompress::ImageBuffer> tryPop();
+
+	//Advances the consumer position once for the whole batch
+	virtual std::vector<std::shared_ptr<ImageBuffer>> popBatch(size_t maxFrames, int timeoutMs);
+
+	//Approximate number of queued elements. Does not lock.
+	virtual int size();
+
+	virtual uint64_t oldestFrameNs();
+
+	/**
+	 * @brief Creates a ring holding up to capacity frames.
+	 */
+	explicit SpscRingBuffer(size_t capacity);
+
+	virtual ~SpscRingBuffer();
+
+private:
+	static const size_t CACHELINE = 64;
+
+	/**
+	 * @brief Waits until the slot at head is filled.
+	 *
+	 * @param Timeout in ms. Negative waits forever, 0 does not wait.
+	 * @return false on timeout
+	 */
+	bool waitForData(size_t head, int timeoutMs);
+
+	//! Takes the frame at head. waitForData must have succeeded.
+	std::shared_ptr<ImageBuffer> take(size_t head);
+
+	//! Written by the producer only. Padded to a cache line of its own.
+	struct ProducerSide {
+		std::atomic<size_t>	tail;
+		//! Last seen consumer position. Avoids touching the consumer's line.
+		size_t				cachedHead;
+		char				padding[CACHELINE - 2 * sizeof(size_t)];
+	};
+
+	//! Written by the consumer only. Padded to a cache line of its own.
+	struct ConsumerSide {
+		std::atomic<size_t>	head;
+		//! Last seen producer position. Avoids touching the producer's line.
+		size_t				cachedTail;
+		//! Set while the consumer waits for _WakeUp
+		std::atomic<bool>	sleeping;
+		char				padding[CACHELINE - 3 * sizeof(size_t)];
+	};
+
+	const size_t _Capacity;
+	std::vector<std::shared_ptr<ImageBuffer>> _Slots;
+
+	//! Keeps _Producer off the line holding the members above
+	char _Padding[CACHELINE];
+	ProducerSide _Producer;
+	ConsumerSide _Consumer;
+
+	//! Only used to put the consumer to sleep on an empty ring
+	std::mutex _SleepAccess;
+	std::condition_variable _WakeUp;
+};
+
+} /* namespace beeCompress */
+
+#endif /* SPSCRINGBUFFER_H_ */
@@ -2,11 +2,14 @@
 
 #include <QString>
 #include <QThread>
+#include <array>
 #include <mutex>
+#include <vector>
 
 struct CalibrationInfo {
     bool doCalibration;
-    double calibrationData[4][4];
+    //! SMD, variance, contrast and noise per camera. Sized to the number of cameras.
+    std::vector<std::array<double, 4>> calibrationData;
     std::mutex dataAccess;
 };
 
@@ -31,7 +34,7 @@ public:
     /**
      * @brief Initialization of cameras and configuration
      *
-     * @param Virtual ID of the camera (0 to 3)
+     * @param Virtual ID of the camera (0 to number of cameras - 1)
      * @param Buffer shared with the encoder thread
      * @param Buffer shared with the shared memory thread
      * @param Pointer to calibration data storeage
@@ -39,7 +42,7 @@ public:
      */
     virtual bool initialize(unsigned int id, beeCompress::MutexBuffer *pBuffer,
                                    beeCompress::MutexBuffer *pSharedMemBuffer, CalibrationInfo *calib,
-                                   Watchdog *dog) = 0;  //here goes the camera ID (from 0 to 3)
+                                   Watchdog *dog) = 0;
     virtual bool isInitialized() const = 0;
 
 signals:
@@ -0,0 +1,158 @@
+#include "CameraTelemetry.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+    std::mutex &registryAccess() {
+        static std::mutex m;
+        return m;
+    }
+
+    //Deliberately leaked: camera threads may still count frames during exit.
+    std::vector<CameraTelemetry*> &registry() {
+        static auto *telemetries = new std::vector<CameraTelemetry*>();
+        return *telemetries;
+    }
+}
+
+CameraTelemetry::CameraTelemetry(const std::string &name) :
+    _Name(name), _Captured(0), _Lost(0), _Gaps(0),
+    _TransportSkipped(0), _ApiSkipped(0), _Copied(0), _LastSequence(0),
+    _LatencyMaxUs(0), _LossPending(false) {
+    for (std::atomic<uint64_t> &bucket : _Latency) {
+        bucket = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(registryAccess());
+    registry().push_back(this);
+}
+
+CameraTelemetry::~CameraTelemetry() {
+    std::lock_guard<std::mutex> lock(registryAccess());
+    registry().erase(std::remove(registry().begin(), registry().end(), this), registry().end());
+}
+
+size_t CameraTelemetry::bucketOf(uint64_t latencyUs) {
+    if (latencyUs < 4) {
+        return static_cast<size_t>(latencyUs);
+    }
+    const size_t msb = 63 - static_cast<size_t>(__builtin_clzll(latencyUs));
+    const size_t sub = static_cast<size_t>(latencyUs >> (msb - 2)) & 3;
+    return std::min(msb * 4 + sub, LATENCY_BUCKETS - 1);
+}
+
+uint64_t CameraTelemetry::bucketFloor(size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    const size_t msb = bucket / 4;
+    return (4 + bucket % 4) << (msb - 2);
+}
+
+void CameraTelemetry::frameCaptured(uint64_t sequence, uint64_t latencyUs) {
+    //Only the capture thread writes these, relaxed ordering is enough for statistics
+    const uint64_t last = _LastSequence.load(std::memory_order_relaxed);
+    if (last != 0 && sequence > last + 1) {
+        _Lost.fetch_add(sequence - last - 1, std::memory_order_relaxed);
+        _Gaps.fetch_add(1, std::memory_order_relaxed);
+        _LossPending.store(true, std::memory_order_relaxed);
+    }
+    _LastSequence.store(sequence, std::memory_order_relaxed);
+    _Captured.fetch_add(1, std::memory_order_relaxed);
+
+    _Latency[bucketOf(latencyUs)].fetch_add(1, std::memory_order_relaxed);
+    if (latencyUs > _LatencyMaxUs.load(std::memory_order_relaxed)) {
+        _LatencyMaxUs.store(latencyUs, std::memory_order_relaxed);
+    }
+}
+
+void CameraTelemetry::frameCopied() {
+    _Copied.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CameraTelemetry::setSkipCounters(uint64_t transportSkipped, uint64_t apiSkipped) {
+    _TransportSkipped.store(transportSkipped, std::memory_order_relaxed);
+    _ApiSkipped.store(apiSkipped, std::memory_order_relaxed);
+}
+
+void CameraTelemetry::setSampler(Sampler sampler) {
+    std::lock_guard<std::mutex> lock(_SamplerAccess);
+    _Sampler = sampler;
+}
+
+uint64_t CameraTelemetry::percentile(double fraction) const {
+    uint64_t total = 0;
+    uint64_t counts[LATENCY_BUCKETS];
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] = _Latency[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = static_cast<uint64_t>(fraction * (total - 1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank) {
+            return bucketFloor(i);
+        }
+    }
+    return bucketFloor(LATENCY_BUCKETS - 1);
+}
+
+CameraTelemetry::Snapshot CameraTelemetry::snapshot() const {
+    Snapshot s;
+    s.captured          = _Captured.load(std::memory_order_relaxed);
+    s.lost              = _Lost.load(std::memory_order_relaxed);
+    s.gaps              = _Gaps.load(std::memory_order_relaxed);
+    s.transportSkipped  = _TransportSkipped.load(std::memory_order_relaxed);
+    s.apiSkipped        = _ApiSkipped.load(std::memory_order_relaxed);
+    s.copied            = _Copied.load(std::memory_order_relaxed);
+    s.latencyP50Us      = percentile(0.5);
+    s.latencyP99Us      = percentile(0.99);
+    s.latencyMaxUs      = _LatencyMaxUs.load(std::memory_order_relaxed);
+    return s;
+}
+
+void CameraTelemetry::sampleAll(bool onlyAfterLoss) {
+    std::lock_guard<std::mutex> lock(registryAccess());
+    for (CameraTelemetry *t : registry()) {
+        if (onlyAfterLoss && !t->_LossPending.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        t->_LossPending.store(false, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> samplerLock(t->_SamplerAccess);
+        if (t->_Sampler) {
+            t->_Sampler(*t);
+        }
+    }
+}
+
+void CameraTelemetry::logStats() {
+    sampleAll(false);
+
+    //Frame loss usually goes along with load, so print it next to the counters
+    double load[3] = {0, 0, 0};
+    if (getloadavg(load, 3) == 3) {
+        std::cout << "System load: " << load[0] << " " << load[1] << " " << load[2] << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(registryAccess());
+    for (CameraTelemetry *t : registry()) {
+        Snapshot s = t->snapshot();
+        std::cout << t->_Name << ": captured " << s.captured
+                  << ", lost " << s.lost << " in " << s.gaps << " gaps"
+                  << ", transport skipped " << s.transportSkipped
+                  << ", API skipped " << s.apiSkipped
+                  << ", copied " << s.copied
+                  << ", capture latency p50 " << s.latencyP50Us
+                  << " us, p99 " << s.latencyP99Us
+                  << " us, max " << s.latencyMaxUs << " us" << std::endl;
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/*!\brief Frame loss and capture latency counters of one camera.
+ *
+ * The capture thread only touches atomics (frameCaptured). Counters
+ * which are expensive to read, like the transport and API skip counters
+ * of the camera driver, are read by a sampler function which runs on
+ * the thread calling sampleAll() or logStats(), never on the capture
+ * thread.
+ *
+ * Telemetries register themselves, so all cameras can be sampled and
+ * printed together.
+ */
+class CameraTelemetry {
+public:
+
+    /**
+     * @brief Consistent enough copy of the counters for reporting.
+     */
+    struct Snapshot {
+        uint64_t    captured;
+        //! Frames missing between consecutive sequence numbers
+        uint64_t    lost;
+        //! Number of gaps in the sequence numbers
+        uint64_t    gaps;
+        //! Frames lost on the way from the camera to the host (driver counter)
+        uint64_t    transportSkipped;
+        //! Frames lost in the driver or API on the host (driver counter)
+        uint64_t    apiSkipped;
+        //! Frames the driver did not write into the pooled frame, so they had to be copied
+        uint64_t    copied;
+        //! Duration of the capture call in us
+        uint64_t    latencyP50Us;
+        uint64_t    latencyP99Us;
+        uint64_t    latencyMaxUs;
+    };
+
+    //! Reads driver counters and reports them with setSkipCounters
+    typedef std::function<void(CameraTelemetry &)> Sampler;
+
+    //! @param Name used in statistics
+    CameraTelemetry(const std::string &name);
+    ~CameraTelemetry();
+
+    /**
+     * @brief Counts a frame. Lock-free, for the capture thread.
+     *
+     * @param Sequence number of the frame as counted by the camera
+     * @param Duration of the capture call in us
+     */
+    void frameCaptured(uint64_t sequence, uint64_t latencyUs);
+
+    //! Counts a frame which had to be copied into its pooled frame. Lock-free.
+    void frameCopied();
+
+    //! Stores the cumulative skip counters of the driver (see Sampler).
+    void setSkipCounters(uint64_t transportSkipped, uint64_t apiSkipped);
+
+    //! Sets the function reading the driver counters. Set it before capturing.
+    void setSampler(Sampler sampler);
+
+    Snapshot snapshot() const;
+
+    /**
+     * @brief Runs the samplers of all cameras.
+     *
+     * @param Only sample cameras which lost frames since their last sample
+     */
+    static void sampleAll(bool onlyAfterLoss);
+
+    //! Samples all cameras and prints their counters and the system load to stdout.
+    static void logStats();
+
+private:
+    //! Histogram bucket of a latency. Four buckets per power of two.
+    static size_t bucketOf(uint64_t latencyUs);
+
+    //! Smallest latency falling into a bucket
+    static uint64_t bucketFloor(size_t bucket);
+
+    uint64_t percentile(double fraction) const;
+
+    static const size_t LATENCY_BUCKETS = 4 * 64;
+
+    const std::string       _Name;
+
+    std::atomic<uint64_t>   _Captured;
+    std::atomic<uint64_t>   _Lost;
+    std::atomic<uint64_t>   _Gaps;
+    std::atomic<uint64_t>   _TransportSkipped;
+    std::atomic<uint64_t>   _ApiSkipped;
+    std::atomic<uint64_t>   _Copied;
+    std::atomic<uint64_t>   _LastSequence;
+    std::atomic<uint64_t>   _LatencyMaxUs;
+    std::atomic<uint64_t>   _Latency[LATENCY_BUCKETS];
+
+    //! Set by the capture thread on a gap, cleared by the sampler
+    std::atomic<bool>       _LossPending;
+
+    //! _SamplerAccess Mutex so only one thread runs the sampler at a time
+    std::mutex              _SamplerAccess;
+    Sampler                 _Sampler;
+};
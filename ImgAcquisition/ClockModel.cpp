@@ -0,0 +1,163 @@
+#include "ClockModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+    //Observations before residuals are trusted enough to reject outliers
+    const uint64_t MIN_SAMPLES = 10;
+
+    //Lower bound of the rejection threshold, so a perfect fit does not reject everything
+    const double MIN_SIGMA_NS = 100000.0;
+
+    //Rejections in a row after which the camera clock is assumed to have jumped
+    const unsigned int MAX_CONSECUTIVE_OUTLIERS = 10;
+
+    //Changes of the UTC offset beyond this are clock steps, not slewing
+    const double UTC_STEP_NS = 100000000.0;
+
+    std::mutex &registryAccess() {
+        static std::mutex m;
+        return m;
+    }
+
+    //Deliberately leaked: camera threads may still update models during exit.
+    std::vector<ClockModel*> &registry() {
+        static auto *models = new std::vector<ClockModel*>();
+        return *models;
+    }
+}
+
+ClockModel::ClockModel(const std::string &name, double forgetting, double outlierSigmas) :
+    _Name(name), _Forgetting(forgetting), _OutlierSigmas(outlierSigmas) {
+    memset(&_Stats, 0, sizeof(_Stats));
+    reset();
+    _Stats.resets = 0;
+
+    std::lock_guard<std::mutex> lock(registryAccess());
+    registry().push_back(this);
+}
+
+ClockModel::~ClockModel() {
+    std::lock_guard<std::mutex> lock(registryAccess());
+    registry().erase(std::remove(registry().begin(), registry().end(), this), registry().end());
+}
+
+void ClockModel::reset() {
+    _CameraOrigin           = 0;
+    _HostOrigin             = 0;
+    _LastCameraNs           = 0;
+    _Weight                 = 0;
+    _MeanX                  = 0;
+    _MeanY                  = 0;
+    _Cxx                    = 0;
+    _Cxy                    = 0;
+    _ResidualVar            = 0;
+    _UtcOffsetNs            = 0;
+    _ConsecutiveOutliers    = 0;
+    _Stats.samples          = 0;
+    _Stats.maxResidualNs    = 0;
+    _Stats.resets++;
+}
+
+double ClockModel::predictUtc(double x) const {
+    const double y = _MeanY + _Cxy / _Cxx * (x - _MeanX);
+    return static_cast<double>(_HostOrigin) + y + _UtcOffsetNs;
+}
+
+uint64_t ClockModel::update(uint64_t cameraNs, uint64_t hostMonotonicNs, uint64_t hostUtcNs) {
+    std::lock_guard<std::mutex> lock(_Access);
+
+    const double utcOffset = static_cast<double>(static_cast<int64_t>(hostUtcNs - hostMonotonicNs));
+
+    if (_Stats.samples > 0 && cameraNs < _LastCameraNs) {
+        std::cout << "Warning: clock of " << _Name << " went backwards, restarting the clock model." << std::endl;
+        reset();
+    }
+    if (_Stats.samples == 0) {
+        _CameraOrigin   = cameraNs;
+        _HostOrigin     = hostMonotonicNs;
+        _UtcOffsetNs    = utcOffset;
+    }
+    _LastCameraNs = cameraNs;
+
+    const double x = static_cast<double>(cameraNs - _CameraOrigin);
+    const double y = static_cast<double>(static_cast<int64_t>(hostMonotonicNs - _HostOrigin));
+
+    //Reject observations far off the fit, e.g. frames delivered late
+    const bool fitted = _Stats.samples >= 2 && _Cxx > 0;
+    double residual = 0;
+    if (fitted) {
+        residual = y - (_MeanY + _Cxy / _Cxx * (x - _MeanX));
+        const double threshold = _OutlierSigmas * std::max(std::sqrt(_ResidualVar), MIN_SIGMA_NS);
+        if (_Stats.samples >= MIN_SAMPLES && std::fabs(residual) > threshold) {
+            _Stats.outliers++;
+            if (++_ConsecutiveOutliers < MAX_CONSECUTIVE_OUTLIERS) {
+                return static_cast<uint64_t>(std::llround(predictUtc(x)));
+            }
+            //The camera clock jumped: start over with this observation
+            std::cout << "Warning: " << _Name << " lost track of the camera clock, restarting the clock model." << std::endl;
+            reset();
+            _CameraOrigin   = cameraNs;
+            _HostOrigin     = hostMonotonicNs;
+            _LastCameraNs   = cameraNs;
+            _UtcOffsetNs    = utcOffset;
+            _Stats.samples  = 1;
+            _Weight         = 1;
+            return hostUtcNs;
+        }
+    }
+    _ConsecutiveOutliers = 0;
+
+    //Exponentially weighted update of means and co-moments
+    _Weight = _Forgetting * _Weight + 1.0;
+    const double dx = x - _MeanX;
+    const double dy = y - _MeanY;
+    _MeanX += dx / _Weight;
+    _MeanY += dy / _Weight;
+    _Cxx = _Forgetting * _Cxx + dx * (x - _MeanX);
+    _Cxy = _Forgetting * _Cxy + dx * (y - _MeanY);
+
+    if (fitted) {
+        _ResidualVar = _Forgetting * _ResidualVar + (1.0 - _Forgetting) * residual * residual;
+        _Stats.maxResidualNs = std::max(_Stats.maxResidualNs, std::fabs(residual));
+    }
+
+    //NTP slews the clocks slowly; steps are taken over right away
+    if (std::fabs(utcOffset - _UtcOffsetNs) > UTC_STEP_NS) {
+        _UtcOffsetNs = utcOffset;
+    } else {
+        _UtcOffsetNs += (1.0 - _Forgetting) * (utcOffset - _UtcOffsetNs);
+    }
+
+    _Stats.samples++;
+    if (_Stats.samples < 2 || _Cxx <= 0) {
+        return hostUtcNs;
+    }
+    return static_cast<uint64_t>(std::llround(predictUtc(x)));
+}
+
+ClockModel::Stats ClockModel::getStats() {
+    std::lock_guard<std::mutex> lock(_Access);
+    Stats s = _Stats;
+    s.residualStdDevNs = std::sqrt(_ResidualVar);
+    //The fit gives host time per camera time
+    s.driftPpm = (_Cxx > 0 && _Cxy > 0) ? (_Cxx / _Cxy - 1.0) * 1e6 : 0.0;
+    return s;
+}
+
+void ClockModel::logStats() {
+    std::lock_guard<std::mutex> lock(registryAccess());
+    for (ClockModel *model : registry()) {
+        Stats s = model->getStats();
+        std::cout << "Clock " << model->_Name << ": drift " << s.driftPpm << " ppm"
+                  << ", residual " << s.residualStdDevNs / 1000.0 << " us"
+                  << " (max " << s.maxResidualNs / 1000.0 << " us)"
+                  << ", " << s.samples << " samples"
+                  << ", " << s.outliers << " outliers"
+                  << ", " << s.resets << " restarts" << std::endl;
+    }
+}
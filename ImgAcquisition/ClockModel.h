@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/*!\brief Maps camera timestamps to drift-corrected UTC timestamps.
+ *
+ * Camera clocks drift against the host by tens of ppm, and the time at
+ * which the host sees a frame jitters with driver and scheduling delays.
+ * The model fits host monotonic time as a linear function of the camera
+ * time (online least squares with exponential forgetting). Timestamps are
+ * taken from the fit, so the jitter averages out while the drift is
+ * tracked. The monotonic clock is mapped to UTC with a smoothed offset.
+ *
+ * Observations far off the fit (e.g. a frame delivered late) are
+ * rejected. Many rejections in a row, or a camera clock going backwards,
+ * restart the model. Each update is O(1).
+ *
+ * Models register themselves, so their statistics can be printed with
+ * logStats().
+ */
+class ClockModel {
+public:
+
+    /**
+     * @brief Quality metrics of the fit.
+     */
+    struct Stats {
+        //! How much faster the camera clock runs than the host clock
+        double      driftPpm;
+        //! Standard deviation of the accepted host observations around the fit
+        double      residualStdDevNs;
+        //! Largest residual of an accepted observation since the last restart
+        double      maxResidualNs;
+        //! Accepted observations since the last restart
+        uint64_t    samples;
+        //! Rejected observations in total
+        uint64_t    outliers;
+        //! Number of restarts
+        uint64_t    resets;
+    };
+
+    /**
+     * @param Name used in statistics
+     * @param Weight of the previous observations per update, in (0, 1)
+     * @param Residuals beyond this many standard deviations are rejected
+     */
+    ClockModel(const std::string &name, double forgetting = 0.999, double outlierSigmas = 5.0);
+    ~ClockModel();
+
+    /**
+     * @brief Adds an observation and gets the timestamp of the frame.
+     *
+     * @param Camera timestamp of the frame in ns (monotonic, any epoch)
+     * @param Host monotonic time in ns at which the frame was received
+     * @param Host UTC time in ns at which the frame was received
+     * @return Drift-corrected UTC time of the frame in ns
+     */
+    uint64_t update(uint64_t cameraNs, uint64_t hostMonotonicNs, uint64_t hostUtcNs);
+
+    //! Forgets all observations. The next update starts a new fit.
+    void reset();
+
+    Stats getStats();
+
+    //! Prints the metrics of all models to stdout.
+    static void logStats();
+
+private:
+    //! UTC of a camera time according to the current fit. Caller holds _Access.
+    double predictUtc(double x) const;
+
+    const std::string   _Name;
+    const double        _Forgetting;
+    const double        _OutlierSigmas;
+
+    std::mutex          _Access;
+
+    //! Camera and host time of the first observation; x and y are relative to them
+    uint64_t            _CameraOrigin;
+    uint64_t            _HostOrigin;
+    uint64_t            _LastCameraNs;
+
+    //! Exponentially weighted sums of the fit
+    double              _Weight;
+    double              _MeanX;
+    double              _MeanY;
+    double              _Cxx;
+    double              _Cxy;
+    double              _ResidualVar;
+
+    //! UTC minus host monotonic time, smoothed
+    double              _UtcOffsetNs;
+
+    unsigned int        _ConsecutiveOutliers;
+    Stats               _Stats;
+};
@@ -0,0 +1,54 @@
+#include "EncoderBackend.h"
+#include "LibavEncoder.h"
+#include "SyntheticEncoder.h"
+#ifndef USE_ENCODER
+#include "nvenc/NvEncoder.h"
+#endif
+#include <iostream>
+
+namespace beeCompress {
+
+bool EncoderBackend::isAvailable(const std::string &name, std::string *reason) {
+    if (name == "nvenc") {
+#ifndef USE_ENCODER
+        return true;
+#else
+        *reason = "this build has no NVENC support (NO_ENCODER).";
+        return false;
+#endif
+    }
+    if (name == "libav") {
+#ifdef USE_LIBAV
+        return true;
+#else
+        *reason = "this build has no libavcodec support. Configure it WITH_LIBAV.";
+        return false;
+#endif
+    }
+    if (name == "synthetic") {
+        return true;
+    }
+    *reason = "unknown ENCODER_BACKEND \"" + name + "\". Use \"nvenc\", \"libav\" or \"synthetic\".";
+    return false;
+}
+
+std::unique_ptr<EncoderBackend> EncoderBackend::create(const std::string &name) {
+    std::string reason;
+    if (!isAvailable(name, &reason)) {
+        std::cout << "Error: " << reason << std::endl;
+        return nullptr;
+    }
+#ifndef USE_ENCODER
+    if (name == "nvenc") {
+        return std::unique_ptr<EncoderBackend>(new CNvEncoder());
+    }
+#endif
+#ifdef USE_LIBAV
+    if (name == "libav") {
+        return std::unique_ptr<EncoderBackend>(new LibavEncoder());
+    }
+#endif
+    return std::unique_ptr<EncoderBackend>(new SyntheticEncoder());
+}
+
+} /* namespace beeCompress */
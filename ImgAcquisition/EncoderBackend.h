@@ -0,0 +1,78 @@
+#ifndef ENCODERBACKEND_H_
+#define ENCODERBACKEND_H_
+
+#include "Buffer/MutexBuffer.h"
+#include "settings/Settings.h"
+#include <memory>
+#include <string>
+
+namespace beeCompress {
+
+class writeHandler;
+
+/**
+ * @brief A video encoder which writes one segment (video file) at a time.
+ *
+ * NvEncGlue takes the frames of a segment from a camera queue and calls
+ *
+ *   openSegment, submitFrame for every frame, flush, closeSegment
+ *
+ * in this order. The backend is reused for the following segments.
+ * Frames are 8 bit monochrome; each backend converts them to what its
+ * codec needs. The raw bitstream (Annex B) is passed to
+ * writeHandler::writeVideo.
+ *
+ * ENCODER_BACKEND selects the implementation:
+ * "nvenc"  HEVC on the GPU (CNvEncoder). Not built with NO_ENCODER.
+ * "libav"  HEVC or H.264 on the CPU through libavcodec (LibavEncoder).
+ *          Only built WITH_LIBAV.
+ * "synthetic" Placeholder units of a realistic size, for load tests
+ *          without a GPU (SyntheticEncoder).
+ */
+class EncoderBackend {
+public:
+
+    /**
+     * @brief Creates a backend.
+     *
+     * @param Name of the backend, see above
+     * @return The backend, or nullptr if it is unknown or not built in
+     */
+    static std::unique_ptr<EncoderBackend> create(const std::string &name);
+
+    /**
+     * @brief Whether create would succeed for a backend, to check the configuration.
+     *
+     * @param Name of the backend, see above
+     * @param Set to the reason if not
+     */
+    static bool isAvailable(const std::string &name, std::string *reason);
+
+    /**
+     * @brief Sets the encoder up for a new segment.
+     *
+     * @param Size, frame rate and rate control of the stream
+     * @param Handler owning the video file
+     * @return false if the encoder could not be set up. Only openSegment may follow.
+     */
+    virtual bool openSegment(const EncoderQualityConfig &cfg, writeHandler *wh) = 0;
+
+    //! Encodes a frame of the size passed to openSegment. The frame is not referenced afterwards.
+    virtual bool submitFrame(const ImageBuffer &img) = 0;
+
+    //! Encodes and writes all frames still pending in the encoder.
+    virtual bool flush() = 0;
+
+    /**
+     * @brief Releases the resources of the segment.
+     *
+     * @return Bytes written to the video file, or -1 on error
+     */
+    virtual long closeSegment() = 0;
+
+    virtual ~EncoderBackend() {}
+};
+
+} /* namespace beeCompress */
+
+#endif /* ENCODERBACKEND_H_ */
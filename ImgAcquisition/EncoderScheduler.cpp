@@ -0,0 +1,215 @@
+#include "EncoderScheduler.h"
+#include "Buffer/BufferWaiter.h"
+#include "Buffer/FramePool.h"
+#include "Buffer/MutexLinkedList.h"
+#include "Buffer/SpscRingBuffer.h"
+#include "settings/ParamNames.h"
+#include "settings/utility.h"
+#include <algorithm>
+#include <iostream>
+
+namespace beeCompress {
+
+//Preview queues count this much compared to main queues
+static const double PREVIEW_WEIGHT = 0.25;
+
+//Backlog which weighs as much as one second of age (about one full frame)
+static const double BYTES_PER_SECOND = 10e6;
+
+//Queues with frames which were not served for this long go first
+static const double STARVATION_SECONDS = 300.0;
+
+EncoderScheduler::EncoderScheduler() {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    _PreviewsEnabled = set->getValueOfParam<int>(IMACQUISITION::DO_PREVIEWS) == 1;
+    _DualPreview = _PreviewsEnabled
+                   && set->maybeGetValueOfParam<std::string>(IMACQUISITION::PREVIEW_MODE).get_value_or("queue") == "dual";
+}
+
+EncoderScheduler::~EncoderScheduler() {
+}
+
+MutexBuffer *EncoderScheduler::addCamera(int camid) {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    EncoderQualityConfig cfg = set->getBufferConf(camid, 0);
+    EncoderQualityConfig cfgPreview = set->getBufferConf(camid, 1);
+
+    //Grab buffer types from json config and initialize buffers.
+    std::unique_ptr<Queue> main(new Queue());
+    std::unique_ptr<Queue> preview(new Queue());
+    main->buffer = createBuffer(camid, 0);
+    preview->buffer = createBuffer(camid, 1);
+
+    main->camid = preview->camid = camid;
+    main->preview = false;
+    preview->preview = true;
+    main->previewOut = _PreviewsEnabled && !_DualPreview ? preview->buffer : nullptr;
+    preview->previewOut = nullptr;
+    main->dualPreview = _DualPreview && cfgPreview.camid >= 0;
+    preview->dualPreview = false;
+    main->cfg = cfg;
+    preview->cfg = cfgPreview;
+    main->cfgPreview = preview->cfgPreview = cfgPreview;
+
+    for (Queue *q : {main.get(), preview.get()}) {
+        q->worker = -1;
+        q->lastServed = std::chrono::steady_clock::now();
+        q->segments = 0;
+        q->totalWaitSeconds = 0;
+        q->maxWaitSeconds = 0;
+        q->totalSetupSeconds = 0;
+        q->maxSetupSeconds = 0;
+    }
+
+    //Preallocate storage for the downscaled preview frames. Dual encoding keeps none.
+    if (main->previewOut != nullptr && cfgPreview.camid >= 0) {
+        FramePool::reserve(cfgPreview.width, cfgPreview.height, cfgPreview.poolsize);
+    }
+
+    MutexBuffer *buffer = main->buffer;
+    std::lock_guard<std::mutex> lock(_Access);
+    _Queues.push_back(std::move(main));
+    _Queues.push_back(std::move(preview));
+    return buffer;
+}
+
+double EncoderScheduler::score(const Queue &queue, uint64_t nowNs, double *ageSeconds) const {
+    const uint64_t oldest = queue.buffer->oldestFrameNs();
+    *ageSeconds = (oldest > 0 && oldest < nowNs) ? (nowNs - oldest) / 1e9 : 0.0;
+
+    const double backlog = static_cast<double>(queue.buffer->size())
+                           * queue.cfg.width * queue.cfg.height;
+    const double weight = queue.preview ? PREVIEW_WEIGHT : 1.0;
+    return weight * (*ageSeconds + backlog / BYTES_PER_SECOND);
+}
+
+EncoderScheduler::Queue *EncoderScheduler::acquire(int worker, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(_Access);
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const uint64_t nowNs = get_utc_time_ns();
+
+    Queue *best = nullptr;
+    double bestScore = -1;
+    double bestAge = 0;
+    bool bestStarving = false;
+    std::vector<MutexBuffer*> idle;
+
+    for (std::unique_ptr<Queue> &q : _Queues) {
+        if (q->worker >= 0) {
+            continue;
+        }
+        idle.push_back(q->buffer);
+        if (q->buffer->size() == 0) {
+            continue;
+        }
+
+        double age;
+        double s = score(*q, nowNs, &age);
+        const double unserved = std::chrono::duration<double>(now - q->lastServed).count();
+        const bool starving = unserved > STARVATION_SECONDS;
+        if (starving) {
+            //Among starving queues the longest unserved one wins
+            s = unserved;
+        }
+        if (starving > bestStarving || (starving == bestStarving && s > bestScore)) {
+            best = q.get();
+            bestScore = s;
+            bestAge = age;
+            bestStarving = starving;
+        }
+    }
+
+    if (best == nullptr) {
+        //Sleep until a frame arrives. Released queues are seen after the timeout at the latest.
+        lock.unlock();
+        waitAny(idle, timeoutMs);
+        return nullptr;
+    }
+
+    best->worker = worker;
+    best->lastServed = now;
+    best->segments++;
+    best->totalWaitSeconds += bestAge;
+    best->maxWaitSeconds = std::max(best->maxWaitSeconds, bestAge);
+
+    std::cout << "Encoder " << worker << " chose cam " << best->camid
+              << (best->preview ? " preview" : "")
+              << ": " << best->buffer->size() << " frames, oldest waited " << bestAge << " s"
+              << (bestStarving ? " (starving)" : "") << std::endl;
+    return best;
+}
+
+void EncoderScheduler::release(Queue *queue, double setupSeconds) {
+    std::lock_guard<std::mutex> lock(_Access);
+    queue->totalSetupSeconds += setupSeconds;
+    queue->maxSetupSeconds = std::max(queue->maxSetupSeconds, setupSeconds);
+    queue->worker = -1;
+    queue->lastServed = std::chrono::steady_clock::now();
+}
+
+void EncoderScheduler::logStats() {
+    std::lock_guard<std::mutex> lock(_Access);
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (std::unique_ptr<Queue> &q : _Queues) {
+        std::cout << "Encoder queue cam " << q->camid << (q->preview ? " preview" : "")
+                  << ": " << q->segments << " segments, waited avg "
+                  << (q->segments > 0 ? q->totalWaitSeconds / q->segments : 0.0) << " s, max "
+                  << q->maxWaitSeconds << " s, setup avg "
+                  << (q->segments > 0 ? q->totalSetupSeconds / q->segments * 1000 : 0.0) << " ms, max "
+                  << q->maxSetupSeconds * 1000 << " ms, ";
+        if (q->worker >= 0) {
+            std::cout << "encoding on encoder " << q->worker;
+        } else {
+            std::cout << "idle for " << std::chrono::duration<double>(now - q->lastServed).count()
+                      << " s with " << q->buffer->size() << " frames";
+        }
+        std::cout << std::endl;
+    }
+}
+
+MutexBuffer *EncoderScheduler::createBuffer(int camid, int preview) {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    EncoderQualityConfig cfg = set->getBufferConf(camid, preview);
+
+    if (cfg.camid < 0) {
+        return new beeCompress::MutexLinkedList();
+    }
+
+    //Each of these buffers has one producer (camera or encoder) and one consumer (encoder) at a time
+    MutexBuffer *buffer;
+    if (cfg.queuetype == "spsc") {
+        buffer = new beeCompress::SpscRingBuffer(static_cast<size_t>(cfg.queuecapacity));
+        if (!cfg.spilldir.empty()) {
+            std::cout << "Warning: spsc buffers do not support SPILLDIR. Camera "
+                      << camid << " will not spill." << std::endl;
+        }
+    } else {
+        if (cfg.queuetype != "list") {
+            std::cout << "Warning: unknown QUEUETYPE " << cfg.queuetype
+                      << " for camera " << camid << ". Using list." << std::endl;
+        }
+        MutexLinkedList *list = new beeCompress::MutexLinkedList();
+        if (!cfg.spilldir.empty()) {
+            std::string path = cfg.spilldir + "/spill_cam" + std::to_string(camid)
+                               + (preview ? "_preview" : "") + ".bin";
+            if (!list->enableSpill(path, cfg.width, cfg.height,
+                                   static_cast<size_t>(cfg.spillframes),
+                                   static_cast<size_t>(cfg.spillhighwatermark))) {
+                std::cout << "Warning: spilling disabled for camera " << camid << std::endl;
+            }
+        }
+        buffer = list;
+    }
+
+    OverflowPolicy policy = parseOverflowPolicy(cfg.overflowpolicy);
+    if (policy == OverflowPolicy::DropOldest && cfg.queuetype == "spsc") {
+        std::cout << "Warning: spsc buffers can not drop their oldest frame. Camera "
+                  << camid << " drops the newest frame instead." << std::endl;
+    }
+    buffer->configure("cam" + std::to_string(camid) + (preview ? " preview" : ""),
+                      policy, cfg.overflowblockms, preview != 0);
+    return buffer;
+}
+
+} /* namespace beeCompress */
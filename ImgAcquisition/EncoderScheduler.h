@@ -0,0 +1,135 @@
+#ifndef ENCODERSCHEDULER_H_
+#define ENCODERSCHEDULER_H_
+
+#include "Buffer/MutexBuffer.h"
+#include "settings/Settings.h"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Hands camera queues to encoder workers.
+ *
+ * Every camera has a main queue (filled by the camera thread) and a
+ * preview queue (filled while its main queue is encoded). With
+ * PREVIEW.MODE "dual" the preview is encoded in the same pass as the
+ * main queue instead, and the preview queue stays empty. Any worker
+ * (NvEncGlue) can take any idle queue and encode one segment of it; a
+ * queue is served by at most one worker at a time, so each buffer still
+ * has a single consumer at any moment.
+ *
+ * The next queue is the one with the highest score
+ *
+ *   weight * (age of the oldest frame in s + backlog in bytes / BYTES_PER_SECOND)
+ *
+ * where weight is 1 for main and PREVIEW_WEIGHT for preview queues. A
+ * queue holding frames which has not been served for STARVATION_SECONDS
+ * goes first regardless of its score, the longest waiting one first.
+ *
+ * Each decision is printed. logStats() prints per queue how often it was
+ * served, how long its oldest frame waited for an encoder and how long
+ * the encoder took to set up a segment.
+ */
+class EncoderScheduler {
+public:
+
+    /**
+     * @brief One camera stream to encode.
+     *
+     * The fields below "guarded" belong to the scheduler.
+     */
+    struct Queue {
+        int                     camid;
+        bool                    preview;
+        //! Frames to encode
+        MutexBuffer             *buffer;
+        //! Where downscaled frames go while encoding. nullptr for preview queues.
+        MutexBuffer             *previewOut;
+        //! Whether the worker encodes the preview stream along with this queue
+        bool                    dualPreview;
+        EncoderQualityConfig    cfg;
+        EncoderQualityConfig    cfgPreview;
+
+        //guarded by the scheduler's _Access
+        //! Worker encoding this queue, -1 if idle
+        int                     worker;
+        //! When the queue was last handed out or released
+        std::chrono::steady_clock::time_point lastServed;
+        //! Number of segments handed out
+        uint64_t                segments;
+        //! Sum and maximum of the oldest frame's age at hand out, in s
+        double                  totalWaitSeconds;
+        double                  maxWaitSeconds;
+        //! Sum and maximum of the encoder setup time per segment, in s
+        double                  totalSetupSeconds;
+        double                  maxSetupSeconds;
+    };
+
+    /**
+     * @brief Creates an empty scheduler. Add cameras before starting workers.
+     */
+    EncoderScheduler();
+
+    /**
+     * @brief Creates the main and preview queue of a camera.
+     *
+     * The buffer implementation is chosen per buffer by QUEUETYPE.
+     *
+     * @param Cam number
+     * @return The buffer the camera thread writes to
+     */
+    MutexBuffer *addCamera(int camid);
+
+    /**
+     * @brief Takes the next queue to encode.
+     *
+     * Sleeps until a frame arrives if all idle queues are empty.
+     *
+     * @param Id of the worker, for logging
+     * @param Timeout in ms
+     * @return The queue, or nullptr on timeout. Pass it to release() when the segment is done.
+     */
+    Queue *acquire(int worker, int timeoutMs);
+
+    /**
+     * @brief Makes a queue available to other workers again.
+     *
+     * @param The queue returned by acquire()
+     * @param Time the encoder took to set up the segment, in s
+     */
+    void release(Queue *queue, double setupSeconds);
+
+    //! Prints the decisions, waiting and encoder setup times of all queues to stdout.
+    void logStats();
+
+    virtual ~EncoderScheduler();
+
+private:
+    //! Score of an idle queue. Caller holds _Access.
+    double score(const Queue &queue, uint64_t nowNs, double *ageSeconds) const;
+
+    /**
+     * @brief Creates the buffer as configured for the camera.
+     *
+     * @param Id of the camera
+     * @param 1 for the preview buffer, 0 otherwise
+     */
+    static MutexBuffer *createBuffer(int camid, int preview);
+
+    //! Whether main queues write preview frames (DO_PREVIEWS)
+    bool                    _PreviewsEnabled;
+
+    //! Whether previews are encoded in the pass of their main queue (PREVIEW.MODE "dual")
+    bool                    _DualPreview;
+
+    //! _Access Mutex to pick and release queues
+    std::mutex              _Access;
+    std::vector<std::unique_ptr<Queue>> _Queues;
+};
+
+} /* namespace beeCompress */
+
+#endif /* ENCODERSCHEDULER_H_ */
@@ -1,5 +1,6 @@
 #include "Flea3CamThread.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
@@ -10,6 +11,9 @@
 #include "Watchdog.h"
 #include "settings/Settings.h"
 #include "settings/utility.h"
+#include "ClockModel.h"
+#include "ThreadPlacement.h"
+#include "PooledCapture.h"
 #include "ImageAnalysis.h"
 #include <sstream> //stringstreams
 
@@ -23,12 +27,7 @@
 #include <stdint.h>
 #endif
 
-#if HALIDE
-#include "halideYuv420Conv.h"
-#include "Halide.h"
-//On Windows this might conflict with predefs
-#undef user_error
-#endif
+#include "LumaConversion.h"
 
 #include <opencv2/opencv.hpp>
 using namespace cv;
@@ -36,6 +35,10 @@ using namespace cv;
 //Flea3CamThread constructor
 Flea3CamThread::Flea3CamThread() {
     _initialized = false;
+    _ExposureUs = 0;
+    _GainDb = 0;
+    _CycleWraps = 0;
+    _LastCycleSeconds = 0;
 }
 
 //Flea3CamThread constructor
@@ -57,6 +60,20 @@ bool Flea3CamThread::initialize(unsigned int id,
     _Dog = dog;
 
     if (initCamera()) {
+        SettingsIAC *set = SettingsIAC::getInstance();
+        EncoderQualityConfig cfg = set->getBufferConf(_ID, 0);
+        _Pool = beeCompress::FramePool::reserve(cfg.width, cfg.height, cfg.poolsize,
+                                                ThreadPlacement::numaNode(ThreadPlacement::forCamera(_ID).cpus));
+
+        _Telemetry.reset(new CameraTelemetry("Cam " + std::to_string(_ID)));
+        _Telemetry->setSampler([this](CameraTelemetry &telemetry) {
+            CameraStats stats;
+            if (_Camera.GetStats(&stats) == PGRERROR_OK) {
+                telemetry.setSkipCounters(stats.imageXmitFailed + stats.imageCorrupt,
+                                          stats.imageDriverDropped);
+            }
+        });
+
         std::cout << "Starting capture on camera " << id << std::endl;
         _initialized = startCapture();
         std::cout << "Done starting capture." << std::endl;
@@ -82,8 +99,6 @@ bool Flea3CamThread::initCamera() {
     Format7ImageSettings fmt7ImageSettings;
 
     fmt7ImageSettings.mode = fmt7Mode;
-    fmt7ImageSettings.offsetX = 0;
-    fmt7ImageSettings.offsetY = 0;
     fmt7ImageSettings.width = cfg.width;
     fmt7ImageSettings.height = cfg.height;
     fmt7ImageSettings.pixelFormat = fmt7PixFmt;
@@ -125,7 +140,9 @@ bool Flea3CamThread::initCamera() {
     Error error;
 
     //Find hardware ID to serial number
-    for (int i = 0; i < 4; i++) {
+    unsigned int numberOfDevices = 0;
+    busMgr.GetNumOfCameras(&numberOfDevices);
+    for (int i = 0; i < static_cast<int>(numberOfDevices); i++) {
         unsigned int serial;
         Error error = busMgr.GetCameraSerialNumberFromIndex(i, &serial);
         if (error == PGRERROR_OK && serial == cfg.serial) {
@@ -167,6 +184,7 @@ bool Flea3CamThread::initCamera() {
     /////////////////// ALL THE PROCESS WITH FORMAT 7 ////////////////////////////////
 
     // Query for available Format 7 modes
+    fmt7Info.mode = fmt7Mode;
     if (!checkReturnCode(_Camera.GetFormat7Info(&fmt7Info, &supported))) {
         return false;
     }
@@ -174,6 +192,24 @@ bool Flea3CamThread::initCamera() {
     // Print the camera capabilities for fmt7
     PrintFormat7Capabilities(fmt7Info);
 
+    // Place the ROI on the sensor. A negative offset centers it.
+    {
+        const unsigned int marginX = fmt7Info.maxWidth > fmt7ImageSettings.width
+                                     ? fmt7Info.maxWidth - fmt7ImageSettings.width : 0;
+        const unsigned int marginY = fmt7Info.maxHeight > fmt7ImageSettings.height
+                                     ? fmt7Info.maxHeight - fmt7ImageSettings.height : 0;
+        unsigned int offsetX = cfg.offsetx < 0 ? marginX / 2 : std::min(static_cast<unsigned int>(cfg.offsetx), marginX);
+        unsigned int offsetY = cfg.offsety < 0 ? marginY / 2 : std::min(static_cast<unsigned int>(cfg.offsety), marginY);
+        if (fmt7Info.offsetHStepSize > 1) {
+            offsetX -= offsetX % fmt7Info.offsetHStepSize;
+        }
+        if (fmt7Info.offsetVStepSize > 1) {
+            offsetY -= offsetY % fmt7Info.offsetVStepSize;
+        }
+        fmt7ImageSettings.offsetX = offsetX;
+        fmt7ImageSettings.offsetY = offsetY;
+    }
+
     // Validate the settings to make sure that they are valid
     if (!checkReturnCode(
                 _Camera.ValidateFormat7Settings(&fmt7ImageSettings, &supported,
@@ -181,6 +217,18 @@ bool Flea3CamThread::initCamera() {
         return false;
     }
 
+    if (!supported && (fmt7ImageSettings.offsetX != 0 || fmt7ImageSettings.offsetY != 0)) {
+        // Fall back to the top left corner, as before offsets were supported
+        sendLogMessage(1, "Format7 offsets are not valid, using 0,0");
+        fmt7ImageSettings.offsetX = 0;
+        fmt7ImageSettings.offsetY = 0;
+        if (!checkReturnCode(
+                    _Camera.ValidateFormat7Settings(&fmt7ImageSettings, &supported,
+                            &fmt7PacketInfo))) {
+            return false;
+        }
+    }
+
     if (!supported) {
         // Settings are not valid
         sendLogMessage(1, "Format7 settings are not valid");
@@ -310,6 +358,9 @@ bool Flea3CamThread::initCamera() {
         return false;
     }
 
+    //Shutter is in ms
+    _ExposureUs = shutter.absValue * 1000.0f;
+
     sendLogMessage(3,
                    "New shutter parameter is: "
                    + QString().sprintf("%s and %.2f ms",
@@ -358,6 +409,8 @@ bool Flea3CamThread::initCamera() {
         return false;
     }
 
+    _GainDb = gain.absValue;
+
     sendLogMessage(3,
                    "New gain parameter is: "
                    + QString().sprintf("%s",
@@ -421,62 +474,18 @@ bool Flea3CamThread::startCapture() {
     return checkReturnCode(_Camera.StartCapture());
 }
 
-int flycapTo420NoHalide(uint8_t *yuvInput, FlyCapture2::Image *img) {
+int flycapTo420(uint8_t *outputImage, FlyCapture2::Image *inputImage) {
     /*  See: http://stackoverflow.com/questions/8349352/how-to-encode-grayscale-video-streams-with-ffmpeg */
 
-    int bytesRead = 0;
-    unsigned char *prtM = img->GetData();
     unsigned int rows, cols, stride;
     FlyCapture2::PixelFormat pixFmt;
     FlyCapture2::BayerTileFormat bayerFormat;
-    img->GetDimensions(&rows, &cols, &stride, &pixFmt, &bayerFormat);
-
-    //Being lazy pays: conversion in 58.22ms (don't set all channels - Cb and Cr are a waste of time)
-    unsigned int x = 0, y = 0;
-    for (y = 0; y < rows; y++) {
-        for (x = 0; x < cols; x++) {
-            yuvInput[y * cols + x] = (uint8_t)(0.895 * (*prtM) + 16);
-            prtM++;
-            bytesRead++;
-        }
-    }
-
-    return bytesRead;
-}
+    inputImage->GetDimensions(&rows, &cols, &stride, &pixFmt, &bayerFormat);
 
-int flycapTo420(uint8_t *outputImage, FlyCapture2::Image *inputImage) {
-    /*  See: http://stackoverflow.com/questions/8349352/how-to-encode-grayscale-video-streams-with-ffmpeg */
+    //Only luma is set, Cb and Cr are a waste of time
+    beeCompress::convertLuma(outputImage, cols, inputImage->GetData(), stride, cols, rows);
 
-    int bytesRead;
-#if HALIDE
-    unsigned long long time, time2;
-    unsigned char *prtM = inputImage->GetData();
-    unsigned int rows,cols,stride;
-    FlyCapture2::PixelFormat pixFmt;
-    FlyCapture2::BayerTileFormat bayerFormat;
-    inputImage->GetDimensions(&rows,&cols,&stride,&pixFmt,&bayerFormat);
-
-    //Precompiled code gets run in 17.88ms. BAM!
-    buffer_t input_buf = {0}, output_buf = {0};
-
-    // The host pointers point to the start of the image data:
-    input_buf.host = prtM;
-    output_buf.host = outputImage;
-    //See the halide tutorial how to set these.
-    input_buf.stride[0] = output_buf.stride[0] = 1;
-    input_buf.stride[1] = output_buf.stride[1] = stride;
-    input_buf.extent[0] = output_buf.extent[0] = cols;
-    input_buf.extent[1] = output_buf.extent[1] = rows;
-    input_buf.elem_size = output_buf.elem_size = 1;
-
-    //do it
-    int error = halideYuv420Conv(&input_buf, &output_buf);
-    bytesRead=rows*cols*3;//fool the system. We never read/written or set Cb and Cr
-#else
-    return flycapTo420NoHalide(outputImage, inputImage);
-#endif
-
-    return bytesRead;
+    return rows * cols;
 }
 
 void analyzeImage(int camid, FlyCapture2::Image *cimg, cv::Mat *ref,
@@ -515,6 +524,8 @@ void Flea3CamThread::run() {
     char timeresult[32];
     char logfilepathFull[256];
 
+    ThreadPlacement::apply(ThreadPlacement::forCamera(_ID), "Cam " + std::to_string(_ID));
+
     SettingsIAC *set = SettingsIAC::getInstance();
     EncoderQualityConfig cfg = set->getBufferConf(_ID, 0);
     std::string logdir = set->getValueOfParam<std::string>(
@@ -577,19 +588,29 @@ void Flea3CamThread::run() {
         }
     }
 
+    //Drift-corrected frame timestamps
+    ClockModel clock("Cam " + std::to_string(_ID));
+
     while (1) {
         _Dog->pulse(_ID);
+
+        //The driver writes the image straight into a pooled frame, which then goes
+        //into the queues without a copy. The metadata is filled in below.
+        std::shared_ptr<beeCompress::ImageBuffer> buf = _Pool->acquire(beeCompress::FrameMetadata());
         FlyCapture2::Image cimg;
+        cimg.SetData(buf->data, static_cast<unsigned int>(vwidth * vheight));
 
         std::chrono::steady_clock::time_point end =
             std::chrono::steady_clock::now();
         //Retrieve image and metadata
         Error e = _Camera.RetrieveBuffer(&cimg);
         //Get the timestamp
-        std::string currentTimestamp = get_utc_time();
+        const uint64_t currentTimestampNs = get_utc_time_ns();
 
         std::chrono::steady_clock::time_point begin =
             std::chrono::steady_clock::now();
+        const uint64_t currentMonotonicNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(begin.time_since_epoch()).count());
 
         //Check if processing a frame took longer than 0.4 seconds. If so, log the event.
         int duration = std::chrono::duration_cast<std::chrono::microseconds>(
@@ -612,11 +633,26 @@ void Flea3CamThread::run() {
             std::exit(1);
         }
 
+        //The driver may still have delivered elsewhere, e.g. after a video mode fallback
+        const beeCompress::DeliveredImage delivered = {
+            cimg.GetData(), static_cast<int>(cimg.GetCols()),
+            static_cast<int>(cimg.GetRows()), static_cast<int>(cimg.GetStride())
+        };
+        if (!beeCompress::adoptDeliveredImage(*buf, _Pool->slotSize(), delivered)) {
+            _Telemetry->frameCopied();
+        }
+
         //Grab metadata and timestamps from the images
         _ImInfo = cimg.GetMetadata();
         _FrameNumber = _ImInfo.embeddedFrameCounter;
+        _Telemetry->frameCaptured(_FrameNumber, static_cast<uint64_t>(duration));
         _TimeStamp = cimg.GetTimeStamp();
 
+        //The host timestamp jitters with the driver and queueing; the model
+        //derives the frame time from the camera clock instead
+        const uint64_t cameraTimestampNs = unwrapCycleTime(_TimeStamp);
+        const uint64_t frameUtcNs = clock.update(cameraTimestampNs, currentMonotonicNs, currentTimestampNs);
+
         //converts the time in seconds to local time
         timeinfo = localtime(&_TimeStamp.seconds);
 
@@ -642,12 +678,15 @@ void Flea3CamThread::run() {
 
         //Not in calibration mode. Move image to buffer for further procession
         if (!_Calibration->doCalibration) {
-            std::shared_ptr<beeCompress::ImageBuffer> buf = std::shared_ptr<
-                    beeCompress::ImageBuffer>(
-                        new beeCompress::ImageBuffer(vwidth, vheight, _ID,
-                                currentTimestamp));
-            //int numBytesRead = flycapTo420(buf.get()->data, &cimg);
-            memcpy(buf.get()->data, cimg.GetData(), vwidth * vheight);
+            beeCompress::FrameMetadata meta;
+            meta.camId              = _ID;
+            meta.cameraTimestampNs  = cameraTimestampNs;
+            meta.wallClockNs        = frameUtcNs;
+            meta.sequence           = _FrameNumber;
+            meta.exposureUs         = _ExposureUs;
+            meta.gainDb             = _GainDb;
+            buf->meta   = meta;
+            buf->camid  = meta.camId;
 
 #ifndef USE_ENCODER
             _Buffer->push(buf);
@@ -674,6 +713,18 @@ void Flea3CamThread::run() {
     return;
 }
 
+uint64_t Flea3CamThread::unwrapCycleTime(const TimeStamp &ts) {
+    if (ts.cycleSeconds < _LastCycleSeconds) {
+        _CycleWraps++;
+    }
+    _LastCycleSeconds = ts.cycleSeconds;
+
+    //A cycle is 125 us and has 3072 offset ticks
+    return (_CycleWraps * 128 + ts.cycleSeconds) * 1000000000ULL
+           + static_cast<uint64_t>(ts.cycleCount) * 125000ULL
+           + static_cast<uint64_t>(ts.cycleOffset) * 125000ULL / 3072;
+}
+
 void Flea3CamThread::logCriticalError(Error e) {
     char logfilepathFull[256];
     std::stringstream str;
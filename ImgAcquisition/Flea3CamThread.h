@@ -7,7 +7,10 @@
 #include "CamThread.h"
 #include "FlyCapture2.h"
 #include "Buffer/MutexBuffer.h"
+#include "Buffer/FramePool.h"
 #include "Watchdog.h"
+#include "CameraTelemetry.h"
+#include <memory>
 #include <mutex>
 using namespace FlyCapture2;
 
@@ -27,7 +30,7 @@ public:
     /**
      * @brief Initialization of cameras and configuration
      *
-     * @param Virtual ID of the camera (0 to 3)
+     * @param Virtual ID of the camera (0 to number of cameras - 1)
      * @param Buffer shared with the encoder thread
      * @param Buffer shared with the shared memory thread
      * @param Pointer to calibration data storeage
@@ -35,7 +38,7 @@ public:
      */
     virtual bool                initialize(unsigned int id, beeCompress::MutexBuffer *pBuffer,
                                    beeCompress::MutexBuffer *pSharedMemBuffer, CalibrationInfo *calib,
-                                   Watchdog *dog) override;  //here goes the camera ID (from 0 to 3)
+                                   Watchdog *dog) override;
 
     //! Object has been initialized using "initialize"
     virtual bool isInitialized() const override { return _initialized; }
@@ -138,6 +141,26 @@ private:
     //! time stamp from the current frame
     TimeStamp           _TimeStamp;
 
+    //! Wrap-arounds of the 128 s cycle timer seen so far
+    uint64_t            _CycleWraps;
+
+    //! Cycle seconds of the previous frame, to detect wrap-arounds
+    unsigned int        _LastCycleSeconds;
+
+    /**
+     * @brief Camera time of a frame in ns from the 1394 cycle timer
+     *
+     * The cycle seconds wrap every 128 s and are unwrapped here. Requires
+     * a frame at least every 128 s.
+     */
+    uint64_t            unwrapCycleTime(const TimeStamp &ts);
+
+    //! Shutter time in us as read back after configuring the camera
+    float               _ExposureUs;
+
+    //! Gain in dB as read back after configuring the camera
+    float               _GainDb;
+
     //! ... to enumerate each image in a second
     unsigned int        _LocalCounter;
 
@@ -147,6 +170,12 @@ private:
     //! Buffer shared with the shared memory thread
     beeCompress::MutexBuffer *_SharedMemBuffer;
 
+    //! Frame loss and latency counters (set by initialize)
+    std::unique_ptr<CameraTelemetry> _Telemetry;
+
+    //! Recycled storage for captured frames (set by initialize)
+    beeCompress::FramePool *_Pool;
+
 protected:
     void run(); //this is the function that will be iterated indefinitely
 
@@ -0,0 +1,228 @@
+#if HALIDE
+
+#include "HalideKernels.h"
+#include "HalideBuffer.h"
+#include "ImageScaling.h"
+#include "LumaConversion.h"
+
+#include "halideLumaRange_sse41.h"
+#include "halideLumaRange_avx2.h"
+#include "halideLumaRange_avx512.h"
+#include "halideDownscale2x_sse41.h"
+#include "halideDownscale2x_avx2.h"
+#include "halideDownscale2x_avx512.h"
+#include "halideDownscale4x_sse41.h"
+#include "halideDownscale4x_avx2.h"
+#include "halideDownscale4x_avx512.h"
+#include "halideFrameStats_sse41.h"
+#include "halideFrameStats_avx2.h"
+#include "halideFrameStats_avx512.h"
+
+#include <atomic>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    typedef int (*ImageKernel)(halide_buffer_t *in, halide_buffer_t *out);
+
+    struct Variant {
+        const char      *isa;
+        ImageKernel     lumaRange;
+        ImageKernel     downscale2x;
+        ImageKernel     downscale4x;
+        ImageKernel     frameStats;
+    };
+
+#define HALIDE_VARIANT(isa) { #isa, halideLumaRange_##isa, halideDownscale2x_##isa, \
+        halideDownscale4x_##isa, halideFrameStats_##isa }
+
+    //Best first
+    const Variant VARIANTS[] = {
+        HALIDE_VARIANT(avx512),
+        HALIDE_VARIANT(avx2),
+        HALIDE_VARIANT(sse41),
+    };
+
+#undef HALIDE_VARIANT
+
+    bool cpuSupports(const std::string &isa) {
+        if (isa == "avx512") {
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+                   && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl")
+                   && __builtin_cpu_supports("avx512cd");
+        }
+        if (isa == "avx2") {
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        }
+        if (isa == "sse41") {
+            return __builtin_cpu_supports("sse4.1");
+        }
+        return false;
+    }
+
+    //Wraps a pitched 8 bit image
+    Halide::Runtime::Buffer<uint8_t> image(const uint8_t *data, int pitch, int width, int height) {
+        halide_dimension_t shape[2] = { { 0, width, 1 }, { 0, height, pitch } };
+        return Halide::Runtime::Buffer<uint8_t>(const_cast<uint8_t*>(data), 2, shape);
+    }
+
+    bool lumaRange(const Variant *v, uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                   int width, int height) {
+        Halide::Runtime::Buffer<uint8_t> in = image(src, srcPitch, width, height);
+        Halide::Runtime::Buffer<uint8_t> out = image(dst, dstPitch, width, height);
+        return v->lumaRange(in.raw_buffer(), out.raw_buffer()) == 0;
+    }
+
+    bool downscale(const Variant *v, uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                   int srcWidth, int srcHeight, int factor) {
+        const int width = srcWidth / factor;
+        const int height = srcHeight / factor;
+        Halide::Runtime::Buffer<uint8_t> in = image(src, srcPitch, width * factor, height * factor);
+        Halide::Runtime::Buffer<uint8_t> out = image(dst, dstPitch, width, height);
+        ImageKernel kernel = factor == 2 ? v->downscale2x : v->downscale4x;
+        return kernel(in.raw_buffer(), out.raw_buffer()) == 0;
+    }
+
+    bool frameStats(const Variant *v, const uint8_t *src, int srcPitch, int width, int height,
+                    uint32_t histogram[256]) {
+        Halide::Runtime::Buffer<uint8_t> in = image(src, srcPitch, width, height);
+        Halide::Runtime::Buffer<uint32_t> out(histogram, 256);
+        return v->frameStats(in.raw_buffer(), out.raw_buffer()) == 0;
+    }
+
+    //Kernels of the variant which do not give the results of the C++ versions
+    std::vector<std::string> mismatches(const Variant *v) {
+        //Odd sizes leave vector tails, the pitch pads the rows
+        const int width = 1003, height = 201, pitch = 1040;
+        std::vector<uint8_t> src(static_cast<size_t>(pitch) * height);
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = static_cast<uint8_t>(i * 7 + i / 251);
+        }
+        std::vector<uint8_t> out(src.size()), ref(src.size());
+        auto same = [&](int w, int h) {
+            for (int y = 0; y < h; y++) {
+                if (memcmp(&out[static_cast<size_t>(y) * pitch], &ref[static_cast<size_t>(y) * pitch], w) != 0) {
+                    return false;
+                }
+            }
+            return true;
+        };
+        std::vector<std::string> failed;
+
+        beeCompress::convertLumaScalar(ref.data(), pitch, src.data(), pitch, width, height);
+        if (!lumaRange(v, out.data(), pitch, src.data(), pitch, width, height) || !same(width, height)) {
+            failed.push_back("lumaRange");
+        }
+
+        beeCompress::downscale2xScalar(ref.data(), pitch, src.data(), pitch, width, height);
+        if (!downscale(v, out.data(), pitch, src.data(), pitch, width, height, 2) || !same(width / 2, height / 2)) {
+            failed.push_back("downscale2x");
+        }
+
+        beeCompress::downscale4xScalar(ref.data(), pitch, src.data(), pitch, width, height);
+        if (!downscale(v, out.data(), pitch, src.data(), pitch, width, height, 4) || !same(width / 4, height / 4)) {
+            failed.push_back("downscale4x");
+        }
+
+        uint32_t hist[256];
+        uint32_t refHist[256] = {};
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                refHist[src[static_cast<size_t>(y) * pitch + x]]++;
+            }
+        }
+        if (!frameStats(v, src.data(), pitch, width, height, hist) || memcmp(hist, refHist, sizeof(hist)) != 0) {
+            failed.push_back("frameStats");
+        }
+        return failed;
+    }
+
+    const Variant *bestVariant() {
+        for (const Variant &v : VARIANTS) {
+            if (!cpuSupports(v.isa)) {
+                continue;
+            }
+            std::vector<std::string> failed = mismatches(&v);
+            if (failed.empty()) {
+                return &v;
+            }
+            std::cout << "Halide " << v.isa << " kernels differ from the C++ versions:";
+            for (const std::string &kernel : failed) {
+                std::cout << " " << kernel;
+            }
+            std::cout << ". Not used." << std::endl;
+        }
+        return nullptr;
+    }
+
+    std::atomic<const Variant*> &selected() {
+        static std::atomic<const Variant*> variant(bestVariant());
+        return variant;
+    }
+
+    const Variant *supportedVariant(const std::string &isa) {
+        for (const Variant &v : VARIANTS) {
+            if (isa == v.isa && cpuSupports(v.isa)) {
+                return &v;
+            }
+        }
+        return nullptr;
+    }
+}
+
+namespace beeCompress {
+
+const char *HalideKernels::isa() {
+    const Variant *v = selected().load();
+    return v ? v->isa : nullptr;
+}
+
+std::vector<std::string> HalideKernels::supportedIsas() {
+    std::vector<std::string> isas;
+    for (const Variant &v : VARIANTS) {
+        if (cpuSupports(v.isa)) {
+            isas.push_back(v.isa);
+        }
+    }
+    return isas;
+}
+
+bool HalideKernels::useIsa(const std::string &isa) {
+    const Variant *v = supportedVariant(isa);
+    if (v == nullptr) {
+        return false;
+    }
+    selected().store(v);
+    return true;
+}
+
+std::vector<std::string> HalideKernels::check(const std::string &isa) {
+    const Variant *v = supportedVariant(isa);
+    if (v == nullptr) {
+        return std::vector<std::string>(1, isa + " (not supported by this CPU)");
+    }
+    return mismatches(v);
+}
+
+bool HalideKernels::lumaRange(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                              int width, int height) {
+    const Variant *v = selected().load();
+    return v != nullptr && ::lumaRange(v, dst, dstPitch, src, srcPitch, width, height);
+}
+
+bool HalideKernels::downscale(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                              int srcWidth, int srcHeight, int factor) {
+    const Variant *v = selected().load();
+    return v != nullptr && (factor == 2 || factor == 4)
+           && ::downscale(v, dst, dstPitch, src, srcPitch, srcWidth, srcHeight, factor);
+}
+
+bool HalideKernels::frameStats(const uint8_t *src, int srcPitch, int width, int height,
+                               uint32_t histogram[256]) {
+    const Variant *v = selected().load();
+    return v != nullptr && ::frameStats(v, src, srcPitch, width, height, histogram);
+}
+
+} /* namespace beeCompress */
+
+#endif /* HALIDE */
@@ -0,0 +1,75 @@
+#ifndef HALIDEKERNELS_H_
+#define HALIDEKERNELS_H_
+
+#if HALIDE
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Runs the Halide kernels compiled ahead of time by halidePreCompile.
+ *
+ * Each kernel exists for SSE4.1, AVX2 and AVX-512. At the first call the
+ * best variant this CPU supports whose kernels give the same results as
+ * the C++ versions (see check) is chosen. All functions return false if no
+ * variant fits or the kernel fails; callers then use their plain C++ code.
+ * Images are 8 bit gray with a pitch (bytes per row).
+ */
+class HalideKernels {
+public:
+
+    //! Variant in use: "avx512", "avx2" or "sse41". nullptr if the CPU lacks SSE4.1.
+    static const char *isa();
+
+    //! Variants this CPU can run, best first.
+    static std::vector<std::string> supportedIsas();
+
+    /**
+     * @brief Uses the given variant from now on, e.g. to compare them. It is not checked.
+     *
+     * @return false if the CPU can not run it. The variant is not changed then.
+     */
+    static bool useIsa(const std::string &isa);
+
+    /**
+     * @brief Compares the kernels of a variant with the C++ versions on test images.
+     *
+     * Reference are convertLumaScalar, downscale2xScalar, downscale4xScalar
+     * and a plain histogram. The images have odd sizes and padded rows.
+     *
+     * @param Variant, which the CPU has to support
+     * @return Names of the kernels which differ or fail, empty if all agree
+     */
+    static std::vector<std::string> check(const std::string &isa);
+
+    //! Range conversion as convertLuma does it.
+    static bool lumaRange(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                          int width, int height);
+
+    /**
+     * @brief Box filter downscale by 2 or 4.
+     *
+     * @param Destination of (srcWidth / factor) x (srcHeight / factor) pixels
+     * @param Pitch of the destination
+     * @param Source frame
+     * @param Pitch of the source
+     * @param Width of the source
+     * @param Height of the source
+     * @param 2 or 4
+     */
+    static bool downscale(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                          int srcWidth, int srcHeight, int factor);
+
+    //! Counts the pixels of each gray value.
+    static bool frameStats(const uint8_t *src, int srcPitch, int width, int height,
+                           uint32_t histogram[256]);
+};
+
+} /* namespace beeCompress */
+
+#endif /* HALIDE */
+
+#endif /* HALIDEKERNELS_H_ */
@@ -6,6 +6,10 @@
  */
 
 #include "ImageAnalysis.h"
+#include "settings/utility.h"
+#include "settings/ParamNames.h"
+#include "ThreadPlacement.h"
+#include "HalideKernels.h"
 #include <math.h>       /* cos */
 #include <vector>
 #include <algorithm>
@@ -19,9 +23,13 @@
 namespace beeCompress {
 using namespace cv;
 
+//Most images taken from the buffer at once
+static const size_t ANALYSIS_BATCH_SIZE = 4;
+
 ImageAnalysis::ImageAnalysis(std::string p_logfile, Watchdog *p_dog) {
     _Logfile = p_logfile;
     _Buffer = new beeCompress::MutexLinkedList();
+    _Buffer->configure("analysis", OverflowPolicy::DropNewest, 0, true);
     _Dog = p_dog;
 }
 
@@ -30,6 +38,8 @@ ImageAnalysis::~ImageAnalysis() {
 }
 
 void ImageAnalysis::run() {
+    ThreadPlacement::apply(ThreadPlacement::get(IMACQUISITION::THREADS_ANALYSIS), "Analysis");
+
     cv::Mat ref;
     char outstr[512];
 
@@ -45,19 +55,25 @@ void ImageAnalysis::run() {
 
     while (true) {
         //Pulse(5) signals analysis thread is alive
-        _Dog->pulse(5);
-
-        std::shared_ptr<beeCompress::ImageBuffer> imgptr = _Buffer->pop();
-        beeCompress::ImageBuffer *img = imgptr.get();
-        cv::Mat mat(img->height, img->width, cv::DataType<uint8_t>::type);
-        mat.data = img->data;
-        double smd = sumModulusDifference(&mat);
-        double variance = getVariance(mat);
-        double contrast = avgHistDifference(ref, mat);
-        double noise = noiseEstimate(mat);
-        sprintf(outstr, "Cam_%d_%s: %f,\t%f,\t%f,\t%f,\t%f\n", img->camid,
-                img->timestamp.c_str(), smd, variance, contrast, noise);
-        fwrite(outstr, sizeof(char), strlen(outstr), outfile);
+        _Dog->pulse(_Dog->analysisSlot());
+
+        //Time out now and then so the watchdog keeps getting pulses
+        std::vector<std::shared_ptr<beeCompress::ImageBuffer>> batch = _Buffer->popBatch(ANALYSIS_BATCH_SIZE, 1000);
+        if (batch.empty()) {
+            continue;
+        }
+        for (const std::shared_ptr<beeCompress::ImageBuffer> &imgptr : batch) {
+            beeCompress::ImageBuffer *img = imgptr.get();
+            cv::Mat mat(img->height, img->width, cv::DataType<uint8_t>::type,
+                    img->data, static_cast<size_t>(img->stride));
+            double smd = sumModulusDifference(&mat);
+            double variance = getVariance(mat);
+            double contrast = avgHistDifference(ref, mat);
+            double noise = noiseEstimate(mat);
+            sprintf(outstr, "Cam_%d_%s: %f,\t%f,\t%f,\t%f,\t%f\n", img->camid,
+                    format_utc_time(img->meta.wallClockNs).c_str(), smd, variance, contrast, noise);
+            fwrite(outstr, sizeof(char), strlen(outstr), outfile);
+        }
         fflush(outfile);
     }
 
@@ -82,6 +98,21 @@ double ImageAnalysis::getContrastRatio(Mat &image) {
 
 double ImageAnalysis::getVariance(Mat &image) {
     //http://www.lfb.rwth-aachen.de/bibtexupload/pdf/GRO10a.pdf
+#if HALIDE
+    //Same value from the histogram, without the double precision copies
+    uint32_t hist[256];
+    if (image.type() == CV_8U && beeCompress::HalideKernels::frameStats(image.data,
+            static_cast<int>(image.step), image.cols, image.rows, hist)) {
+        double n = 0, s = 0, s2 = 0;
+        for (int v = 0; v < 256; v++) {
+            n += hist[v];
+            s += static_cast<double>(hist[v]) * v;
+            s2 += static_cast<double>(hist[v]) * v * v;
+        }
+        double mean = s / n;
+        return s2 / n - mean * mean;
+    }
+#endif
     Mat out(image.size(), cv::DataType<double>::type);
     Mat squared(image.size(), cv::DataType<double>::type);
     Mat in(image.size(), cv::DataType<double>::type);
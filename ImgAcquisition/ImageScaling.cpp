@@ -0,0 +1,346 @@
+#include "ImageScaling.h"
+#include "HalideKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SCALE_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define SCALE_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SCALE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+    //Area filter weights are fixed point with this many fraction bits per direction
+    const int AREA_BITS = 12;
+    const uint32_t AREA_ONE = 1u << AREA_BITS;
+
+    //Rows of a 2x2 block: a is the upper, b the lower one
+    typedef void (*Row2x)(uint8_t *dst, const uint8_t *a, const uint8_t *b, int dstWidth);
+    //Rows of a 4x4 block, top to bottom
+    typedef void (*Row4x)(uint8_t *dst, const uint8_t *const *rows, int dstWidth);
+
+    inline void row2xScalar(uint8_t *dst, const uint8_t *a, const uint8_t *b, int from, int dstWidth) {
+        for (int x = from; x < dstWidth; x++) {
+            const int sum = a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1];
+            dst[x] = static_cast<uint8_t>((sum + 2) >> 2);
+        }
+    }
+
+    inline void row4xScalar(uint8_t *dst, const uint8_t *const *rows, int from, int dstWidth) {
+        for (int x = from; x < dstWidth; x++) {
+            int sum = 0;
+            for (int r = 0; r < 4; r++) {
+                const uint8_t *p = rows[r] + 4 * x;
+                sum += p[0] + p[1] + p[2] + p[3];
+            }
+            dst[x] = static_cast<uint8_t>((sum + 8) >> 4);
+        }
+    }
+
+    void row2xC(uint8_t *dst, const uint8_t *a, const uint8_t *b, int dstWidth) {
+        row2xScalar(dst, a, b, 0, dstWidth);
+    }
+
+    void row4xC(uint8_t *dst, const uint8_t *const *rows, int dstWidth) {
+        row4xScalar(dst, rows, 0, dstWidth);
+    }
+
+#ifdef SCALE_X86
+    //Sums of the horizontal pixel pairs of 16 bytes as 8 words
+    inline __m128i pairSums(__m128i v) {
+        const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+        return _mm_add_epi16(_mm_and_si128(v, lowBytes), _mm_srli_epi16(v, 8));
+    }
+
+    inline __m128i load(const uint8_t *p) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+
+    void row2xSse2(uint8_t *dst, const uint8_t *a, const uint8_t *b, int dstWidth) {
+        const __m128i two = _mm_set1_epi16(2);
+        int x = 0;
+        for (; x + 16 <= dstWidth; x += 16) {
+            __m128i lo = _mm_add_epi16(pairSums(load(a + 2 * x)), pairSums(load(b + 2 * x)));
+            __m128i hi = _mm_add_epi16(pairSums(load(a + 2 * x + 16)), pairSums(load(b + 2 * x + 16)));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+        }
+        row2xScalar(dst, a, b, x, dstWidth);
+    }
+
+    //Sums of 4x4 blocks of 16 columns as 4 dwords
+    inline __m128i blockSums(const uint8_t *const *rows, int offset) {
+        const __m128i lowWords = _mm_set1_epi32(0x0000FFFF);
+        __m128i pairs = _mm_add_epi16(_mm_add_epi16(pairSums(load(rows[0] + offset)), pairSums(load(rows[1] + offset))),
+                                      _mm_add_epi16(pairSums(load(rows[2] + offset)), pairSums(load(rows[3] + offset))));
+        return _mm_add_epi32(_mm_and_si128(pairs, lowWords), _mm_srli_epi32(pairs, 16));
+    }
+
+    void row4xSse2(uint8_t *dst, const uint8_t *const *rows, int dstWidth) {
+        const __m128i eight = _mm_set1_epi16(8);
+        int x = 0;
+        for (; x + 16 <= dstWidth; x += 16) {
+            //At most 16 * 255, so the signed packing keeps every sum
+            __m128i lo = _mm_packs_epi32(blockSums(rows, 4 * x), blockSums(rows, 4 * x + 16));
+            __m128i hi = _mm_packs_epi32(blockSums(rows, 4 * x + 32), blockSums(rows, 4 * x + 48));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, eight), 4);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, eight), 4);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+        }
+        row4xScalar(dst, rows, x, dstWidth);
+    }
+#endif
+
+#ifdef SCALE_AVX2
+    __attribute__((target("avx2")))
+    inline __m256i pairSums256(const uint8_t *p) {
+        const __m256i lowBytes = _mm256_set1_epi16(0x00FF);
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        return _mm256_add_epi16(_mm256_and_si256(v, lowBytes), _mm256_srli_epi16(v, 8));
+    }
+
+    __attribute__((target("avx2")))
+    void row2xAvx2(uint8_t *dst, const uint8_t *a, const uint8_t *b, int dstWidth) {
+        const __m256i two = _mm256_set1_epi16(2);
+        int x = 0;
+        for (; x + 32 <= dstWidth; x += 32) {
+            __m256i lo = _mm256_add_epi16(pairSums256(a + 2 * x), pairSums256(b + 2 * x));
+            __m256i hi = _mm256_add_epi16(pairSums256(a + 2 * x + 32), pairSums256(b + 2 * x + 32));
+            lo = _mm256_srli_epi16(_mm256_add_epi16(lo, two), 2);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(hi, two), 2);
+            //Packing works per 128 bit lane; restore the order of the quarters
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), packed);
+        }
+        row2xScalar(dst, a, b, x, dstWidth);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i blockSums256(const uint8_t *const *rows, int offset) {
+        const __m256i lowWords = _mm256_set1_epi32(0x0000FFFF);
+        __m256i pairs = _mm256_add_epi16(_mm256_add_epi16(pairSums256(rows[0] + offset), pairSums256(rows[1] + offset)),
+                                         _mm256_add_epi16(pairSums256(rows[2] + offset), pairSums256(rows[3] + offset)));
+        return _mm256_add_epi32(_mm256_and_si256(pairs, lowWords), _mm256_srli_epi32(pairs, 16));
+    }
+
+    __attribute__((target("avx2")))
+    void row4xAvx2(uint8_t *dst, const uint8_t *const *rows, int dstWidth) {
+        const __m256i eight = _mm256_set1_epi16(8);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        int x = 0;
+        for (; x + 32 <= dstWidth; x += 32) {
+            __m256i lo = _mm256_packs_epi32(blockSums256(rows, 4 * x), blockSums256(rows, 4 * x + 32));
+            __m256i hi = _mm256_packs_epi32(blockSums256(rows, 4 * x + 64), blockSums256(rows, 4 * x + 96));
+            lo = _mm256_srli_epi16(_mm256_add_epi16(lo, eight), 4);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(hi, eight), 4);
+            //Both packs interleave the lanes; each dword now holds 4 pixels in the wrong place
+            __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), order);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), packed);
+        }
+        row4xScalar(dst, rows, x, dstWidth);
+    }
+#endif
+
+#ifdef SCALE_NEON
+    void row2xNeon(uint8_t *dst, const uint8_t *a, const uint8_t *b, int dstWidth) {
+        int x = 0;
+        for (; x + 8 <= dstWidth; x += 8) {
+            uint16x8_t sum = vpadalq_u8(vpaddlq_u8(vld1q_u8(a + 2 * x)), vld1q_u8(b + 2 * x));
+            vst1_u8(dst + x, vrshrn_n_u16(sum, 2));
+        }
+        row2xScalar(dst, a, b, x, dstWidth);
+    }
+
+    void row4xNeon(uint8_t *dst, const uint8_t *const *rows, int dstWidth) {
+        int x = 0;
+        for (; x + 8 <= dstWidth; x += 8) {
+            uint16x8_t lo = vpaddlq_u8(vld1q_u8(rows[0] + 4 * x));
+            uint16x8_t hi = vpaddlq_u8(vld1q_u8(rows[0] + 4 * x + 16));
+            for (int r = 1; r < 4; r++) {
+                lo = vpadalq_u8(lo, vld1q_u8(rows[r] + 4 * x));
+                hi = vpadalq_u8(hi, vld1q_u8(rows[r] + 4 * x + 16));
+            }
+            uint16x8_t sum = vcombine_u16(vpadd_u16(vget_low_u16(lo), vget_high_u16(lo)),
+                                          vpadd_u16(vget_low_u16(hi), vget_high_u16(hi)));
+            vst1_u8(dst + x, vrshrn_n_u16(sum, 4));
+        }
+        row4xScalar(dst, rows, x, dstWidth);
+    }
+#endif
+
+    struct Kernels {
+        Row2x       row2x;
+        Row4x       row4x;
+        const char  *isa;
+    };
+
+    Kernels selectKernels() {
+#ifdef SCALE_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernels { row2xAvx2, row4xAvx2, "avx2" };
+        }
+#endif
+#ifdef SCALE_X86
+        return Kernels { row2xSse2, row4xSse2, "sse2" };
+#elif defined(SCALE_NEON)
+        return Kernels { row2xNeon, row4xNeon, "neon" };
+#else
+        return Kernels { row2xC, row4xC, "c" };
+#endif
+    }
+
+    const Kernels &kernels() {
+        static const Kernels selected = selectKernels();
+        return selected;
+    }
+
+    void scale2x(Row2x row, uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int srcWidth, int srcHeight) {
+        for (int y = 0; y < srcHeight / 2; y++) {
+            const uint8_t *a = src + static_cast<size_t>(2 * y) * srcPitch;
+            row(dst + static_cast<size_t>(y) * dstPitch, a, a + srcPitch, srcWidth / 2);
+        }
+    }
+
+    void scale4x(Row4x row, uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int srcWidth, int srcHeight) {
+        for (int y = 0; y < srcHeight / 4; y++) {
+            const uint8_t *top = src + static_cast<size_t>(4 * y) * srcPitch;
+            const uint8_t *rows[4] = { top, top + srcPitch, top + 2 * srcPitch, top + 3 * srcPitch };
+            row(dst + static_cast<size_t>(y) * dstPitch, rows, srcWidth / 4);
+        }
+    }
+
+    //Source pixels and weights (summing to AREA_ONE) of each destination pixel along one axis
+    struct AreaTaps {
+        std::vector<int>        first;
+        std::vector<int>        count;
+        std::vector<int>        offset;
+        std::vector<uint32_t>   weight;
+    };
+
+    AreaTaps areaTaps(int srcSize, int dstSize) {
+        AreaTaps taps;
+        const double scale = static_cast<double>(srcSize) / dstSize;
+        for (int i = 0; i < dstSize; i++) {
+            const double start = i * scale;
+            const double end = std::min((i + 1) * scale, static_cast<double>(srcSize));
+            const int first = static_cast<int>(start);
+            const int last = std::max(first, static_cast<int>(std::ceil(end)) - 1);
+
+            taps.first.push_back(first);
+            taps.count.push_back(last - first + 1);
+            taps.offset.push_back(static_cast<int>(taps.weight.size()));
+
+            uint32_t total = 0;
+            for (int j = first; j <= last; j++) {
+                const double overlap = std::min(end, j + 1.0) - std::max(start, static_cast<double>(j));
+                const uint32_t w = static_cast<uint32_t>(std::lround(overlap / scale * AREA_ONE));
+                taps.weight.push_back(w);
+                total += w;
+            }
+            //Rounding may miss the total by a little; the largest tap absorbs it
+            std::vector<uint32_t>::iterator heaviest =
+                std::max_element(taps.weight.begin() + taps.offset.back(), taps.weight.end());
+            *heaviest += AREA_ONE - total;
+        }
+        return taps;
+    }
+}
+
+namespace beeCompress {
+
+void downscale2x(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int srcWidth, int srcHeight) {
+#if HALIDE
+    if (HalideKernels::downscale(dst, dstPitch, src, srcPitch, srcWidth, srcHeight, 2)) {
+        return;
+    }
+#endif
+    scale2x(kernels().row2x, dst, dstPitch, src, srcPitch, srcWidth, srcHeight);
+}
+
+void downscale4x(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int srcWidth, int srcHeight) {
+#if HALIDE
+    if (HalideKernels::downscale(dst, dstPitch, src, srcPitch, srcWidth, srcHeight, 4)) {
+        return;
+    }
+#endif
+    scale4x(kernels().row4x, dst, dstPitch, src, srcPitch, srcWidth, srcHeight);
+}
+
+void downscale2xScalar(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                       int srcWidth, int srcHeight) {
+    scale2x(row2xC, dst, dstPitch, src, srcPitch, srcWidth, srcHeight);
+}
+
+void downscale4xScalar(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                       int srcWidth, int srcHeight) {
+    scale4x(row4xC, dst, dstPitch, src, srcPitch, srcWidth, srcHeight);
+}
+
+void downscaleArea(uint8_t *dst, int dstPitch, int dstWidth, int dstHeight,
+                   const uint8_t *src, int srcPitch, int srcWidth, int srcHeight) {
+    const AreaTaps cols = areaTaps(srcWidth, dstWidth);
+    const AreaTaps rows = areaTaps(srcHeight, dstHeight);
+
+    //A row filtered horizontally holds at most 255 * AREA_ONE per pixel,
+    //the vertical sum 255 * AREA_ONE^2 plus rounding, which fits 32 bit.
+    std::vector<uint32_t> filtered(dstWidth);
+    std::vector<uint32_t> sum(dstWidth);
+    for (int y = 0; y < dstHeight; y++) {
+        std::fill(sum.begin(), sum.end(), 0);
+        for (int k = 0; k < rows.count[y]; k++) {
+            const uint8_t *line = src + static_cast<size_t>(rows.first[y] + k) * srcPitch;
+            const uint32_t wy = rows.weight[rows.offset[y] + k];
+            for (int x = 0; x < dstWidth; x++) {
+                const uint8_t *p = line + cols.first[x];
+                const uint32_t *w = &cols.weight[cols.offset[x]];
+                uint32_t h = 0;
+                for (int j = 0; j < cols.count[x]; j++) {
+                    h += w[j] * p[j];
+                }
+                filtered[x] = h;
+            }
+            for (int x = 0; x < dstWidth; x++) {
+                sum[x] += wy * filtered[x];
+            }
+        }
+        uint8_t *out = dst + static_cast<size_t>(y) * dstPitch;
+        for (int x = 0; x < dstWidth; x++) {
+            out[x] = static_cast<uint8_t>((sum[x] + (1u << (2 * AREA_BITS - 1))) >> (2 * AREA_BITS));
+        }
+    }
+}
+
+void downscale(uint8_t *dst, int dstPitch, int dstWidth, int dstHeight,
+               const uint8_t *src, int srcPitch, int srcWidth, int srcHeight) {
+    if (srcWidth / 2 == dstWidth && srcHeight / 2 == dstHeight) {
+        downscale2x(dst, dstPitch, src, srcPitch, srcWidth, srcHeight);
+    } else if (srcWidth / 4 == dstWidth && srcHeight / 4 == dstHeight) {
+        downscale4x(dst, dstPitch, src, srcPitch, srcWidth, srcHeight);
+    } else {
+        downscaleArea(dst, dstPitch, dstWidth, dstHeight, src, srcPitch, srcWidth, srcHeight);
+    }
+}
+
+const char *imageScalingIsa() {
+#if HALIDE
+    if (HalideKernels::isa() != nullptr) {
+        return "halide";
+    }
+#endif
+    return kernels().isa;
+}
+
+} /* namespace beeCompress */
@@ -0,0 +1,53 @@
+#ifndef IMAGESCALING_H_
+#define IMAGESCALING_H_
+
+#include <cstdint>
+
+namespace beeCompress {
+
+/**
+ * @brief Downscales an 8 bit gray image by averaging (area filter).
+ *
+ * Every destination pixel is the rounded mean of the source area it
+ * covers. Halving and quartering both sides are the common preview
+ * sizes; they run as box filters with AVX2 or SSE2 on x86 (chosen at
+ * runtime) and NEON on ARM, or the Halide kernel if built WITH_HALIDE
+ * and it passed HalideKernels::check. Other ratios use a fixed point area filter in plain C. The
+ * destination must not be larger than the source.
+ *
+ * @param Destination
+ * @param Bytes from one destination row to the next
+ * @param Width of the destination
+ * @param Height of the destination
+ * @param Source frame
+ * @param Bytes from one source row to the next
+ * @param Width of the source
+ * @param Height of the source
+ */
+void downscale(uint8_t *dst, int dstPitch, int dstWidth, int dstHeight,
+               const uint8_t *src, int srcPitch, int srcWidth, int srcHeight);
+
+//! Box filter by 2 in both directions. The destination has (srcWidth / 2) x (srcHeight / 2) pixels.
+void downscale2x(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int srcWidth, int srcHeight);
+
+//! Box filter by 4 in both directions. The destination has (srcWidth / 4) x (srcHeight / 4) pixels.
+void downscale4x(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int srcWidth, int srcHeight);
+
+//! Area filter for any ratio, as downscale uses it for sizes other than 1/2 and 1/4.
+void downscaleArea(uint8_t *dst, int dstPitch, int dstWidth, int dstHeight,
+                   const uint8_t *src, int srcPitch, int srcWidth, int srcHeight);
+
+//! Plain C versions of downscale2x and downscale4x, e.g. to check the vectorized ones.
+void downscale2xScalar(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                       int srcWidth, int srcHeight);
+void downscale4xScalar(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                       int srcWidth, int srcHeight);
+
+//! Instruction set of the box filters on this CPU: "halide", "avx2", "sse2", "neon" or "c".
+const char *imageScalingIsa();
+
+} /* namespace beeCompress */
+
+#endif /* IMAGESCALING_H_ */
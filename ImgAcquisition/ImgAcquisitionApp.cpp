@@ -3,6 +3,13 @@
 #include "settings/ParamNames.h"
 #include "settings/utility.h"
 #include "Watchdog.h"
+#include "Buffer/BufferBudget.h"
+#include "Buffer/FramePool.h"
+#include "SyntheticCamThread.h"
+#include "ClockModel.h"
+#include "CameraTelemetry.h"
+#include "EncoderBackend.h"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
@@ -123,7 +130,7 @@ void ImgAcquisitionApp::resolveLocks() {
     found = exchangedirprevSet.find_last_of("/\\");
     std::string exchangedirprev = exchangedirprevSet.substr(0, found) + "/";
 
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < set->getCameraCount(); i++) {
         char src[512];
         char dst[512];
         sprintf(src, imdir.c_str(), i, 0);
@@ -141,16 +148,19 @@ void ImgAcquisitionApp::resolveLocks() {
 ImgAcquisitionApp::ImgAcquisitionApp(int &argc, char **argv) :
     QCoreApplication(argc, argv) //
 {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    //One camera slot per CAMID in the configuration
+    const int numSlots = set->getCameraCount();
     CalibrationInfo calib;
-    Watchdog dog;
+    Watchdog dog(numSlots);
     int numCameras = 0;
     int camsStarted = 0;
-    SettingsIAC *set = SettingsIAC::getInstance();
     calib.doCalibration = false;            // When calibrating cameras only
+    calib.calibrationData.assign(numSlots, {{0, 0, 0, 0}});
     //Do not do image analysis on regular recordings
     //analysis              = new beeCompress::ImageAnalysis(
     //      set->getValueOfParam<std::string>(IMACQUISITION::ANALYSISFILE), &dog);
-    _smthread = new beeCompress::SharedMemory();
+    _smthread = new beeCompress::SharedMemory(numSlots);
 
     std::cout << "Successfully parsed config!" << std::endl;
 
@@ -167,7 +177,18 @@ ImgAcquisitionApp::ImgAcquisitionApp(int &argc, char **argv) :
 
     printBuildInfo();
     resolveLocks();
-    numCameras = checkCameras(); // when the number of cameras is insufficient it should interrupt the program
+    //Synthetic cameras need no hardware, so the app may run without any camera attached
+    int numSynthetic = 0;
+    for (int i = 0; i < numSlots; i++) {
+        if (SyntheticCamThread::isSynthetic(i)) {
+            numSynthetic++;
+        }
+    }
+    numCameras = checkCameras(numSynthetic == 0); // when the number of cameras is insufficient it should interrupt the program
+    if (numCameras < 0 && numSynthetic > 0) {
+        numCameras = 0;
+    }
+    numCameras += numSynthetic;
 
     int camcountConf = set->getValueOfParam<int>(IMACQUISITION::CAMCOUNT);
     if (numCameras < camcountConf){
@@ -179,8 +200,12 @@ ImgAcquisitionApp::ImgAcquisitionApp(int &argc, char **argv) :
     }
 
     // Initialize CamThreads and connect the respective signals.
-    for (int i = 0; i < 4; i++)
+    _threads.resize(numSlots);
+    for (int i = 0; i < numSlots; i++)
     {
+        if (SyntheticCamThread::isSynthetic(i)) {
+            _threads[i] = std::unique_ptr<CamThread> { static_cast<CamThread*>(new SyntheticCamThread()) };
+        } else
 #ifdef USE_FLYCAPTURE
         _threads[i] = std::unique_ptr<CamThread> { static_cast<CamThread*>(new Flea3CamThread()) };
 #else
@@ -192,22 +217,37 @@ ImgAcquisitionApp::ImgAcquisitionApp(int &argc, char **argv) :
 
     cout << "Connected " << numCameras << " cameras." << endl;
 
-    //the threads are initialized as a private variable of the class ImgAcquisitionApp
-    _threads[0]->initialize(0, (_glue1._Buffer1), _smthread->_Buffer, &calib, &dog);
-    _threads[1]->initialize(1, (_glue2._Buffer1), _smthread->_Buffer, &calib, &dog);
-    _threads[2]->initialize(2, (_glue1._Buffer2), _smthread->_Buffer, &calib, &dog);
-    _threads[3]->initialize(3, (_glue2._Buffer2), _smthread->_Buffer, &calib, &dog);
+    //A misspelled or missing encoder backend would leave every queue without a consumer
+    const std::string backendName =
+        set->maybeGetValueOfParam<std::string>(IMACQUISITION::ENCODER_BACKEND).get_value_or("nvenc");
+    std::string backendError;
+    if (!beeCompress::EncoderBackend::isAvailable(backendName, &backendError)) {
+        std::cout << "Configuration error: " << backendError << std::endl;
+        slackpost("Configuration error: " + backendError, 2);
+        std::exit(2);
+    }
 
-    //Map the buffers to camera id's
-    _glue1._CamBuffer1 = 0;
-    _glue1._CamBuffer2 = 2;
-    _glue2._CamBuffer1 = 1;
-    _glue2._CamBuffer2 = 3;
+    //Every camera has a main and a preview queue; any glue may encode any of them.
+    _scheduler.reset(new beeCompress::EncoderScheduler());
+    _preview = beeCompress::PreviewScaler::fromSettings();
+
+    //One encoder session per glue. Consumer GPUs allow only a few of them.
+    int numEncoders = set->maybeGetValueOfParam<int>(IMACQUISITION::ENCODERCOUNT).get_value_or(2);
+    numEncoders = std::max(1, std::min(numEncoders, 2 * numSlots));
+    for (int i = 0; i < numEncoders; i++) {
+        _glues.emplace_back(new beeCompress::NvEncGlue(_scheduler.get(), _preview.get(), i));
+    }
+
+    //The threads are initialized as a private variable of the class ImgAcquisitionApp
+    for (int i = 0; i < numSlots; i++) {
+        beeCompress::MutexBuffer *buffer = _scheduler->addCamera(i);
+        _threads[i]->initialize(i, buffer, _smthread->_Buffer, &calib, &dog);
+    }
 
     cout << "Initialized " << numCameras << " cameras." << endl;
 
     //execute run() function, spawns cam readers
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < numSlots; i++) {
         if (_threads[i]->isInitialized()) {
             _threads[i]->start();
             camsStarted++;
@@ -217,12 +257,12 @@ ImgAcquisitionApp::ImgAcquisitionApp(int &argc, char **argv) :
     cout << "Started " << camsStarted << " camera threads." << endl;
 
     //Start encoder threads
-    //The if(numCameras>=2) is not required here. If only one camera is present,
-    //the other glue thread will sleep most of the time.
-    _glue1.start();
-    _glue2.start();
+    //Idle glues sleep until one of the queues receives a frame.
+    for (std::unique_ptr<beeCompress::NvEncGlue> &glue : _glues) {
+        glue->start();
+    }
 
-    cout << "Started the encoder threads." << endl;
+    cout << "Started " << _glues.size() << " encoder threads." << endl;
 
     //While normal recording, start analysis thread to
     //log image statistics
@@ -243,22 +283,28 @@ ImgAcquisitionApp::ImgAcquisitionApp(int &argc, char **argv) :
              << "*************************************" << std::endl;
         printf("CamId,\tSMD,\tVar,\tCont,\tNoise\n");
         calib.dataAccess.lock();
-        for (int i = 0; i < 4; i++)
-            printf("Cam %d: %f,\t%f,\t%f,\t%f\n", i,
+        for (size_t i = 0; i < calib.calibrationData.size(); i++)
+            printf("Cam %zu: %f,\t%f,\t%f,\t%f\n", i,
                    calib.calibrationData[i][0], calib.calibrationData[i][1],
                    calib.calibrationData[i][2], calib.calibrationData[i][3]);
 
         calib.dataAccess.unlock();
         cpsleep(500*1000);
     }
-    while (true) {
+    for (unsigned long loopCount = 1; true; loopCount++) {
         dog.check();
+        //Read the driver's skip counters soon after a camera lost frames
+        CameraTelemetry::sampleAll(true);
 #ifdef WITH_DEBUG_IMAGE_OUTPUT
         for (int i = 0; i < 5 * 1000; ++i)
             cv::waitKey(100);
 #else
         cpsleep(500*1000);
 #endif
+        //Print statistics about once a minute
+        if (loopCount % 120 == 0) {
+            logStatistics();
+        }
     }
 }
 
@@ -282,7 +328,7 @@ void ImgAcquisitionApp::printBuildInfo() {
 }
 
 // This function checks that at least one camera is connected
-int ImgAcquisitionApp::checkCameras() {
+int ImgAcquisitionApp::checkCameras(bool required) {
 #ifdef USE_FLYCAPTURE
     FlyCapture2::BusManager cc_busMgr;
     FlyCapture2::Error error;
@@ -302,7 +348,7 @@ int ImgAcquisitionApp::checkCameras() {
     qDebug() << "Number of cameras detected: " << _numCameras << endl << endl;
 
     //Find hardware ID to serial number
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < static_cast<int>(_numCameras); i++) {
 #ifdef USE_FLYCAPTURE
         unsigned int serial;
         Error error = cc_busMgr.GetCameraSerialNumberFromIndex(i, &serial);
@@ -327,7 +373,7 @@ int ImgAcquisitionApp::checkCameras() {
 #endif
     }
 
-    if (_numCameras < 1) {
+    if (_numCameras < 1 && required) {
         cout << "Insufficient number of cameras... press Enter to exit."
              << endl;
         logMessage(1, "Insufficient number of cameras ...");
@@ -337,6 +383,20 @@ int ImgAcquisitionApp::checkCameras() {
     return _numCameras;
 }
 
+// Prints counters which help sizing buffers and pools
+void ImgAcquisitionApp::logStatistics() {
+    beeCompress::FramePool::logStats();
+    beeCompress::BufferBudget::logStats();
+    ClockModel::logStats();
+    CameraTelemetry::logStats();
+    if (_scheduler) {
+        _scheduler->logStats();
+    }
+    if (_preview) {
+        _preview->logStats();
+    }
+}
+
 // The slot for signals generated from the threads
 void ImgAcquisitionApp::logMessage(int prio, QString message) {
     qDebug() << message;
@@ -5,9 +5,12 @@
 #include <QtGui/QKeyEvent>
 #include "CamThread.h"
 #include "ImageAnalysis.h"
+#include "EncoderScheduler.h"
 #include "NvEncGlue.h"
+#include "PreviewScaler.h"
 #include "SharedMemory.h"
 #include <memory>
+#include <vector>
 
 //inherits from QCoreApplication
 class ImgAcquisitionApp : public QCoreApplication
@@ -39,8 +42,11 @@ public:
 
     /**
      * @brief This function checks that at least one camera is connected
+     *
+     * @param Whether to complain and wait for the user if none is connected
+     * @return Number of connected cameras, -1 on errors
      */
-    int                         checkCameras();
+    int                         checkCameras(bool required = true);
 
     /**
      * @brief Find and fix any partially written videos
@@ -50,18 +56,29 @@ public:
      */
     void                        resolveLocks();
 
+    /**
+     * @brief Prints statistics of the frame pools, buffers, camera clocks, frame loss and encoder queues to stdout
+     */
+    void                        logStatistics();
+
 private:
     //! Shared memory thread pointer
     beeCompress::SharedMemory   *_smthread;
 
-    //! A vector of the class CamThread, they are accessed from the constructor
-    std::unique_ptr<CamThread> _threads[4];
+    //! A vector of the class CamThread, one per configured camera, they are accessed from the constructor
+    std::vector<std::unique_ptr<CamThread>> _threads;
 
     //! Number of detected cameras
     unsigned int                _numCameras;
 
-    //! Glue objects which handle encoder workers
-    beeCompress::NvEncGlue      _glue1,_glue2;
+    //! Hands the camera queues to the encoder workers
+    std::unique_ptr<beeCompress::EncoderScheduler> _scheduler;
+
+    //! Downscales frames for the preview queues, shared by the glues
+    std::unique_ptr<beeCompress::PreviewScaler> _preview;
+
+    //! Glue objects which handle encoder workers (ENCODERCOUNT)
+    std::vector<std::unique_ptr<beeCompress::NvEncGlue>> _glues;
 
     /**
      * @brief Helper function of resolveLocks
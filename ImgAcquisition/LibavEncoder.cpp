@@ -0,0 +1,189 @@
+#ifdef USE_LIBAV
+
+#include "LibavEncoder.h"
+#include "writeHandler.h"
+#include "settings/ParamNames.h"
+
+#include <cstring>
+#include <iostream>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
+}
+
+namespace {
+    std::string errorString(int err) {
+        char buf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(err, buf, sizeof(buf));
+        return buf;
+    }
+
+    bool supportsGray(const AVCodec *codec) {
+        for (const AVPixelFormat *fmt = codec->pix_fmts; fmt != nullptr && *fmt != AV_PIX_FMT_NONE; fmt++) {
+            if (*fmt == AV_PIX_FMT_GRAY8) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+namespace beeCompress {
+
+LibavEncoder::LibavEncoder() :
+    _Context(nullptr), _Frame(nullptr), _Packet(nullptr), _NeutralChroma(nullptr),
+    _Out(nullptr), _Bytes(0), _Pts(0), _Error(false) {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    _Codec = set->maybeGetValueOfParam<std::string>(IMACQUISITION::LIBAV_CODEC).get_value_or("libx265");
+    _Preset = set->maybeGetValueOfParam<std::string>(IMACQUISITION::LIBAV_PRESET).get_value_or("fast");
+    _Threads = set->maybeGetValueOfParam<int>(IMACQUISITION::LIBAV_THREADS).get_value_or(0);
+}
+
+LibavEncoder::~LibavEncoder() {
+    release();
+}
+
+bool LibavEncoder::openSegment(const EncoderQualityConfig &cfg, writeHandler *wh) {
+    release();
+
+    const AVCodec *codec = avcodec_find_encoder_by_name(_Codec.c_str());
+    if (codec == nullptr) {
+        std::cout << "Error: libavcodec has no encoder \"" << _Codec << "\"." << std::endl;
+        return false;
+    }
+
+    _Context = avcodec_alloc_context3(codec);
+    _Frame = av_frame_alloc();
+    _Packet = av_packet_alloc();
+    if (_Context == nullptr || _Frame == nullptr || _Packet == nullptr) {
+        release();
+        return false;
+    }
+
+    _Context->width = cfg.width;
+    _Context->height = cfg.height;
+    _Context->time_base = AVRational { 1, cfg.fps };
+    _Context->framerate = AVRational { cfg.fps, 1 };
+    _Context->pix_fmt = supportsGray(codec) ? AV_PIX_FMT_GRAY8 : AV_PIX_FMT_YUV420P;
+    _Context->color_range = AVCOL_RANGE_JPEG;
+    _Context->gop_size = cfg.idrinterval > 0 ? cfg.idrinterval : cfg.totalFrames;
+    _Context->max_b_frames = 0;
+    _Context->thread_count = _Threads;
+
+    av_opt_set(_Context->priv_data, "preset", _Preset.c_str(), 0);
+    if (cfg.rcmode == 0) {
+        av_opt_set_int(_Context->priv_data, "qp", cfg.qp, 0);
+    } else {
+        _Context->bit_rate = cfg.bitrate;
+    }
+    if (_Codec == "libx265") {
+        //Closed GOPs, so every keyframe is an IDR frame the index can seek to
+        av_opt_set(_Context->priv_data, "x265-params", "log-level=warning:open-gop=0", 0);
+    }
+
+    int err = avcodec_open2(_Context, codec, nullptr);
+    if (err < 0) {
+        std::cout << "Error: could not open " << _Codec << " for " << cfg.width << "x" << cfg.height
+                  << ": " << errorString(err) << std::endl;
+        release();
+        return false;
+    }
+
+    _Frame->format = _Context->pix_fmt;
+    _Frame->width = cfg.width;
+    _Frame->height = cfg.height;
+    err = av_frame_get_buffer(_Frame, 0);
+    if (err < 0) {
+        std::cout << "Error: could not allocate a " << _Codec << " frame: " << errorString(err) << std::endl;
+        release();
+        return false;
+    }
+
+    //The index reads the NAL unit headers of the pictures
+    switch (codec->id) {
+    case AV_CODEC_ID_HEVC:
+        wh->setCodec(VideoCodec::HEVC);
+        break;
+    case AV_CODEC_ID_H264:
+        wh->setCodec(VideoCodec::H264);
+        break;
+    default:
+        wh->setCodec(VideoCodec::Unknown);
+        break;
+    }
+
+    _Out = wh;
+    _Bytes = 0;
+    _Pts = 0;
+    _Error = false;
+    return true;
+}
+
+bool LibavEncoder::submitFrame(const ImageBuffer &img) {
+    //The codec may still hold the previous frame
+    int err = av_frame_make_writable(_Frame);
+    if (err < 0) {
+        std::cout << "Error: " << _Codec << " frame not writable: " << errorString(err) << std::endl;
+        _Error = true;
+        return false;
+    }
+
+    av_image_copy_plane(_Frame->data[0], _Frame->linesize[0], img.data, img.stride,
+                        img.width, img.height);
+
+    //Chroma never changes; it is only set when the frame got new storage
+    if (_Context->pix_fmt == AV_PIX_FMT_YUV420P && _NeutralChroma != _Frame->data[1]) {
+        const int chromaHeight = (img.height + 1) / 2;
+        memset(_Frame->data[1], 128, static_cast<size_t>(_Frame->linesize[1]) * chromaHeight);
+        memset(_Frame->data[2], 128, static_cast<size_t>(_Frame->linesize[2]) * chromaHeight);
+        _NeutralChroma = _Frame->data[1];
+    }
+
+    _Frame->pts = _Pts++;
+    return encode(_Frame);
+}
+
+bool LibavEncoder::flush() {
+    return encode(nullptr);
+}
+
+long LibavEncoder::closeSegment() {
+    release();
+    return _Error ? -1 : _Bytes;
+}
+
+bool LibavEncoder::encode(AVFrame *frame) {
+    int err = avcodec_send_frame(_Context, frame);
+    if (err < 0) {
+        std::cout << "Error: " << _Codec << " did not take a frame: " << errorString(err) << std::endl;
+        _Error = true;
+        return false;
+    }
+
+    while ((err = avcodec_receive_packet(_Context, _Packet)) >= 0) {
+        if (!_Out->writeVideo(_Packet->data, static_cast<size_t>(_Packet->size))) {
+            std::cout << "Error: could not write the " << _Codec << " bitstream." << std::endl;
+            _Error = true;
+        }
+        _Bytes += _Packet->size;
+        av_packet_unref(_Packet);
+    }
+    if (err != AVERROR(EAGAIN) && err != AVERROR_EOF) {
+        std::cout << "Error: " << _Codec << " failed: " << errorString(err) << std::endl;
+        _Error = true;
+    }
+    return !_Error;
+}
+
+void LibavEncoder::release() {
+    avcodec_free_context(&_Context);
+    av_frame_free(&_Frame);
+    av_packet_free(&_Packet);
+    _NeutralChroma = nullptr;
+}
+
+} /* namespace beeCompress */
+
+#endif /* USE_LIBAV */
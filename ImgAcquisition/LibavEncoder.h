@@ -0,0 +1,81 @@
+#ifndef LIBAVENCODER_H_
+#define LIBAVENCODER_H_
+
+#ifdef USE_LIBAV
+
+#include "EncoderBackend.h"
+#include <string>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+namespace beeCompress {
+
+/**
+ * @brief Encodes on the CPU through libavcodec.
+ *
+ * Settings (IMACQUISITION.LIBAV.*):
+ * CODEC    libavcodec encoder, e.g. "libx265" (default) or "libx264". Other
+ *          codecs than HEVC and H.264 are written without index.
+ * PRESET   Encoder preset, e.g. "ultrafast" to "veryslow". Default "fast".
+ * THREADS  Threads per encoder. 0 (default) lets the codec use all cores.
+ *
+ * Frames are passed as monochrome (4:0:0, AV_PIX_FMT_GRAY8) if the codec
+ * supports it, otherwise as 4:2:0 with neutral chroma. Rate control
+ * follows the buffer's RCMODE: 0 encodes with constant QP, anything
+ * else with the average BITRATE. As in the NVENC stream, a keyframe
+ * starts the segment and then every IDRINTERVAL frames; with an
+ * IDRINTERVAL of 0 it is the only one.
+ */
+class LibavEncoder : public EncoderBackend {
+public:
+
+    //! Reads the LIBAV settings. The codec is opened per segment.
+    LibavEncoder();
+
+    bool openSegment(const EncoderQualityConfig &cfg, writeHandler *wh) override;
+
+    bool submitFrame(const ImageBuffer &img) override;
+
+    bool flush() override;
+
+    long closeSegment() override;
+
+    virtual ~LibavEncoder();
+
+private:
+
+    /**
+     * @brief Sends a frame to the codec and writes the packets it returns.
+     *
+     * @param The frame, or nullptr to drain the codec
+     */
+    bool encode(AVFrame *frame);
+
+    //! Frees the codec context, frame and packet of the segment
+    void release();
+
+    std::string     _Codec;
+    std::string     _Preset;
+    int             _Threads;
+
+    AVCodecContext  *_Context;
+    AVFrame         *_Frame;
+    AVPacket        *_Packet;
+
+    //! Chroma plane filled with 128, nullptr for monochrome frames
+    uint8_t         *_NeutralChroma;
+
+    //! Handler of the segment's video file
+    writeHandler    *_Out;
+    long            _Bytes;
+    int64_t         _Pts;
+    bool            _Error;
+};
+
+} /* namespace beeCompress */
+
+#endif /* USE_LIBAV */
+
+#endif /* LIBAVENCODER_H_ */
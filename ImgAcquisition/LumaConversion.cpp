@@ -0,0 +1,150 @@
+#include "LumaConversion.h"
+#include "HalideKernels.h"
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LUMA_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define LUMA_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LUMA_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+    //0.895 in 16 bit fixed point. Truncates like the float formula for every input.
+    const int LUMA_SCALE = 58656;
+    const int LUMA_OFFSET = 16;
+
+    inline uint8_t lumaPixel(uint8_t x) {
+        return static_cast<uint8_t>(((x * LUMA_SCALE) >> 16) + LUMA_OFFSET);
+    }
+
+    inline void lumaRowScalar(uint8_t *dst, const uint8_t *src, int from, int width) {
+        for (int x = from; x < width; x++) {
+            dst[x] = lumaPixel(src[x]);
+        }
+    }
+
+    typedef void (*LumaRow)(uint8_t *dst, const uint8_t *src, int width);
+
+    void lumaRowC(uint8_t *dst, const uint8_t *src, int width) {
+        lumaRowScalar(dst, src, 0, width);
+    }
+
+#ifdef LUMA_X86
+    void lumaRowSse2(uint8_t *dst, const uint8_t *src, int width) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i scale = _mm_set1_epi16(static_cast<short>(LUMA_SCALE));
+        const __m128i offset = _mm_set1_epi16(LUMA_OFFSET);
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(in, zero), scale);
+            __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(in, zero), scale);
+            lo = _mm_add_epi16(lo, offset);
+            hi = _mm_add_epi16(hi, offset);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(lo, hi));
+        }
+        lumaRowScalar(dst, src, x, width);
+    }
+#endif
+
+#ifdef LUMA_AVX2
+    __attribute__((target("avx2")))
+    void lumaRowAvx2(uint8_t *dst, const uint8_t *src, int width) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i scale = _mm256_set1_epi16(static_cast<short>(LUMA_SCALE));
+        const __m256i offset = _mm256_set1_epi16(LUMA_OFFSET);
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+            //Unpacking and packing both work per 128 bit lane, so the order is kept
+            __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x));
+            __m256i lo = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(in, zero), scale);
+            __m256i hi = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(in, zero), scale);
+            lo = _mm256_add_epi16(lo, offset);
+            hi = _mm256_add_epi16(hi, offset);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), _mm256_packus_epi16(lo, hi));
+        }
+        lumaRowScalar(dst, src, x, width);
+    }
+#endif
+
+#ifdef LUMA_NEON
+    void lumaRowNeon(uint8_t *dst, const uint8_t *src, int width) {
+        const uint8x8_t offset = vdup_n_u8(LUMA_OFFSET);
+        int x = 0;
+        for (; x + 8 <= width; x += 8) {
+            uint16x8_t in = vmovl_u8(vld1_u8(src + x));
+            uint32x4_t lo = vmull_n_u16(vget_low_u16(in), LUMA_SCALE);
+            uint32x4_t hi = vmull_n_u16(vget_high_u16(in), LUMA_SCALE);
+            uint16x8_t scaled = vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+            vst1_u8(dst + x, vadd_u8(vmovn_u16(scaled), offset));
+        }
+        lumaRowScalar(dst, src, x, width);
+    }
+#endif
+
+    struct Kernel {
+        LumaRow     row;
+        const char  *isa;
+    };
+
+    Kernel selectKernel() {
+#ifdef LUMA_AVX2
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernel { lumaRowAvx2, "avx2" };
+        }
+#endif
+#ifdef LUMA_X86
+        return Kernel { lumaRowSse2, "sse2" };
+#elif defined(LUMA_NEON)
+        return Kernel { lumaRowNeon, "neon" };
+#else
+        return Kernel { lumaRowC, "c" };
+#endif
+    }
+
+    const Kernel &kernel() {
+        static const Kernel selected = selectKernel();
+        return selected;
+    }
+
+    void convertRows(LumaRow row, uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                     int width, int height) {
+        for (int y = 0; y < height; y++) {
+            row(dst + static_cast<size_t>(y) * dstPitch, src + static_cast<size_t>(y) * srcPitch, width);
+        }
+    }
+}
+
+namespace beeCompress {
+
+void convertLuma(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int width, int height) {
+#if HALIDE
+    if (HalideKernels::lumaRange(dst, dstPitch, src, srcPitch, width, height)) {
+        return;
+    }
+#endif
+    convertRows(kernel().row, dst, dstPitch, src, srcPitch, width, height);
+}
+
+void convertLumaScalar(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                       int width, int height) {
+    convertRows(lumaRowC, dst, dstPitch, src, srcPitch, width, height);
+}
+
+const char *lumaConversionIsa() {
+#if HALIDE
+    if (HalideKernels::isa() != nullptr) {
+        return "halide";
+    }
+#endif
+    return kernel().isa;
+}
+
+} /* namespace beeCompress */
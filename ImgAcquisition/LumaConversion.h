@@ -0,0 +1,35 @@
+#ifndef LUMACONVERSION_H_
+#define LUMACONVERSION_H_
+
+#include <cstdint>
+
+namespace beeCompress {
+
+/**
+ * @brief Maps camera luma (0-255) to the video range (16-235) of the encoder.
+ *
+ * Computes (uint8_t)(0.895 * x + 16) as (x * 58656 >> 16) + 16, which is
+ * exact for all 256 inputs. Uses the Halide kernel if built WITH_HALIDE
+ * and it passed HalideKernels::check, else AVX2 or SSE2 on x86 (chosen at
+ * runtime) and NEON on ARM, plain C otherwise.
+ *
+ * @param Destination, e.g. the luma plane of a locked encoder surface
+ * @param Bytes from one destination row to the next
+ * @param Source frame
+ * @param Bytes from one source row to the next
+ * @param Width in pixels
+ * @param Height in pixels
+ */
+void convertLuma(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                 int width, int height);
+
+//! Plain C version of convertLuma, e.g. to check the vectorized ones.
+void convertLumaScalar(uint8_t *dst, int dstPitch, const uint8_t *src, int srcPitch,
+                       int width, int height);
+
+//! Implementation convertLuma uses on this CPU: "halide", "avx2", "sse2", "neon" or "c".
+const char *lumaConversionIsa();
+
+} /* namespace beeCompress */
+
+#endif /* LUMACONVERSION_H_ */
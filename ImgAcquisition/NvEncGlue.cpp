@@ -12,25 +12,152 @@
 #else
 #include <stdint.h>
 #endif
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include "settings/utility.h"
 #include "settings/Settings.h"
-//The order is important!
+#include "Buffer/FramePool.h"
 #include "NvEncGlue.h"
-#ifndef USE_ENCODER
-#include "nvenc/NvEncoder.h"
-#endif
+#include "EncoderBackend.h"
+#include "BitstreamWriter.h"
+#include "PreviewScaler.h"
+#include "ImageScaling.h"
+#include "ThreadPlacement.h"
 #include "writeHandler.h"
 
 namespace beeCompress {
 
-unsigned int mymax(unsigned int a, unsigned int b) {
-    return (a > b ? a : b);
+//Longest time the glue sleeps on empty buffers before checking them again
+static const int IDLE_TIMEOUT_MS = 1000;
+
+//Print a note after this many ms without a frame from the camera
+static const int STALL_REPORT_MS = 10000;
+
+//Most frames taken from the buffer at once
+static const size_t ENCODE_BATCH_SIZE = 8;
+
+long NvEncGlue::encodeSegment(EncoderBackend *backend, EncoderScheduler::Queue *queue, writeHandler *wh,
+                              EncoderBackend *previewBackend, writeHandler *previewWh, double *setupSeconds) {
+    const EncoderQualityConfig &encCfg = queue->cfg;
+    MutexBuffer *buffer = queue->buffer;
+    MutexBuffer *bufferPrev = queue->previewOut;
+
+    //No frames of the queue are taken while the encoder is set up
+    std::chrono::steady_clock::time_point setupStart = std::chrono::steady_clock::now();
+    bool opened = backend->openSegment(encCfg, wh);
+
+    //The preview segment of a dual pass spans the main segment
+    bool previewOpen = false;
+    if (opened && previewBackend != nullptr) {
+        EncoderQualityConfig previewCfg = queue->cfgPreview;
+        previewCfg.totalFrames = encCfg.totalFrames;
+        previewOpen = previewBackend->openSegment(previewCfg, previewWh);
+        if (!previewOpen) {
+            std::cout << "Encoder " << _Id << " could not set up the preview of cam " << queue->camid
+                      << "; encoding without it." << std::endl;
+        } else if (!_PreviewFrame || _PreviewFrame->width != previewCfg.width
+                   || _PreviewFrame->height != previewCfg.height) {
+            _PreviewFrame.reset(new ImageBuffer(previewCfg.width, previewCfg.height, FrameMetadata()));
+        }
+    }
+    bool previewOk = previewOpen;
+
+    *setupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart).count();
+    std::cout << "Encoder " << _Id << " set up for cam " << queue->camid
+              << (queue->preview ? " preview" : previewOpen ? " and its preview" : "")
+              << " in " << *setupSeconds * 1000 << " ms" << std::endl;
+    if (!opened) {
+        return -1;
+    }
+
+    //Frames are taken from the buffer in batches when there is a backlog
+    std::vector<std::shared_ptr<ImageBuffer>> batch;
+    size_t batchPos = 0;
+    int numFramesEncoded = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (int frm = 0; frm < encCfg.totalFrames; frm++) {
+
+        //Wait until there is a new image available (done by popBatch)
+        if (batchPos == batch.size()) {
+            size_t wanted = std::min(ENCODE_BATCH_SIZE,
+                                     static_cast<size_t>(encCfg.totalFrames - frm));
+            while ((batch = buffer->popBatch(wanted, STALL_REPORT_MS)).empty()) {
+                printf("Waiting for frame %d of camera %d \n", frm, encCfg.camid);
+            }
+            batchPos = 0;
+        }
+        std::shared_ptr<ImageBuffer> imgptr = std::move(batch[batchPos++]);
+        ImageBuffer *img = imgptr.get();
+
+        //This should not happen
+        if (img->width * img->height == 0)
+            break;
+
+        if (!backend->submitFrame(*img)) {
+            break;
+        }
+        numFramesEncoded++;
+
+        //Log the progress to the writeHandler
+        wh->log(img->meta);
+
+        //Scaled by the preview workers, not here
+        if (bufferPrev != NULL) {
+            _Preview->submit(imgptr, bufferPrev, queue->cfgPreview.width, queue->cfgPreview.height);
+        }
+
+        //Dual pass: the preview is encoded right away and never queued
+        if (previewOk) {
+            ImageBuffer *preview = _PreviewFrame.get();
+            downscale(preview->data, preview->stride, preview->width, preview->height,
+                      img->data, img->stride, img->width, img->height);
+            preview->meta = img->meta;
+            preview->camid = img->camid;
+            previewOk = previewBackend->submitFrame(*preview);
+            if (previewOk) {
+                previewWh->log(img->meta);
+            } else {
+                std::cout << "Encoder " << _Id << " stopped the preview of cam " << queue->camid
+                          << " after an error." << std::endl;
+            }
+        }
+    }
+
+    //The rest of a batch taken before an error is lost as well
+    const size_t discarded = batch.size() - batchPos;
+    if (discarded > 0) {
+        buffer->countDropped(discarded);
+        std::cout << "Encoder " << _Id << " discarded " << discarded << " frames of cam " << queue->camid
+                  << " after an error." << std::endl;
+    }
+
+    backend->flush();
+    if (previewOpen) {
+        previewBackend->flush();
+        long previewBytes = previewBackend->closeSegment();
+        if (previewBytes > 0) {
+            std::cout << "Encoded preview of " << previewBytes / 1024 << " KB" << std::endl;
+        }
+    }
+
+    if (numFramesEncoded > 0) {
+        double elapsedMs = std::chrono::duration<double, std::milli>(
+                               std::chrono::steady_clock::now() - start).count();
+        printf("Encoded %d frames in %6.2fms\n", numFramesEncoded, elapsedMs);
+        printf("Average Encode Time : %6.2fms\n", elapsedMs / numFramesEncoded);
+    }
+
+    return backend->closeSegment();
 }
 
 void NvEncGlue::run() {
 
-#ifndef USE_ENCODER
+    ThreadPlacement::apply(ThreadPlacement::get(IMACQUISITION::THREADS_ENCODER), "Encoder " + std::to_string(_Id));
+
     SettingsIAC *set = SettingsIAC::getInstance();
 
     std::string imdir = set->getValueOfParam<std::string>(IMACQUISITION::IMDIR);
@@ -41,89 +168,64 @@ void NvEncGlue::run() {
     std::string exchangedirprev = set->getValueOfParam<std::string>(
                                       IMACQUISITION::EXCHANGEDIRPREVIEW);
 
-    //For logging encoding times
-    double elapsedTimeP, avgtimeP;
-
     //Encoder may be reused. Potentially saves time.
-    CNvEncoder enc;
-    EncoderQualityConfig cfgC1 = set->getBufferConf(_CamBuffer1, 0);
-    EncoderQualityConfig cfgC2 = set->getBufferConf(_CamBuffer2, 0);
-    EncoderQualityConfig cfgP1 = set->getBufferConf(_CamBuffer1, 1);
-    EncoderQualityConfig cfgP2 = set->getBufferConf(_CamBuffer2, 1);
+    std::string backendName =
+        set->maybeGetValueOfParam<std::string>(IMACQUISITION::ENCODER_BACKEND).get_value_or("nvenc");
+    std::unique_ptr<EncoderBackend> backend = EncoderBackend::create(backendName);
+    if (!backend) {
+        //The queues would fill up with nobody to drain them
+        const std::string msg = "Encoder " + std::to_string(_Id) + " could not create its "
+                                + backendName + " backend. Exit!";
+        std::cout << msg << std::endl;
+        slackpost(msg, 0);
+        std::exit(1);
+    }
+
+    //Video files are written on a thread of their own, so the encoder never waits for the disk
+    std::unique_ptr<BitstreamWriter> writer = BitstreamWriter::fromSettings("Writer " + std::to_string(_Id));
+
+    //Second session for previews encoded along with the main stream. Created when first needed.
+    std::unique_ptr<EncoderBackend> previewBackend;
+    bool previewBackendFailed = false;
 
     while (1) {
-        //Select a buffer to work on. Largest first.
-        long long unsigned int c1 = _Buffer1->size()
-                                    * (long long unsigned int)(cfgC1.width * cfgC1.height);
-        long long unsigned int c2 = _Buffer2->size()
-                                    * (long long unsigned int)(cfgC2.width * cfgC2.height);
-        long long unsigned int c1p = _Buffer1_preview->size()
-                                     * (long long unsigned int)(cfgP1.width * cfgP1.height);
-        long long unsigned int c2p = _Buffer2_preview->size()
-                                     * (long long unsigned int)(cfgP2.width * cfgP2.height);
-
-        int currentCam = 0;
-        MutexBuffer *currentCamBuffer;
-        MutexBuffer *currentPreviewBuffer;
-        EncoderQualityConfig encCfg;
-        EncoderQualityConfig encCfgPrev;
-
-        long long unsigned int maxSize = mymax(mymax(mymax(c1, c2), c1p), c2p);
-
-        //If all are empty, check again later.
-        if (maxSize == 0) {
-            usleep(500);
+        //Take the queue which needs an encoder most, or sleep until a frame arrives.
+        EncoderScheduler::Queue *queue = _Scheduler->acquire(_Id, IDLE_TIMEOUT_MS);
+        if (queue == nullptr) {
             continue;
         }
 
-        //Configure which buffer and configuration to use
-        if (c1 >= maxSize) {
-            currentCamBuffer = _Buffer1;
-            currentPreviewBuffer = _Buffer1_preview;
-            currentCam = _CamBuffer1;
-            encCfg = cfgC1;
-            encCfgPrev = cfgP1;
-            std::cout << "Chosen: 1" << std::endl;
-        } else if (c1p >= maxSize) {
-            currentCamBuffer = _Buffer1_preview;
-            currentPreviewBuffer = NULL;
-            currentCam = _CamBuffer1;
-            encCfg = cfgP1;
-            encCfgPrev = cfgP1;
-            std::cout << "Chosen: 2" << std::endl;
-        } else if (c2 >= maxSize) {
-            currentCamBuffer = _Buffer2;
-            currentPreviewBuffer = _Buffer2_preview;
-            currentCam = _CamBuffer2;
-            encCfg = cfgC2;
-            encCfgPrev = cfgP2;
-            std::cout << "Chosen: 3" << std::endl;
-        } else if (c2p >= maxSize) {
-            currentCamBuffer = _Buffer2_preview;
-            currentPreviewBuffer = NULL;
-            currentCam = _CamBuffer2;
-            encCfg = cfgP2;
-            encCfgPrev = cfgP2;
-            std::cout << "Chosen: 4" << std::endl;
-        }
-
         //Configure output directories
         std::string dir = imdir;
         std::string exdir = exchangedir;
-        if (currentPreviewBuffer == NULL) {
+        if (queue->preview) {
             dir = imdirprev;
             exdir = exchangedirprev;
         }
-        else { // Would write into preview buffer. Disable if previews are disabled.
-            if (!previewsEnabled)
-                currentPreviewBuffer = nullptr;
+        std::unique_ptr<writeHandler> wh(new writeHandler(dir, queue->camid, exdir, writer.get()));
+
+        std::unique_ptr<writeHandler> previewWh;
+        if (queue->dualPreview && !previewBackend && !previewBackendFailed) {
+            previewBackend = EncoderBackend::create(backendName);
+            previewBackendFailed = !previewBackend;
+        }
+        if (queue->dualPreview && previewBackend) {
+            previewWh.reset(new writeHandler(imdirprev, queue->camid, exchangedirprev, writer.get()));
         }
-        beeCompress::writeHandler wh(dir, currentCam, exdir);
 
         //encode the frames in the buffer using given configuration
         std::cout << "Write handler initialized!" << std::endl;
-        int ret = enc.EncodeMain(&elapsedTimeP, &avgtimeP, currentCamBuffer,
-                                 currentPreviewBuffer, &wh, encCfg, encCfgPrev);
+        double setupSeconds = 0;
+        long ret = encodeSegment(backend.get(), queue, wh.get(),
+                                 previewWh ? previewBackend.get() : nullptr, previewWh.get(), &setupSeconds);
+        _Scheduler->release(queue, setupSeconds);
+        if (writer) {
+            writer->close(std::move(wh));
+            if (previewWh) {
+                writer->close(std::move(previewWh));
+            }
+            logWriterStats(writer.get());
+        }
         if (ret <= 0) {
             std::cout << "ENCODER ERROR! " << std::endl;
         } else {
@@ -131,26 +233,18 @@ void NvEncGlue::run() {
             std::cout << "Encoded " << ret / 1024 / 1024 << " MB" << std::endl;
         }
     }
-#else
-    while (true) {
-        usleep(500);
-    }
-#endif
 }
 
-NvEncGlue::NvEncGlue() {
-
-    SettingsIAC *set = SettingsIAC::getInstance();
-
-    //Grab buffer size from json config and initialize buffers.
-    _Buffer1 = new beeCompress::MutexLinkedList();
-    _Buffer2 = new beeCompress::MutexLinkedList();
-    _Buffer1_preview = new beeCompress::MutexLinkedList();
-    _Buffer2_preview = new beeCompress::MutexLinkedList();
-    _CamBuffer1 = -1;
-    _CamBuffer2 = -1;
+void NvEncGlue::logWriterStats(BitstreamWriter *writer) {
+    BitstreamWriter::Stats stats = writer->takeStats();
+    printf("Writer %d: %.1f MB in %llu batches, queue %zu (max %zu), write %.2fms avg %.2fms max, "
+           "%llu stalls (%.1fms)\n", _Id, stats.bytes / 1024.0 / 1024.0,
+           static_cast<unsigned long long>(stats.batches), stats.queueDepth, stats.maxQueueDepth,
+           stats.avgWriteMs, stats.maxWriteMs, static_cast<unsigned long long>(stats.stalls), stats.stallMs);
+}
 
-    previewsEnabled = set->getValueOfParam<int>(IMACQUISITION::DO_PREVIEWS) == 1;;
+NvEncGlue::NvEncGlue(EncoderScheduler *scheduler, PreviewScaler *preview, int id) :
+    _Scheduler(scheduler), _Preview(preview), _Id(id) {
 }
 
 NvEncGlue::~NvEncGlue() {
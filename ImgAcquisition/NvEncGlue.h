@@ -2,27 +2,34 @@
 #ifndef NVENCGLUE_H_
 #define NVENCGLUE_H_
 
-#include "Buffer/MutexBuffer.h"
-#include "Buffer/MutexLinkedList.h"
+#include "EncoderScheduler.h"
 #include <QThread>
 
 namespace beeCompress {
 
+class BitstreamWriter;
+class EncoderBackend;
+class PreviewScaler;
+class writeHandler;
+
 /**
  * @brief The NvEncGlue class
  *
- * This class reads from two ringbuffers
- * and processes the leass occupied one
- * using the NvEncoder in HEVC.
+ * An encoder worker. It repeatedly takes a camera queue from the shared
+ * EncoderScheduler and encodes one segment of it
+ * with the EncoderBackend chosen by ENCODER_BACKEND (NVENC by default).
  * This class should be spawned as a QThread.<br>
  * <br>
  * Warning:<br>
  * Keep in mind:<br>
  * -    The number of processors you spawn.
  *      Most consumer Nvidia GPU's are only able to spawn 2 HEVC GPU encoders.
- *      One thread will use one encoder and crash if no GPU encoder is available.<br>
+ *      One thread will use one encoder and crash if no GPU encoder is available.
+ *      With PREVIEW.MODE "dual" a thread uses two encoders.<br>
  * -    The resolution. Encoding may throw errors madly if 4096x4096 is exceeded.
  *      This is a Nvidia GPU encoder limitation.
+ * The CPU backend (libav) has neither limit, but each glue's encoder uses
+ * several cores.
  */
 class NvEncGlue : public QThread {
     Q_OBJECT   //generates the MOC
@@ -30,60 +37,64 @@ class NvEncGlue : public QThread {
 public:
 
     /**
-     * @brief _Buffer1 The first buffer to encode
-     */
-    MutexLinkedList *_Buffer1;
-    MutexLinkedList *_Buffer1_preview;
-
-    /**
-     * @brief _CamRing1 Cam number associated with the first ringbuffer
-     */
-    int _CamBuffer1;
-
-    /**
-     * @brief _Buffer2 The second buffer to encode
-     */
-    MutexLinkedList *_Buffer2;
-    MutexLinkedList *_Buffer2_preview;
-
-    /**
-     * @brief _CamRing2 Cam number associated with the second ringbuffer
-     */
-    int _CamBuffer2;
-
-    /**
-     * @brief Creates a new encoder glue. Initializes ringbuffers.
+     * @brief Creates a new encoder worker.
+     *
+     * @param Scheduler handing out the camera queues
+     * @param Scaler of the preview frames
+     * @param Id of the worker, for logging
      */
-    NvEncGlue();
+    NvEncGlue(EncoderScheduler *scheduler, PreviewScaler *preview, int id);
 
     /**
      * @brief Destroy the encoder glue
     */
     virtual ~NvEncGlue();
 
-    /**
-     * @brief Whether to enable previews.
-    */
-    void enablePreviews(bool enable=true) {
-        previewsEnabled = enable;
-    }
-
 protected:
 
     /**
      * @brief Run the encoding thread.
      *
      * This is the function that will be iterated indefinitely.
-     * The ringbuffers will be watched permanently and will be encoded.
-     *
-     * @param Length of the ringbuffer
+     * The queues will be taken from the scheduler permanently and will be encoded.
      */
     void run();
 
     /**
-     * @brief Whether to write smaller preview images into the preview buffers.
+     * @brief Encodes one segment of a queue.
+     *
+     * Takes the segment's frames from the queue, passes them to the
+     * backend, logs them to the writeHandler and hands them to the
+     * PreviewScaler for the queue's preview buffer. With a preview
+     * backend (PREVIEW.MODE "dual") each frame is instead downscaled and
+     * encoded into the preview video right away, so no preview frames
+     * are kept in memory.
+     *
+     * @param Backend to encode with
+     * @param Queue to take the frames from
+     * @param Handler of the segment's files
+     * @param Backend encoding the preview in the same pass, or nullptr
+     * @param Handler of the preview's files, or nullptr
+     * @param Output parameter. Time the backends took to set up the segment, in s.
+     * @return Size of the video in bytes, or -1 on error
      */
-    bool previewsEnabled { true };
+    long encodeSegment(EncoderBackend *backend, EncoderScheduler::Queue *queue, writeHandler *wh,
+                       EncoderBackend *previewBackend, writeHandler *previewWh, double *setupSeconds);
+
+    //! Prints the writer's queue depth and write latency since the previous segment
+    void logWriterStats(BitstreamWriter *writer);
+
+    //! Scheduler handing out the camera queues
+    EncoderScheduler *_Scheduler;
+
+    //! Downscales the frames for the preview buffers
+    PreviewScaler *_Preview;
+
+    //! Downscaled frame of a dual pass, reused for every frame
+    std::unique_ptr<ImageBuffer> _PreviewFrame;
+
+    //! Id of the worker
+    int _Id;
 };
 
 } /* namespace beeCompress */
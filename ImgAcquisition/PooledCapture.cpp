@@ -0,0 +1,56 @@
+#include "PooledCapture.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace beeCompress {
+
+bool adoptDeliveredImage(ImageBuffer &frame, size_t slotSize, const DeliveredImage &image) {
+    const bool inPlace = image.data == frame.data
+                         && image.width == frame.width
+                         && image.height == frame.height
+                         && image.stride >= image.width
+                         && static_cast<size_t>(image.stride) * static_cast<size_t>(image.height) <= slotSize;
+    if (inPlace) {
+        frame.stride = image.stride;
+        return true;
+    }
+
+    //The rows of the copy follow each other, so this always fits the slot
+    frame.stride = frame.width;
+    const int width = std::min(image.width, frame.width);
+    const int height = std::min(image.height, frame.height);
+    if (image.data == nullptr || image.stride < image.width || width <= 0 || height <= 0) {
+        memset(frame.data, 0, static_cast<size_t>(frame.width) * frame.height);
+        return false;
+    }
+
+    //The driver may have written into the frame with a layout of its own
+    const uint8_t *src = image.data;
+    std::vector<uint8_t> staging;
+    const size_t imageBytes = static_cast<size_t>(image.stride) * (image.height - 1) + image.width;
+    if (src < frame.data + slotSize && frame.data < src + imageBytes) {
+        staging.assign(src, src + std::min(imageBytes, static_cast<size_t>(frame.data + slotSize - src)));
+        staging.resize(imageBytes, 0);
+        src = staging.data();
+    }
+
+    //Centered, like the software crop of the capture backends
+    const int srcX = (image.width - width) / 2;
+    const int srcY = (image.height - height) / 2;
+    const int dstX = (frame.width - width) / 2;
+    const int dstY = (frame.height - height) / 2;
+    for (int y = 0; y < frame.height; y++) {
+        uint8_t *row = frame.data + static_cast<size_t>(y) * frame.stride;
+        if (y < dstY || y >= dstY + height) {
+            memset(row, 0, frame.width);
+            continue;
+        }
+        memcpy(row + dstX, src + static_cast<size_t>(y - dstY + srcY) * image.stride + srcX, width);
+        memset(row, 0, dstX);
+        memset(row + dstX + width, 0, frame.width - dstX - width);
+    }
+    return false;
+}
+
+} /* namespace beeCompress */
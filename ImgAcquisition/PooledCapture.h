@@ -0,0 +1,43 @@
+#ifndef POOLEDCAPTURE_H_
+#define POOLEDCAPTURE_H_
+
+#include "Buffer/MutexBuffer.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace beeCompress {
+
+/**
+ * @brief An image as reported by the camera SDK after capturing.
+ */
+struct DeliveredImage {
+    //! First pixel, wherever the SDK put it
+    const uint8_t   *data;
+    int             width;
+    int             height;
+    //! Bytes from one row to the next
+    int             stride;
+};
+
+/**
+ * @brief Makes sure a pooled frame holds the image the SDK was asked to write into it.
+ *
+ * The capture backends point the SDK at a pooled frame (Image::SetData,
+ * XI_IMG::bp). A driver may still deliver into memory of its own, e.g.
+ * after falling back to another video mode, or with a size or stride the
+ * pool slot cannot hold. Such images are copied into the frame instead.
+ *
+ * On the fast path only frame.stride is set from the image. A copy keeps
+ * the size of the frame: the centered region of the image is copied row by
+ * row (stride = width) and whatever the image does not cover is cleared.
+ *
+ * @param Pooled frame handed to the SDK, with the expected width and height
+ * @param Bytes of storage behind frame.data (FramePool::slotSize)
+ * @param What the SDK reports
+ * @return false if the image had to be copied
+ */
+bool adoptDeliveredImage(ImageBuffer &frame, size_t slotSize, const DeliveredImage &image);
+
+} /* namespace beeCompress */
+
+#endif /* POOLEDCAPTURE_H_ */
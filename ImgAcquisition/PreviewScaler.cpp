@@ -0,0 +1,118 @@
+#include "PreviewScaler.h"
+#include "ImageScaling.h"
+#include "ThreadPlacement.h"
+#include "Buffer/FramePool.h"
+#include "settings/Settings.h"
+#include "settings/ParamNames.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+namespace beeCompress {
+
+PreviewScaler::PreviewScaler(int threads, size_t capacity) :
+    _Capacity(std::max<size_t>(capacity, 1)), _NextTicket(0), _NextPush(0), _Stop(false),
+    _Frames(0), _Dropped(0), _TotalMs(0), _MaxMs(0) {
+    for (int i = 0; i < threads; i++) {
+        _Workers.emplace_back(&PreviewScaler::run, this, i);
+    }
+}
+
+std::unique_ptr<PreviewScaler> PreviewScaler::fromSettings() {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    int threads = set->maybeGetValueOfParam<int>(IMACQUISITION::PREVIEW_THREADS).get_value_or(2);
+    int capacity = set->maybeGetValueOfParam<int>(IMACQUISITION::PREVIEW_QUEUE).get_value_or(32);
+    return std::unique_ptr<PreviewScaler>(new PreviewScaler(std::max(threads, 0), std::max(capacity, 1)));
+}
+
+PreviewScaler::~PreviewScaler() {
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        _Stop = true;
+    }
+    _Queued.notify_all();
+    _Pushed.notify_all();
+    for (std::thread &worker : _Workers) {
+        worker.join();
+    }
+}
+
+bool PreviewScaler::submit(const std::shared_ptr<ImageBuffer> &frame, MutexBuffer *target, int width, int height) {
+    if (_Workers.empty()) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        target->push(scale(Job { frame, target, width, height, 0 }));
+        std::lock_guard<std::mutex> lock(_Mutex);
+        count(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_Mutex);
+        if (_Jobs.size() >= _Capacity) {
+            _Dropped++;
+            return false;
+        }
+        _Jobs.push_back(Job { frame, target, width, height, _NextTicket++ });
+    }
+    _Queued.notify_one();
+    return true;
+}
+
+void PreviewScaler::logStats() {
+    std::lock_guard<std::mutex> lock(_Mutex);
+    std::cout << "Preview scaler (" << imageScalingIsa() << ", " << _Workers.size() << " workers): "
+              << _Frames << " previews, " << _Dropped << " dropped, " << _Jobs.size() << " waiting, "
+              << (_Frames > 0 ? _TotalMs / _Frames : 0.0) << " ms avg, " << _MaxMs << " ms max" << std::endl;
+}
+
+std::shared_ptr<ImageBuffer> PreviewScaler::scale(const Job &job) {
+    const ImageBuffer &frame = *job.frame;
+    std::shared_ptr<ImageBuffer> preview = FramePool::getPool(job.width, job.height)->acquire(frame.meta);
+    downscale(preview->data, preview->stride, job.width, job.height,
+              frame.data, frame.stride, frame.width, frame.height);
+    return preview;
+}
+
+void PreviewScaler::count(double ms) {
+    _Frames++;
+    _TotalMs += ms;
+    _MaxMs = std::max(_MaxMs, ms);
+}
+
+void PreviewScaler::run(int index) {
+    ThreadPlacement::apply(ThreadPlacement::get(IMACQUISITION::THREADS_ENCODER), "Preview " + std::to_string(index));
+
+    std::unique_lock<std::mutex> lock(_Mutex);
+    while (true) {
+        _Queued.wait(lock, [this] { return _Stop || !_Jobs.empty(); });
+        if (_Stop) {
+            break;
+        }
+        Job job = std::move(_Jobs.front());
+        _Jobs.pop_front();
+        lock.unlock();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::shared_ptr<ImageBuffer> preview = scale(job);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        //The full frame goes back to its pool right away
+        job.frame.reset();
+
+        //Jobs are taken in order, so the previous ticket is already being worked on
+        lock.lock();
+        count(ms);
+        _Pushed.wait(lock, [this, &job] { return _Stop || _NextPush == job.ticket; });
+        if (_Stop) {
+            break;
+        }
+        lock.unlock();
+        job.target->push(preview);
+        lock.lock();
+        _NextPush++;
+        _Pushed.notify_all();
+    }
+}
+
+} /* namespace beeCompress */
@@ -0,0 +1,104 @@
+#ifndef PREVIEWSCALER_H_
+#define PREVIEWSCALER_H_
+
+#include "Buffer/MutexBuffer.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Downscales frames for the preview videos on a pool of worker threads.
+ *
+ * The encoder thread only queues the frame it just encoded; a worker
+ * scales it (see downscale in ImageScaling.h) into a frame of the
+ * FramePool of the preview size and pushes that to the preview buffer.
+ * Frames reach the preview buffers in the order they were queued.
+ *
+ * Settings (IMACQUISITION.PREVIEW.*):
+ * THREADS  Number of workers. Default 2. 0 scales on the encoder thread.
+ * QUEUE    Frames waiting for a worker at most. Default 32. Further
+ *          frames get no preview; previews are the first to go when the
+ *          system falls behind.
+ * MODE     "queue" (default) uses this class. "dual" encodes the
+ *          preview in the same pass as the main stream (see NvEncGlue)
+ *          and does not use it.
+ */
+class PreviewScaler {
+public:
+
+    /**
+     * @brief Starts the workers.
+     *
+     * @param Number of workers. 0 scales in submit.
+     * @param Frames waiting for a worker at most
+     */
+    PreviewScaler(int threads, size_t capacity);
+
+    //! Creates a scaler as configured
+    static std::unique_ptr<PreviewScaler> fromSettings();
+
+    //! Stops the workers. Frames still waiting get no preview.
+    ~PreviewScaler();
+
+    /**
+     * @brief Queues a preview of a frame.
+     *
+     * The frame is referenced until it is scaled.
+     *
+     * @param The full size frame
+     * @param Buffer receiving the preview
+     * @param Width of the preview
+     * @param Height of the preview
+     * @return false if the queue was full and the preview was dropped
+     */
+    bool submit(const std::shared_ptr<ImageBuffer> &frame, MutexBuffer *target, int width, int height);
+
+    //! Prints the number of previews, drops and the time per preview.
+    void logStats();
+
+private:
+
+    struct Job {
+        std::shared_ptr<ImageBuffer>    frame;
+        MutexBuffer                     *target;
+        int                             width;
+        int                             height;
+        //! Position in the order of submit
+        uint64_t                        ticket;
+    };
+
+    void run(int index);
+
+    //! Scales the frame of a job. Returns the preview.
+    std::shared_ptr<ImageBuffer> scale(const Job &job);
+
+    //! Adds the time of one preview to the statistics. Requires _Mutex.
+    void count(double ms);
+
+    size_t                          _Capacity;
+    std::vector<std::thread>        _Workers;
+
+    std::mutex                      _Mutex;
+    std::condition_variable         _Queued;
+    //! Signalled when a preview was pushed, so the next one may follow
+    std::condition_variable         _Pushed;
+    std::deque<Job>                 _Jobs;
+    uint64_t                        _NextTicket;
+    uint64_t                        _NextPush;
+    bool                            _Stop;
+
+    uint64_t                        _Frames;
+    uint64_t                        _Dropped;
+    double                          _TotalMs;
+    double                          _MaxMs;
+};
+
+} /* namespace beeCompress */
+
+#endif /* PREVIEWSCALER_H_ */
@@ -0,0 +1,215 @@
+#include "SegmentIndex.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    using beeCompress::VideoCodec;
+
+    //Maps a whole file read only. nullptr if it can not be read or is empty.
+    const uint8_t *mapFile(const std::string &path, size_t *size) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            *size = static_cast<size_t>(st.st_size);
+            map = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        return map == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(map);
+    }
+
+    //Next 00 00 01 at or after from, end if there is none
+    size_t nextStartCode(const uint8_t *data, size_t from, size_t end) {
+        for (size_t i = from; i + 3 < end; i++) {
+            if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+                return i;
+            }
+        }
+        return end;
+    }
+
+    /**
+     * Parameter sets among the NAL units of an access unit before its first
+     * slice. Other units there (SEI, access unit delimiters) are skipped.
+     *
+     * @param Receives the parameter sets, each with a four byte start code. May be nullptr.
+     * @return Number of parameter sets
+     */
+    size_t parameterSets(VideoCodec codec, const uint8_t *data, size_t size, std::vector<uint8_t> *out) {
+        static const uint8_t START_CODE[4] = { 0, 0, 0, 1 };
+        const size_t end = beeCompress::firstSlice(codec, data, size);
+        size_t count = 0;
+        size_t unit = nextStartCode(data, 0, end);
+        while (unit < end) {
+            size_t next = nextStartCode(data, unit + 3, end);
+            if (beeCompress::isParameterSetNal(codec, beeCompress::nalUnitType(codec, data[unit + 3]))) {
+                count++;
+                if (out != nullptr) {
+                    //Without trailing zeros, e.g. the first byte of a four byte start code
+                    size_t last = next;
+                    while (last > unit + 3 && data[last - 1] == 0) {
+                        last--;
+                    }
+                    out->insert(out->end(), START_CODE, START_CODE + sizeof(START_CODE));
+                    out->insert(out->end(), data + unit + 3, data + last);
+                }
+            }
+            unit = next;
+        }
+        return count;
+    }
+
+    //End of a leading access unit delimiter, which has to stay first. 0 if there is none.
+    size_t delimiterBytes(VideoCodec codec, const uint8_t *data, size_t size) {
+        const uint8_t delimiter = codec == VideoCodec::H264 ? 9 : 35;
+        size_t unit = nextStartCode(data, 0, size);
+        if (unit == size || beeCompress::nalUnitType(codec, data[unit + 3]) != delimiter) {
+            return 0;
+        }
+        size_t next = nextStartCode(data, unit + 3, size);
+        //The first byte of a four byte start code belongs to the next unit
+        return next < size && data[next - 1] == 0 ? next - 1 : next;
+    }
+}
+
+namespace beeCompress {
+
+SegmentIndex::SegmentIndex() :
+    _IndexMap(nullptr), _IndexSize(0), _VideoMap(nullptr), _VideoSize(0),
+    _Records(nullptr), _RecordBytes(0), _Count(0), _Codec(VideoCodec::HEVC) {
+}
+
+SegmentIndex::~SegmentIndex() {
+    if (_IndexMap) munmap(const_cast<uint8_t*>(_IndexMap), _IndexSize);
+    if (_VideoMap) munmap(const_cast<uint8_t*>(_VideoMap), _VideoSize);
+}
+
+std::unique_ptr<SegmentIndex> SegmentIndex::open(const std::string &videoFile) {
+    size_t dot = videoFile.find_last_of('.');
+    std::string indexFile = videoFile.substr(0, dot == std::string::npos ? videoFile.size() : dot) + ".idx";
+
+    std::unique_ptr<SegmentIndex> index(new SegmentIndex());
+    index->_VideoMap = mapFile(videoFile, &index->_VideoSize);
+    index->_IndexMap = mapFile(indexFile, &index->_IndexSize);
+    if (index->_VideoMap == nullptr || index->_IndexMap == nullptr) {
+        std::cout << "Could not map " << videoFile << " and its index " << indexFile << std::endl;
+        return nullptr;
+    }
+
+    //Version 1 headers are shorter than SidecarHeader; only their first fields are read
+    const SidecarHeader *header = reinterpret_cast<const SidecarHeader*>(index->_IndexMap);
+    if (index->_IndexSize < offsetof(SidecarHeader, codec)
+            || memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+            || header->version > SIDECAR_VERSION
+            || index->_IndexSize < sidecarHeaderBytes(*header)
+            || header->recordBytes < sizeof(IndexRecord) || header->recordBytes % 8 != 0) {
+        std::cout << indexFile << " is not an index" << std::endl;
+        return nullptr;
+    }
+    index->_Codec = sidecarCodec(*header);
+    if (index->_Codec != VideoCodec::HEVC && index->_Codec != VideoCodec::H264) {
+        std::cout << indexFile << " is of an unknown codec" << std::endl;
+        return nullptr;
+    }
+    const size_t headerBytes = sidecarHeaderBytes(*header);
+    index->_Records = index->_IndexMap + headerBytes;
+    index->_RecordBytes = header->recordBytes;
+
+    //Stop at the first picture the video does not hold completely
+    size_t listed = (index->_IndexSize - headerBytes) / index->_RecordBytes;
+    while (index->_Count < listed) {
+        const IndexRecord &r = index->record(index->_Count);
+        if (r.videoOffset + r.videoBytes > index->_VideoSize) {
+            break;
+        }
+        if (r.keyframe) {
+            index->_Keyframes.push_back(index->_Count);
+        }
+        index->_Count++;
+    }
+    if (index->_Count == 0 || index->_Keyframes.empty() || index->_Keyframes.front() != 0) {
+        std::cout << videoFile << " does not start with a keyframe" << std::endl;
+        return nullptr;
+    }
+
+    const IndexRecord &first = index->record(0);
+    parameterSets(index->_Codec, index->_VideoMap + first.videoOffset, first.videoBytes, &index->_ParameterSets);
+    return index;
+}
+
+size_t SegmentIndex::findTime(uint64_t wallClockNs) const {
+    size_t lo = 0, hi = _Count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (record(mid).wallClockNs < wallClockNs) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t SegmentIndex::keyframeBefore(size_t picture) const {
+    std::vector<size_t>::const_iterator it = std::upper_bound(_Keyframes.begin(), _Keyframes.end(), picture);
+    return *(it - 1);
+}
+
+bool SegmentIndex::read(size_t first, size_t end, std::vector<uint8_t> &out) const {
+    if (first >= end || end > _Count) {
+        return false;
+    }
+    const IndexRecord &from = record(first);
+    const IndexRecord &to = record(end - 1);
+    const uint8_t *data = _VideoMap + from.videoOffset;
+    size_t size = to.videoOffset + to.videoBytes - from.videoOffset;
+
+    bool hasParameterSets = parameterSets(_Codec, data, from.videoBytes, nullptr) > 0;
+    out.clear();
+    out.reserve(size + (hasParameterSets ? 0 : _ParameterSets.size()));
+    if (!hasParameterSets) {
+        size_t delimiter = delimiterBytes(_Codec, data, from.videoBytes);
+        out.insert(out.end(), data, data + delimiter);
+        out.insert(out.end(), _ParameterSets.begin(), _ParameterSets.end());
+        data += delimiter;
+        size -= delimiter;
+    }
+    out.insert(out.end(), data, data + size);
+    return true;
+}
+
+std::vector<SegmentIndex::Chunk> SegmentIndex::chunks(size_t count) const {
+    std::vector<Chunk> result;
+    count = std::max<size_t>(count, 1);
+    size_t first = 0;
+    for (size_t i = 1; i <= count && first < _Count; i++) {
+        //Cut at the keyframe closest to the even split
+        size_t end = _Count;
+        if (i < count) {
+            size_t target = _Count * i / count;
+            std::vector<size_t>::const_iterator it = std::lower_bound(_Keyframes.begin(), _Keyframes.end(), target);
+            if (it != _Keyframes.end() && it != _Keyframes.begin() && target - *(it - 1) < *it - target) {
+                it--;
+            }
+            if (it == _Keyframes.end() || *it <= first) {
+                continue;
+            }
+            end = *it;
+        }
+        result.push_back(Chunk { first, end });
+        first = end;
+    }
+    return result;
+}
+
+} /* namespace beeCompress */
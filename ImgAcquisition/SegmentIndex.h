@@ -0,0 +1,107 @@
+#ifndef SEGMENTINDEX_H_
+#define SEGMENTINDEX_H_
+
+#include "SidecarFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Random access into a recorded video through its index (.idx).
+ *
+ * Maps the video and the index written by writeHandler. A picture is
+ * decoded by feeding a decoder the pictures from the keyframe before it
+ * up to it (see read); with an IDRINTERVAL of n that is at most n
+ * pictures instead of the whole segment. Pieces starting at keyframes
+ * (see chunks) decode independently, e.g. on several cores. The NAL
+ * units are read as HEVC or H.264, as the header of the index says.
+ *
+ * Pictures the index lists beyond the end of the video (a recording cut
+ * short) are ignored. Needs neither Qt nor CUDA; link the segmentIndex
+ * library.
+ */
+class SegmentIndex {
+public:
+
+    //! Pictures [first, end) of a video. first is a keyframe.
+    struct Chunk {
+        size_t  first;
+        size_t  end;
+    };
+
+    /**
+     * @brief Maps a video and its index.
+     *
+     * @param Path of the video. The index is expected next to it with the extension .idx.
+     * @return nullptr if either file can not be read or the index is invalid
+     */
+    static std::unique_ptr<SegmentIndex> open(const std::string &videoFile);
+
+    ~SegmentIndex();
+
+    //! Number of coded pictures
+    size_t pictures() const { return _Count; }
+
+    //! Codec of the video, HEVC or H.264
+    VideoCodec codec() const { return _Codec; }
+
+    const IndexRecord &record(size_t picture) const {
+        return *reinterpret_cast<const IndexRecord*>(_Records + picture * _RecordBytes);
+    }
+
+    //! First picture captured at or after the time. pictures() if there is none.
+    size_t findTime(uint64_t wallClockNs) const;
+
+    //! Last keyframe at or before the picture
+    size_t keyframeBefore(size_t picture) const;
+
+    /**
+     * @brief Copies the bitstream of pictures [first, end) for a decoder.
+     *
+     * The parameter sets of the video are put in front if the first
+     * picture does not carry them, after its access unit delimiter if any.
+     *
+     * @param First picture. Should be a keyframe, see keyframeBefore.
+     * @param One past the last picture
+     * @param Receives the bitstream
+     * @return false if the range is empty or out of bounds
+     */
+    bool read(size_t first, size_t end, std::vector<uint8_t> &out) const;
+
+    /**
+     * @brief Splits the video at keyframes into about equally long pieces.
+     *
+     * @param Number of pieces wanted. Fewer are returned if there are fewer keyframes.
+     */
+    std::vector<Chunk> chunks(size_t count) const;
+
+private:
+
+    SegmentIndex();
+
+    //! Index file, mapped
+    const uint8_t           *_IndexMap;
+    size_t                  _IndexSize;
+    //! Video file, mapped
+    const uint8_t           *_VideoMap;
+    size_t                  _VideoSize;
+
+    //! First record and distance between records (recordBytes of the header)
+    const uint8_t           *_Records;
+    size_t                  _RecordBytes;
+    size_t                  _Count;
+    //! Pictures decoding can start at, ascending
+    std::vector<size_t>     _Keyframes;
+    //! From the header: HEVC or H.264
+    VideoCodec              _Codec;
+    //! Parameter sets of the first picture (VPS, SPS and PPS in HEVC, SPS and PPS in H.264)
+    std::vector<uint8_t>    _ParameterSets;
+};
+
+} /* namespace beeCompress */
+
+#endif /* SEGMENTINDEX_H_ */
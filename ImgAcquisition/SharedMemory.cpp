@@ -13,13 +13,21 @@
 #include <iostream>
 #include "settings/Settings.h"
 #include "settings/ParamNames.h"
+#include "ThreadPlacement.h"
 #include <iostream>
 #include <cstdio>
 
 namespace beeCompress {
 
-SharedMemory::SharedMemory() {
+//Most images taken from the buffer at once
+static const size_t SHM_BATCH_SIZE = 16;
+
+SharedMemory::SharedMemory(int numCameras) :
+    _key(numCameras, 0), _shmid(numCameras, 0),
+    _data(numCameras, nullptr), _mutex(numCameras, nullptr) {
     _Buffer = new beeCompress::MutexLinkedList();
+    //Only the newest image matters to shared memory readers
+    _Buffer->configure("sharedmemory", OverflowPolicy::DropOldest, 0, true);
 }
 
 SharedMemory::~SharedMemory() {
@@ -66,21 +74,37 @@ void SharedMemory::doUnlock(int id) {
 
 void SharedMemory::run()
 {
+    ThreadPlacement::apply(ThreadPlacement::get(IMACQUISITION::THREADS_SHAREDMEMORY), "Shared memory");
 
     while (true) {
-        //Wait until there is a new image available (done by pop)
-        std::shared_ptr<beeCompress::ImageBuffer> imgptr = _Buffer->pop();
-        beeCompress::ImageBuffer *img = imgptr.get();
+        //Wait until there is a new image available (done by popBatch)
+        std::vector<std::shared_ptr<beeCompress::ImageBuffer>> batch = _Buffer->popBatch(SHM_BATCH_SIZE, -1);
+
+        //Readers only ever see the latest image, so older ones need no copy
+        std::vector<beeCompress::ImageBuffer*> newest(_data.size(), nullptr);
+        for (const std::shared_ptr<beeCompress::ImageBuffer> &imgptr : batch) {
+            if (imgptr->camid >= 0 && imgptr->camid < static_cast<int>(newest.size())) {
+                newest[imgptr->camid] = imgptr.get();
+            }
+        }
 
-        doLock(img->camid);
-        memcpy(_data[img->camid], img->data, img->width * img->height);
-        doUnlock(img->camid);
+        for (size_t id = 0; id < newest.size(); id++) {
+            beeCompress::ImageBuffer *img = newest[id];
+            if (img == nullptr) {
+                continue;
+            }
+            doLock(img->camid);
+            img->copyTo(reinterpret_cast<uint8_t*>(_data[img->camid]));
+            doUnlock(img->camid);
+        }
     }
 
-    /* detach from the segment: */
-    if (shmdt(_data) == -1) {
-        perror("shmdt");
-        exit(1);
+    /* detach from the segments: */
+    for (char *data : _data) {
+        if (data != nullptr && shmdt(data) == -1) {
+            perror("shmdt");
+            exit(1);
+        }
     }
 }
 
@@ -11,6 +11,7 @@
 #include "Buffer/MutexBuffer.h"
 #include "Buffer/MutexLinkedList.h"
 #include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <vector>
 
 namespace beeCompress {
 
@@ -20,8 +21,12 @@ class SharedMemory : public QThread
 public:
     /**
      * @brief Simple constuctor. Only creates the buffer.
+     *
+     * Segments are created for cameras 0 to numCameras - 1 on first use.
+     *
+     * @param Number of cameras
      */
-    SharedMemory();
+    explicit SharedMemory(int numCameras = 4);
 
     /**
      * @brief STUB
@@ -65,17 +70,17 @@ protected:
 
     ////////////////////////Shared Memory///////////////#
 
-    //! Shared memory keys of camera 0 - 3
-    key_t _key[4];
+    //! Shared memory keys per camera
+    std::vector<key_t> _key;
 
-    //! Shared memory ids of camera 0 - 3
-    int _shmid[4];
+    //! Shared memory ids per camera
+    std::vector<int> _shmid;
 
-    //! Pointer to the memory segments of camera 0 - 3
-    char *_data[4] = {nullptr, nullptr, nullptr, nullptr};
+    //! Pointer to the memory segments per camera
+    std::vector<char*> _data;
 
-    //! Interprocess mutexes of camera 0 - 3
-    boost::interprocess::interprocess_mutex *_mutex[4] = {nullptr, nullptr, nullptr, nullptr};
+    //! Interprocess mutexes per camera
+    std::vector<boost::interprocess::interprocess_mutex*> _mutex;
     ////////////////////////////////////////////////////
 
     /**
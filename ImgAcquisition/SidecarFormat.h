@@ -0,0 +1,158 @@
+#ifndef SIDECARFORMAT_H_
+#define SIDECARFORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace beeCompress {
+
+/**
+ * @brief Layout of the binary sidecars next to the video.
+ *
+ * The frame sidecar (.bin) is a SidecarHeader followed by one
+ * SidecarRecord per frame in capture order. The index (.idx) is a
+ * SidecarHeader followed by one IndexRecord per coded picture in
+ * bitstream order, which is also capture order (no B-frames); see
+ * SegmentIndex for reading it. All fields are little endian and naturally aligned, so
+ * readers can mmap the file and index the records directly. A file cut
+ * short by a crash ends after the last flushed record.
+ *
+ * Version 1 headers end after recordBytes (see sidecarHeaderBytes); their
+ * videos are HEVC.
+ */
+struct SidecarHeader {
+    //! SIDECAR_MAGIC
+    char        magic[8];
+    //! SIDECAR_VERSION
+    uint32_t    version;
+    //! sizeof(SidecarRecord), so readers can skip fields added later
+    uint32_t    recordBytes;
+    //! VideoCodec of the video. Since version 2.
+    uint32_t    codec;
+    uint32_t    reserved;
+};
+
+struct SidecarRecord {
+    //! Frame counter of the camera
+    uint64_t    sequence;
+    //! Raw camera clock in ns. 0 if unknown.
+    uint64_t    cameraTimestampNs;
+    //! Capture time in ns since the UNIX epoch (UTC)
+    uint64_t    wallClockNs;
+    //! Position of the frame's coded picture in the video. SIDECAR_NO_OFFSET if it was never written.
+    uint64_t    videoOffset;
+};
+
+struct IndexRecord {
+    //! Position of the coded picture in the video
+    uint64_t    videoOffset;
+    //! Capture time in ns since the UNIX epoch (UTC). 0 if the frame was never logged.
+    uint64_t    wallClockNs;
+    //! Size of the coded picture, parameter sets included
+    uint32_t    videoBytes;
+    //! NAL unit type of the first slice in the codec of the video. INDEX_UNKNOWN_TYPE without a slice.
+    uint8_t     nalType;
+    //! 1 if decoding can start at this picture (an IRAP picture)
+    uint8_t     keyframe;
+    uint16_t    reserved;
+};
+
+static const char       SIDECAR_MAGIC[8]    = { 'B', 'E', 'E', 'F', 'R', 'M', 'S', '\0' };
+static const char       INDEX_MAGIC[8]      = { 'B', 'E', 'E', 'I', 'N', 'D', 'X', '\0' };
+static const uint32_t   SIDECAR_VERSION     = 2;
+static const uint64_t   SIDECAR_NO_OFFSET   = ~0ull;
+static const uint8_t    INDEX_UNKNOWN_TYPE  = 0xFF;
+
+static_assert(sizeof(SidecarHeader) == 24, "SidecarHeader must not be padded");
+static_assert(sizeof(SidecarRecord) == 32, "SidecarRecord must not be padded");
+static_assert(sizeof(IndexRecord) == 24, "IndexRecord must not be padded");
+
+//! Codec of the video, which decides how its NAL unit headers are read. Stored in the SidecarHeader.
+enum class VideoCodec : uint32_t {
+    HEVC    = 0,
+    H264    = 1,
+    //! Neither; pictures can not be typed
+    Unknown = 2
+};
+
+//! Bytes before the first record: version 1 headers lack the codec
+inline size_t sidecarHeaderBytes(const SidecarHeader &header) {
+    return header.version < 2 ? offsetof(SidecarHeader, codec) : sizeof(SidecarHeader);
+}
+
+//! Codec of the video. Version 1 sidecars were only written for HEVC.
+inline VideoCodec sidecarCodec(const SidecarHeader &header) {
+    return header.version < 2 ? VideoCodec::HEVC : static_cast<VideoCodec>(header.codec);
+}
+
+//! NAL unit type from the first byte of the NAL unit header
+inline uint8_t nalUnitType(VideoCodec codec, uint8_t header) {
+    return codec == VideoCodec::H264 ? header & 0x1F : (header >> 1) & 0x3F;
+}
+
+//! Whether NAL units of this type are slices: 0-31 in HEVC, 1-5 (with the partitions) in H.264
+inline bool isSliceNal(VideoCodec codec, uint8_t type) {
+    switch (codec) {
+    case VideoCodec::HEVC:
+        return type < 32;
+    case VideoCodec::H264:
+        return type >= 1 && type <= 5;
+    default:
+        return false;
+    }
+}
+
+//! Whether NAL units of this type are parameter sets: VPS, SPS and PPS in HEVC, SPS and PPS in H.264
+inline bool isParameterSetNal(VideoCodec codec, uint8_t type) {
+    switch (codec) {
+    case VideoCodec::HEVC:
+        return type >= 32 && type <= 34;
+    case VideoCodec::H264:
+        return type == 7 || type == 8;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Start code of the first slice in Annex B data.
+ *
+ * @return Offset of its 00 00 01, size if the data holds no slice
+ */
+inline size_t firstSlice(VideoCodec codec, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            if (isSliceNal(codec, nalUnitType(codec, data[i + 3]))) {
+                return i;
+            }
+            i += 3;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief NAL unit type of the first slice in an Annex B access unit.
+ *
+ * @return INDEX_UNKNOWN_TYPE if the data holds no slice
+ */
+inline uint8_t pictureType(VideoCodec codec, const uint8_t *data, size_t size) {
+    size_t slice = firstSlice(codec, data, size);
+    return slice < size ? nalUnitType(codec, data[slice + 3]) : INDEX_UNKNOWN_TYPE;
+}
+
+//! Whether a picture of this NAL unit type starts a decodable sequence: BLA, IDR or CRA in HEVC, IDR in H.264
+inline bool isKeyframe(VideoCodec codec, uint8_t nalType) {
+    switch (codec) {
+    case VideoCodec::HEVC:
+        return nalType >= 16 && nalType <= 23;
+    case VideoCodec::H264:
+        return nalType == 5;
+    default:
+        return false;
+    }
+}
+
+} /* namespace beeCompress */
+
+#endif /* SIDECARFORMAT_H_ */
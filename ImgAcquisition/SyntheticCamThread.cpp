@@ -0,0 +1,284 @@
+#include "SyntheticCamThread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <QDebug>
+#include <QDir>
+
+#include "settings/Settings.h"
+#include "settings/utility.h"
+#include "ThreadPlacement.h"
+
+//Number of precomputed noise samples. Must be a power of two.
+static const size_t NOISE_TABLE_SIZE = 1 << 20;
+
+//Pixels the pattern moves per frame, so the encoder has motion to work on
+static const int PATTERN_SPEED = 8;
+
+//Edge length of the squares of the pattern
+static const int PATTERN_CELL = 64;
+
+SyntheticCamThread::SyntheticCamThread() :
+    _ID(0), _Width(0), _Height(0), _Fps(0), _DropRate(0), _DriftPpm(0),
+    _ExposureUs(0), _GainDb(0), _NextFile(0),
+    _Buffer(nullptr), _SharedMemBuffer(nullptr), _Pool(nullptr),
+    _Calibration(nullptr), _Dog(nullptr) {
+
+}
+
+SyntheticCamThread::~SyntheticCamThread() {
+
+}
+
+bool SyntheticCamThread::isSynthetic(unsigned int id) {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    EncoderQualityConfig cfg = set->getBufferConf(id, 0);
+    return cfg.camid != -1 && cfg.camtype == "synthetic";
+}
+
+bool SyntheticCamThread::initialize(unsigned int id,
+                                    beeCompress::MutexBuffer *pBuffer,
+                                    beeCompress::MutexBuffer *pSharedMemBuffer, CalibrationInfo *calib,
+                                    Watchdog *dog) {
+    _SharedMemBuffer = pSharedMemBuffer;
+    _Buffer = pBuffer;
+    _ID = id;
+    _Calibration = calib;
+    _Dog = dog;
+    _initialized = false;
+    _Random.seed(id);
+
+    SettingsIAC *set = SettingsIAC::getInstance();
+    EncoderQualityConfig cfg = set->getBufferConf(_ID, 0);
+    _Width      = cfg.width;
+    _Height     = cfg.height;
+    _Fps        = std::max(cfg.fps, 1);
+    _Source     = cfg.syntheticsource;
+    _DropRate   = cfg.syntheticdroprate;
+    _DriftPpm   = cfg.syntheticdriftppm;
+    _ExposureUs = cfg.shutter * 1000.0f;
+    _GainDb     = static_cast<float>(cfg.gain);
+
+    if (_Width <= 0 || _Height <= 0) {
+        sendLogMessage(0, "Invalid frame size for a synthetic camera.");
+        return false;
+    }
+
+    if (_Source == "directory") {
+        QDir dir(QString::fromStdString(cfg.syntheticpath));
+        dir.setNameFilters(QStringList() << "*.png" << "*.pgm" << "*.raw");
+        dir.setFilter(QDir::Files);
+        dir.setSorting(QDir::Name);
+        for (const QString &file : dir.entryList()) {
+            _Files.push_back(dir.filePath(file).toStdString());
+        }
+        if (_Files.empty()) {
+            sendLogMessage(0, "No frames found in " + cfg.syntheticpath);
+            return false;
+        }
+    } else if (_Source == "video") {
+        if (!_Video.open(cfg.syntheticpath)) {
+            sendLogMessage(0, "Could not open recording " + cfg.syntheticpath);
+            return false;
+        }
+    } else {
+        if (_Source != "pattern") {
+            sendLogMessage(0, "Unknown synthetic source '" + _Source + "', using pattern.");
+            _Source = "pattern";
+        }
+
+        //Squares on a horizontal gradient. Twice as wide as the frame, so the
+        //moving window never has to wrap within a row.
+        const int bgWidth = 2 * _Width;
+        _Background.resize(static_cast<size_t>(bgWidth) * _Height);
+        for (int y = 0; y < _Height; y++) {
+            for (int x = 0; x < bgWidth; x++) {
+                const int gradient = 40 + (x % _Width) * 120 / _Width;
+                const bool cell = ((x / PATTERN_CELL) + (y / PATTERN_CELL)) % 2 == 0;
+                _Background[static_cast<size_t>(y) * bgWidth + x] =
+                    static_cast<uint8_t>(cell ? gradient + 60 : gradient);
+            }
+        }
+
+        if (cfg.syntheticnoise > 0) {
+            std::normal_distribution<double> noise(0.0, cfg.syntheticnoise);
+            _Noise.resize(NOISE_TABLE_SIZE);
+            for (int8_t &n : _Noise) {
+                n = static_cast<int8_t>(std::max(-127.0, std::min(127.0, std::round(noise(_Random)))));
+            }
+        }
+    }
+
+    _Pool = beeCompress::FramePool::reserve(_Width, _Height, cfg.poolsize,
+                                            ThreadPlacement::numaNode(ThreadPlacement::forCamera(_ID).cpus));
+    _Telemetry.reset(new CameraTelemetry("Cam " + std::to_string(_ID)));
+
+    sendLogMessage(0, "Synthetic camera (" + _Source + ") "
+                   + std::to_string(_Width) + "x" + std::to_string(_Height)
+                   + " at " + std::to_string(_Fps) + " fps");
+    _initialized = true;
+    return true;
+}
+
+void SyntheticCamThread::renderPattern(uint8_t *dst, uint64_t frame) {
+    const int bgWidth = 2 * _Width;
+    const int shift = static_cast<int>((frame * PATTERN_SPEED) % static_cast<uint64_t>(_Width));
+    const size_t mask = NOISE_TABLE_SIZE - 1;
+
+    for (int y = 0; y < _Height; y++) {
+        const uint8_t *src = &_Background[static_cast<size_t>(y) * bgWidth + shift];
+        uint8_t *row = dst + static_cast<size_t>(y) * _Width;
+        if (_Noise.empty()) {
+            memcpy(row, src, _Width);
+            continue;
+        }
+        //A random start per row keeps the noise from repeating visibly
+        const size_t start = _Random() & mask;
+        for (int x = 0; x < _Width; x++) {
+            const int v = src[x] + _Noise[(start + x) & mask];
+            row[x] = static_cast<uint8_t>(std::max(0, std::min(255, v)));
+        }
+    }
+}
+
+bool SyntheticCamThread::loadFile(uint8_t *dst) {
+    const std::string &path = _Files[_NextFile];
+    _NextFile = (_NextFile + 1) % _Files.size();
+
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".raw") == 0) {
+        std::ifstream in(path, std::ios::binary);
+        in.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(_Width) * _Height);
+        if (in.gcount() != static_cast<std::streamsize>(_Width) * _Height) {
+            sendLogMessage(1, "Raw frame " + path + " is smaller than "
+                           + std::to_string(_Width) + "x" + std::to_string(_Height));
+            return false;
+        }
+        return true;
+    }
+
+    cv::Mat frame = cv::imread(path, CV_LOAD_IMAGE_GRAYSCALE);
+    if (frame.empty()) {
+        sendLogMessage(1, "Could not read frame " + path);
+        return false;
+    }
+    fitFrame(frame, dst);
+    return true;
+}
+
+bool SyntheticCamThread::decodeFrame(uint8_t *dst) {
+    cv::Mat frame;
+    if (!_Video.read(frame) || frame.empty()) {
+        //End of the recording: start over
+        _Video.set(cv::CAP_PROP_POS_FRAMES, 0);
+        if (!_Video.read(frame) || frame.empty()) {
+            sendLogMessage(1, "Could not decode a frame of the recording.");
+            return false;
+        }
+    }
+    fitFrame(frame, dst);
+    return true;
+}
+
+void SyntheticCamThread::fitFrame(const cv::Mat &frame, uint8_t *dst) {
+    cv::Mat grey = frame;
+    if (frame.channels() != 1) {
+        cv::cvtColor(frame, grey, cv::COLOR_BGR2GRAY);
+    }
+
+    //Write straight into the pooled frame
+    cv::Mat out(_Height, _Width, CV_8UC1, dst);
+    if (grey.cols == _Width && grey.rows == _Height) {
+        grey.copyTo(out);
+    } else {
+        cv::resize(grey, out, cv::Size(_Width, _Height), 0, 0, cv::INTER_AREA);
+    }
+}
+
+void SyntheticCamThread::run() {
+    ThreadPlacement::apply(ThreadPlacement::forCamera(_ID), "Cam " + std::to_string(_ID));
+
+    const std::chrono::nanoseconds period(1000000000LL / _Fps);
+    const double clockRate = 1.0 + _DriftPpm * 1e-6;
+    std::bernoulli_distribution drop(std::max(0.0, std::min(1.0, _DropRate)));
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const uint64_t startWallNs = get_utc_time_ns();
+    std::chrono::steady_clock::time_point next = start;
+    uint64_t sequence = 0;
+
+    for (uint64_t frame = 0; true; frame++) {
+        _Dog->pulse(static_cast<int>(_ID));
+
+        //Sleep until the absolute due time, so rendering time does not add up
+        next += period;
+        std::this_thread::sleep_until(next);
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - next > 2 * period) {
+            sendLogMessage(1, "Warning: Synthetic frame " + std::to_string(frame) + " is "
+                           + std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now - next).count())
+                           + " ms late");
+            //Do not try to catch up with a burst of frames
+            next = now;
+        }
+
+        sequence++;
+        if (_DropRate > 0 && drop(_Random)) {
+            continue;
+        }
+
+        //Nothing to analyze for calibration
+        if (_Calibration->doCalibration) {
+            continue;
+        }
+
+        //The camera clock drifts and the wall clock follows it, as for the Ximea cameras
+        const double elapsedNs = std::chrono::duration<double, std::nano>(now - start).count();
+        const uint64_t cameraNs = static_cast<uint64_t>(elapsedNs * clockRate);
+
+        beeCompress::FrameMetadata meta;
+        meta.camId              = _ID;
+        meta.cameraTimestampNs  = cameraNs;
+        meta.wallClockNs        = startWallNs + cameraNs;
+        meta.sequence           = sequence;
+        meta.exposureUs         = _ExposureUs;
+        meta.gainDb             = _GainDb;
+        std::shared_ptr<beeCompress::ImageBuffer> buf = _Pool->acquire(meta);
+
+        bool ok = true;
+        if (_Source == "directory") {
+            ok = loadFile(buf->data);
+        } else if (_Source == "video") {
+            ok = decodeFrame(buf->data);
+        } else {
+            renderPattern(buf->data, frame);
+        }
+        if (!ok) {
+            continue;
+        }
+        //The time to produce the frame stands in for the capture call
+        _Telemetry->frameCaptured(sequence, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - now).count()));
+
+#ifndef USE_ENCODER
+        _Buffer->push(buf);
+#endif
+        _SharedMemBuffer->push(buf);
+    }
+}
+
+void SyntheticCamThread::sendLogMessage(int logLevel, QString message) {
+    emit logMessage(logLevel, "Cam " + QString::number(_ID) + " : " + message);
+}
+void SyntheticCamThread::sendLogMessage(int logLevel, std::string message) {
+    sendLogMessage(logLevel, QString::fromStdString(message));
+}
+void SyntheticCamThread::sendLogMessage(int logLevel, const char *message) {
+    sendLogMessage(logLevel, QString(message));
+}
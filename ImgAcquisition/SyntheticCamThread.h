@@ -0,0 +1,127 @@
+#pragma once
+
+#include "CamThread.h"
+#include "Buffer/MutexBuffer.h"
+#include "Buffer/FramePool.h"
+#include "Watchdog.h"
+#include "CameraTelemetry.h"
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/*!\brief Camera without hardware. Produces frames from a pattern, image files or a recording.
+ *
+ * Frames are delivered at the configured FPS and resolution of the camera
+ * slot, so encoding, writing and shared memory can be load-tested on any
+ * machine. Select it per camera slot with CAMTYPE "synthetic". The source
+ * is chosen with SYNTHETIC_SOURCE:
+ *
+ * "pattern"   A moving test pattern with gaussian sensor noise (SYNTHETIC_NOISE).
+ * "directory" PNG, PGM or raw (width*height bytes) frames in SYNTHETIC_PATH, in name order.
+ * "video"     Frames decoded from the recording SYNTHETIC_PATH.
+ *
+ * File sources are looped. Frames are dropped with probability
+ * SYNTHETIC_DROPRATE; the sequence number still advances, as it does when
+ * a real camera loses a frame. The camera clock runs SYNTHETIC_DRIFTPPM
+ * faster than the host clock and, as with the Ximea cameras, the wall
+ * clock timestamps are derived from it.
+ */
+class SyntheticCamThread : public CamThread
+{
+    Q_OBJECT   //generates the MOC
+
+public:
+    SyntheticCamThread();
+    virtual ~SyntheticCamThread();
+
+    /**
+     * @brief Opens the frame source of the camera slot
+     *
+     * @param Virtual ID of the camera (0 to number of cameras - 1)
+     * @param Buffer shared with the encoder thread
+     * @param Buffer shared with the shared memory thread
+     * @param Pointer to calibration data storeage
+     * @param Watchdog to notifiy each acquisition loop (when running)
+     */
+    virtual bool                initialize(unsigned int id, beeCompress::MutexBuffer *pBuffer,
+                                   beeCompress::MutexBuffer *pSharedMemBuffer, CalibrationInfo *calib,
+                                   Watchdog *dog) override;
+
+    //! Object has been initialized using "initialize"
+    virtual bool isInitialized() const override { return _initialized; }
+
+    //! Whether the camera slot is configured as a synthetic camera
+    static bool isSynthetic(unsigned int id);
+
+private:
+    //! Renders the next pattern frame into dst
+    void                renderPattern(uint8_t *dst, uint64_t frame);
+
+    //! Loads the next file of the directory into dst. False if it can not be read.
+    bool                loadFile(uint8_t *dst);
+
+    //! Decodes the next frame of the recording into dst. False if none can be decoded.
+    bool                decodeFrame(uint8_t *dst);
+
+    //! Copies a grey or color frame of any size into dst
+    void                fitFrame(const cv::Mat &frame, uint8_t *dst);
+
+    void                sendLogMessage(int logLevel, QString message);
+    void                sendLogMessage(int logLevel, std::string message);
+    void                sendLogMessage(int logLevel, const char *message);
+
+    bool                _initialized { false };
+
+    //! Virtual ID of the camera
+    unsigned int        _ID;
+
+    int                 _Width;
+    int                 _Height;
+    int                 _Fps;
+    std::string         _Source;
+    double              _DropRate;
+    double              _DriftPpm;
+    float               _ExposureUs;
+    float               _GainDb;
+
+    //! Static part of the pattern, twice as wide so a moving window can be cut out
+    std::vector<uint8_t> _Background;
+
+    //! Precomputed gaussian noise, indexed at a random offset per row
+    std::vector<int8_t> _Noise;
+
+    //! Files of the "directory" source and the next one to load
+    std::vector<std::string> _Files;
+    size_t              _NextFile;
+
+    //! Decoder of the "video" source
+    cv::VideoCapture    _Video;
+
+    std::mt19937        _Random;
+
+    //! Buffer shared with the encoder thread
+    beeCompress::MutexBuffer *_Buffer;
+
+    //! Buffer shared with the shared memory thread
+    beeCompress::MutexBuffer *_SharedMemBuffer;
+
+    //! Frame loss and latency counters (set by initialize)
+    std::unique_ptr<CameraTelemetry> _Telemetry;
+
+    //! Recycled storage for generated frames (set by initialize)
+    beeCompress::FramePool *_Pool;
+
+    //! Pointer to calibration data storeage (set by initialize)
+    CalibrationInfo     *_Calibration;
+
+    //! Watchdog to notifiy each acquisition loop (set by initialize)
+    Watchdog            *_Dog;
+
+protected:
+    void run(); //this is the function that will be iterated indefinitely
+
+signals:
+    virtual void                logMessage(int logLevel, QString message) override;
+};
@@ -0,0 +1,61 @@
+#include "SyntheticEncoder.h"
+#include "writeHandler.h"
+
+#include <algorithm>
+
+namespace {
+    //HEVC NAL unit types
+    const uint8_t NAL_TRAIL_R = 1;
+    const uint8_t NAL_IDR_W_RADL = 19;
+
+    const size_t HEADER_BYTES = 6;
+    const size_t IDR_FACTOR = 4;
+}
+
+namespace beeCompress {
+
+SyntheticEncoder::SyntheticEncoder() :
+    _Out(nullptr), _FrameBytes(0), _Frames(0), _IdrInterval(0), _Error(false) {
+}
+
+bool SyntheticEncoder::openSegment(const EncoderQualityConfig &cfg, writeHandler *wh) {
+    if (cfg.rcmode != 0 && cfg.fps > 0) {
+        _FrameBytes = static_cast<size_t>(cfg.bitrate) / cfg.fps / 8;
+    } else {
+        _FrameBytes = static_cast<size_t>(cfg.width) * cfg.height / 32;
+    }
+    _FrameBytes = std::max(_FrameBytes, HEADER_BYTES + 1);
+
+    //Payload without zero bytes, so it never contains a start code
+    _Unit.assign(_FrameBytes * IDR_FACTOR, 0xAA);
+    _Out = wh;
+    _Frames = 0;
+    _IdrInterval = cfg.idrinterval;
+    _Error = false;
+    return true;
+}
+
+bool SyntheticEncoder::submitFrame(const ImageBuffer &) {
+    bool idr = _Frames == 0 || (_IdrInterval > 0 && _Frames % _IdrInterval == 0);
+    _Frames++;
+    return emit(idr ? NAL_IDR_W_RADL : NAL_TRAIL_R, idr ? _FrameBytes * IDR_FACTOR : _FrameBytes);
+}
+
+bool SyntheticEncoder::flush() {
+    return !_Error;
+}
+
+long SyntheticEncoder::closeSegment() {
+    return _Error ? -1 : static_cast<long>(_Out->_videoBytes);
+}
+
+bool SyntheticEncoder::emit(uint8_t nalType, size_t size) {
+    const uint8_t header[HEADER_BYTES] = { 0, 0, 0, 1, static_cast<uint8_t>(nalType << 1), 1 };
+    std::copy(header, header + HEADER_BYTES, _Unit.begin());
+    if (!_Out->writeVideo(_Unit.data(), size)) {
+        _Error = true;
+    }
+    return !_Error;
+}
+
+} /* namespace beeCompress */
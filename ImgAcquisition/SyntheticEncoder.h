@@ -0,0 +1,53 @@
+#ifndef SYNTHETICENCODER_H_
+#define SYNTHETICENCODER_H_
+
+#include "EncoderBackend.h"
+#include <cstdint>
+#include <vector>
+
+namespace beeCompress {
+
+/**
+ * @brief Encoder without an encoder. Emits placeholder HEVC units of a realistic size.
+ *
+ * Each frame yields one Annex B unit: an IDR slice for the first frame
+ * of a segment and every IDRINTERVAL frames, trailing slices otherwise.
+ * Its size follows the rate control of the buffer: BITRATE / FPS with
+ * RCMODE other than 0, about a quarter bit per pixel with constant QP.
+ * The IDR is four times as large. The payload can not be decoded.
+ *
+ * With SyntheticCamThread this load-tests buffering, scheduling and
+ * writing (see BitstreamWriter) on machines without a GPU or codecs.
+ * Select it with ENCODER_BACKEND "synthetic".
+ */
+class SyntheticEncoder : public EncoderBackend {
+public:
+
+    SyntheticEncoder();
+
+    bool openSegment(const EncoderQualityConfig &cfg, writeHandler *wh) override;
+
+    bool submitFrame(const ImageBuffer &img) override;
+
+    bool flush() override;
+
+    long closeSegment() override;
+
+private:
+
+    //! Writes a unit of the given NAL type with size bytes in total
+    bool emit(uint8_t nalType, size_t size);
+
+    writeHandler            *_Out;
+    size_t                  _FrameBytes;
+    //! Frames of the segment so far
+    int                     _Frames;
+    int                     _IdrInterval;
+    bool                    _Error;
+    //! Start code, NAL header and payload of the largest unit
+    std::vector<uint8_t>    _Unit;
+};
+
+} /* namespace beeCompress */
+
+#endif /* SYNTHETICENCODER_H_ */
@@ -0,0 +1,189 @@
+#include "ThreadPlacement.h"
+#include "settings/Settings.h"
+#include "settings/ParamNames.h"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    int parsePolicy(const std::string &policy, const std::string &threadClass) {
+#ifdef __linux__
+        if (policy == "fifo") {
+            return SCHED_FIFO;
+        }
+        if (policy == "rr") {
+            return SCHED_RR;
+        }
+        if (policy != "other") {
+            std::cout << "Warning: unknown scheduling policy \"" << policy << "\" for "
+                      << threadClass << ", using \"other\"." << std::endl;
+        }
+        return SCHED_OTHER;
+#else
+        return 0;
+#endif
+    }
+
+    //CPUs of a NUMA node, empty if there is no such node
+    std::vector<int> nodeCpus(int node) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!std::getline(in, list)) {
+            return std::vector<int>();
+        }
+        return ThreadPlacement::parseCpuList(list);
+    }
+
+    //NUMA node of a CPU, -1 if unknown
+    int nodeOfCpu(int cpu) {
+        int node = -1;
+#ifdef __linux__
+        //The CPU's sysfs directory links to its node as "node<N>"
+        DIR *dir = opendir(("/sys/devices/system/cpu/cpu" + std::to_string(cpu)).c_str());
+        if (dir == nullptr) {
+            return -1;
+        }
+        while (struct dirent *entry = readdir(dir)) {
+            if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1) {
+                break;
+            }
+            node = -1;
+        }
+        closedir(dir);
+#endif
+        return node;
+    }
+
+    bool setAffinity(const std::vector<int> &cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+}
+
+std::vector<int> ThreadPlacement::parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        if (part.find_first_not_of(" \t\n") == std::string::npos) {
+            continue;
+        }
+        int first, last;
+        char dash;
+        std::stringstream range(part);
+        if (!(range >> first)) {
+            std::cout << "Warning: ignoring \"" << part << "\" in CPU list \"" << list << "\"." << std::endl;
+            continue;
+        }
+        if (!(range >> dash >> last) || dash != '-') {
+            last = first;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            if (cpu >= 0) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+ThreadPlacement::Placement ThreadPlacement::get(const std::string &threadClass) {
+    SettingsIAC *set = SettingsIAC::getInstance();
+    Placement p;
+    p.cpus = parseCpuList(set->maybeGetValueOfParam<std::string>(
+                              threadClass + "." + IMACQUISITION::THREADCONF::CPUS).get_value_or(""));
+    p.policy = parsePolicy(set->maybeGetValueOfParam<std::string>(
+                               threadClass + "." + IMACQUISITION::THREADCONF::POLICY).get_value_or("other"),
+                           threadClass);
+    p.priority = set->maybeGetValueOfParam<int>(
+                     threadClass + "." + IMACQUISITION::THREADCONF::PRIORITY).get_value_or(0);
+    return p;
+}
+
+ThreadPlacement::Placement ThreadPlacement::forCamera(unsigned int id) {
+    Placement p = get(IMACQUISITION::THREADS_CAPTURE);
+    EncoderQualityConfig cfg = SettingsIAC::getInstance()->getBufferConf(static_cast<int>(id), 0);
+    if (cfg.camid >= 0 && !cfg.cpus.empty()) {
+        p.cpus = parseCpuList(cfg.cpus);
+    }
+    return p;
+}
+
+void ThreadPlacement::apply(const Placement &placement, const std::string &name) {
+#ifdef __linux__
+    if (!placement.cpus.empty() && !setAffinity(placement.cpus)) {
+        std::cout << "Warning: could not pin " << name << " to its CPUs, none of them is online." << std::endl;
+    }
+
+    if (placement.policy != SCHED_OTHER) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = placement.priority;
+        int err = pthread_setschedparam(pthread_self(), placement.policy, &param);
+        if (err != 0) {
+            std::cout << "Warning: could not set the real-time priority " << placement.priority
+                      << " of " << name << ": " << strerror(err)
+                      << ". It needs CAP_SYS_NICE or an rtprio limit." << std::endl;
+        }
+    }
+#endif
+}
+
+int ThreadPlacement::numaNode(const std::vector<int> &cpus) {
+    int node = -1;
+    for (size_t i = 0; i < cpus.size(); i++) {
+        int n = nodeOfCpu(cpus[i]);
+        if (n < 0 || (i > 0 && n != node)) {
+            return -1;
+        }
+        node = n;
+    }
+    return node;
+}
+
+void ThreadPlacement::runOnNode(int node, const std::function<void()> &function) {
+    std::vector<int> cpus;
+    if (node >= 0) {
+        cpus = nodeCpus(node);
+    }
+    if (cpus.empty()) {
+        function();
+        return;
+    }
+
+    //Exceptions (e.g. std::bad_alloc) are passed on to the caller
+    std::exception_ptr error;
+    std::thread worker([&cpus, &function, &error]() {
+        setAffinity(cpus);
+        try {
+            function();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    });
+    worker.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
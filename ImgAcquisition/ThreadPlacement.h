@@ -0,0 +1,62 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*!\brief CPU affinity, scheduling policy and NUMA node of the pipeline threads.
+ *
+ * Each thread class (capture, encoder, shared memory, analysis) has a
+ * section IMACQUISITION.THREADS.<CLASS> with
+ *
+ * CPUS     CPU list as in /proc/cpuinfo, e.g. "0-3,8". Empty: any CPU.
+ * POLICY   "other" (default), "fifo" (SCHED_FIFO) or "rr" (SCHED_RR).
+ * PRIORITY Real-time priority for "fifo" and "rr", 1 to 99.
+ *
+ * Capture threads can be pinned per camera with the CPUS key of the
+ * camera's buffer entry. Real-time policies need CAP_SYS_NICE or an
+ * rtprio limit; without them a warning is printed and the thread runs
+ * with the default policy.
+ */
+class ThreadPlacement {
+public:
+
+    struct Placement {
+        //! Empty if the thread may run on any CPU
+        std::vector<int>    cpus;
+        //! SCHED_OTHER, SCHED_FIFO or SCHED_RR
+        int                 policy;
+        int                 priority;
+    };
+
+    //! Reads the placement of a thread class, e.g. IMACQUISITION::THREADS_ENCODER.
+    static Placement get(const std::string &threadClass);
+
+    //! Placement of the capture thread of a camera, including the camera's own CPU set.
+    static Placement forCamera(unsigned int id);
+
+    /**
+     * @brief Applies the placement to the calling thread.
+     *
+     * Call it at the beginning of QThread::run().
+     *
+     * @param Placement to apply
+     * @param Name of the thread for warnings
+     */
+    static void apply(const Placement &placement, const std::string &name);
+
+    //! NUMA node all given CPUs belong to. -1 if unknown, none given or they span nodes.
+    static int numaNode(const std::vector<int> &cpus);
+
+    /**
+     * @brief Runs a function on a CPU of the given NUMA node and waits for it.
+     *
+     * Memory first touched by the function is placed on that node by the
+     * kernel's default policy. Runs the function on the calling thread if
+     * the node is negative or unknown.
+     */
+    static void runOnNode(int node, const std::function<void()> &function);
+
+    //! Parses a CPU list like "0-3,8". Invalid parts are skipped with a warning.
+    static std::vector<int> parseCpuList(const std::string &list);
+};
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <iostream>
+#include <vector>
 
 
 class Watchdog
@@ -11,11 +12,21 @@ class Watchdog
 
 public:
 
-    //! [x]==1 means cam x is active. x==5 is the analysis thread.
-    int                 _camActive[6];
+    /**
+     * @brief Creates a watchdog with one slot per camera and one for the analysis thread.
+     *
+     * @param Number of cameras
+     */
+    explicit Watchdog(int numCameras = 4) :
+        _camActive(numCameras + 1, 0),
+        _timestamps(numCameras + 1, 0) {
+    }
+
+    //! [x]==1 means cam x is active. The last slot is the analysis thread.
+    std::vector<int>                 _camActive;
 
     //! Timestamp when x was seen alive last time.
-    unsigned long int   _timestamps[6];
+    std::vector<unsigned long int>   _timestamps;
 
     /**
      * @brief Check all slots for a timeout.
@@ -25,7 +36,7 @@ public:
         //Find processes which might be dead
         //Iff the process didn't deliver something for analysis in the
         //last 60 seconds it's considered dead.
-        for (int i=0; i<=5; i++) {
+        for (size_t i=0; i<_camActive.size(); i++) {
             if (_camActive[i] == 1) {
                 unsigned long int now = time(NULL);
                 if (now - _timestamps[i] > 60) {
@@ -39,14 +50,19 @@ public:
     /**
      * @brief As a process, signal that it's alive
      *
-     * @param the process id. Has to be 0 ~ 5
+     * @param the process id. A camera id or analysisSlot()
      */
     void pulse(int id)
     {
         _camActive[id] = 1;
         _timestamps[id] = time(NULL);
     }
+
+    //! Slot of the analysis thread
+    int analysisSlot() const
+    {
+        return static_cast<int>(_camActive.size()) - 1;
+    }
 };
 
 #endif // WATCHDOG_H
-
@@ -1,5 +1,6 @@
 ﻿#include "XimeaCamThread.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
@@ -11,9 +12,11 @@
 #include "settings/Settings.h"
 #include "settings/utility.h"
 #include "ImageAnalysis.h"
+#include "ClockModel.h"
+#include "ThreadPlacement.h"
+#include "PooledCapture.h"
 #include <sstream> //stringstreams
 
-#include <array>
 #include <ctime> //get time
 #include <time.h>
 
@@ -24,13 +27,6 @@
 #include <stdint.h>
 #endif
 
-#if HALIDE
-#include "halideYuv420Conv.h"
-#include "Halide.h"
-//On Windows this might conflict with predefs
-#undef user_error
-#endif
-
 #include <opencv2/opencv.hpp>
 
 #include <opencv2/core/core.hpp>
@@ -63,6 +59,24 @@ bool XimeaCamThread::initialize(unsigned int id,
     _Dog = dog;
 
     if (initCamera()) {
+        SettingsIAC *set = SettingsIAC::getInstance();
+        EncoderQualityConfig cfg = set->getBufferConf(_ID, 0);
+        // The camera writes whole sensor images straight into pooled frames,
+        // allocated close to the CPUs the capture thread will run on.
+        // A slot holds a whole image including the row padding of the camera.
+        _Pool = beeCompress::FramePool::reserve(_SensorPitch, _SensorHeight, cfg.poolsize,
+                                                ThreadPlacement::numaNode(ThreadPlacement::forCamera(_ID).cpus));
+
+        _Telemetry.reset(new CameraTelemetry("Cam " + std::to_string(_ID)));
+        _Telemetry->setSampler([this](CameraTelemetry &telemetry) {
+            int transport {0}, api {0};
+            xiSetParamInt(_Camera, XI_PRM_COUNTER_SELECTOR, XI_CNT_SEL_TRANSPORT_SKIPPED_FRAMES);
+            xiGetParamInt(_Camera, XI_PRM_COUNTER_VALUE, &transport);
+            xiSetParamInt(_Camera, XI_PRM_COUNTER_SELECTOR, XI_CNT_SEL_API_SKIPPED_FRAMES);
+            xiGetParamInt(_Camera, XI_PRM_COUNTER_VALUE, &api);
+            telemetry.setSkipCounters(static_cast<uint64_t>(transport), static_cast<uint64_t>(api));
+        });
+
         std::cout << "Starting capture on camera " << id << std::endl;
         _initialized = startCapture();
         std::cout << "Done starting capture." << std::endl;
@@ -104,7 +118,7 @@ bool XimeaCamThread::initCamera()
     }
 
     _HWID = std::numeric_limits<decltype(_HWID)>::max();
-    for (int i = 0; i < 4; ++i)
+    for (int i = 0; i < static_cast<int>(numberOfDevices); ++i)
     {
         XI_RETURN errorCode;
         HANDLE cam;
@@ -216,11 +230,9 @@ bool XimeaCamThread::initCamera()
     xiSetParamInt(_Camera, XI_PRM_TRG_SELECTOR, XI_TRG_SEL_FRAME_START);
     xiSetParamInt(_Camera, XI_PRM_EXPOSURE_BURST_COUNT, 1);
 
-    // The Ximea camera does not support 4000x3000 pixels.
-    // errorCode = xiSetParamInt(_Camera, XI_PRM_WIDTH, 4000);
-    // if (!checkReturnCode(errorCode, "xiSetParamInt XI_PRM_WIDTH")) return false;
-    // errorCode = xiSetParamInt(_Camera, XI_PRM_HEIGHT, 3000);
-    // if (!checkReturnCode(errorCode, "xiSetParamInt XI_PRM_HEIGHT")) return false;
+    // Only transfer the pixels we keep. If the sensor can not be cropped,
+    // run() crops the whole image in software.
+    _RoiApplied = applyRoi(cfg);
 
     // Gain.
     errorCode = xiSetParamInt(_Camera, XI_PRM_GAIN_SELECTOR, XI_GAIN_SELECTOR_ALL);
@@ -264,8 +276,20 @@ bool XimeaCamThread::initCamera()
         if (!checkReturnCode(errorCode, "xiSetParamInt XI_PRM_ACQ_BUFFER_SIZE")) return false;
     }
 
-    //errorCode = xiSetParamInt(_Camera, XI_PRM_BUFFER_POLICY, XI_BP_SAFE);
-    //if (!checkReturnCode(errorCode, "xiSetParamInt XI_PRM_BUFFER_POLICY")) return false;
+    // Let the API write into our buffers (image.bp) instead of handing out its own.
+    errorCode = xiSetParamInt(_Camera, XI_PRM_BUFFER_POLICY, XI_BP_SAFE);
+    if (!checkReturnCode(errorCode, "xiSetParamInt XI_PRM_BUFFER_POLICY")) return false;
+
+    // Size of the images delivered by the camera; the pooled frames have to hold them.
+    errorCode = xiGetParamInt(_Camera, XI_PRM_WIDTH, &_SensorWidth);
+    if (!checkReturnCode(errorCode, "xiGetParamInt XI_PRM_WIDTH")) return false;
+    errorCode = xiGetParamInt(_Camera, XI_PRM_HEIGHT, &_SensorHeight);
+    if (!checkReturnCode(errorCode, "xiGetParamInt XI_PRM_HEIGHT")) return false;
+    // Rows may be padded, the payload covers that.
+    int payloadSize { 0 };
+    errorCode = xiGetParamInt(_Camera, XI_PRM_IMAGE_PAYLOAD_SIZE, &payloadSize);
+    if (!checkReturnCode(errorCode, "xiGetParamInt XI_PRM_IMAGE_PAYLOAD_SIZE")) return false;
+    _SensorPitch = std::max(_SensorWidth, (payloadSize + _SensorHeight - 1) / std::max(_SensorHeight, 1));
 
     // Set maximum transport buffer size.
     {
@@ -280,6 +304,66 @@ bool XimeaCamThread::initCamera()
     return true;
 }
 
+namespace {
+    // Rounds value up to the next multiple of increment
+    int roundUp(int value, int increment) {
+        return increment > 1 ? (value + increment - 1) / increment * increment : value;
+    }
+
+    // Rounds value down to the previous multiple of increment
+    int roundDown(int value, int increment) {
+        return increment > 1 ? value / increment * increment : value;
+    }
+}
+
+bool XimeaCamThread::applyRoi(const EncoderQualityConfig &cfg)
+{
+    int maxWidth { 0 }, maxHeight { 0 };
+    int widthIncrement { 1 }, heightIncrement { 1 };
+    int offsetXIncrement { 1 }, offsetYIncrement { 1 };
+    if (xiGetParamInt(_Camera, XI_PRM_WIDTH XI_PRM_INFO_MAX, &maxWidth) != XI_OK
+            || xiGetParamInt(_Camera, XI_PRM_HEIGHT XI_PRM_INFO_MAX, &maxHeight) != XI_OK)
+    {
+        sendLogMessage(1, "Could not query the sensor size. Cropping in software.");
+        return false;
+    }
+    xiGetParamInt(_Camera, XI_PRM_WIDTH XI_PRM_INFO_INCREMENT, &widthIncrement);
+    xiGetParamInt(_Camera, XI_PRM_HEIGHT XI_PRM_INFO_INCREMENT, &heightIncrement);
+    xiGetParamInt(_Camera, XI_PRM_OFFSET_X XI_PRM_INFO_INCREMENT, &offsetXIncrement);
+    xiGetParamInt(_Camera, XI_PRM_OFFSET_Y XI_PRM_INFO_INCREMENT, &offsetYIncrement);
+
+    // The ROI may be a bit larger than the video; run() crops the rest.
+    const int width = std::min(roundUp(cfg.width, widthIncrement), maxWidth);
+    const int height = std::min(roundUp(cfg.height, heightIncrement), maxHeight);
+    // A negative offset centers the ROI on the sensor.
+    const int offsetX = roundDown(std::min(cfg.offsetx < 0 ? (maxWidth - width) / 2 : cfg.offsetx,
+                                           maxWidth - width), offsetXIncrement);
+    const int offsetY = roundDown(std::min(cfg.offsety < 0 ? (maxHeight - height) / 2 : cfg.offsety,
+                                           maxHeight - height), offsetYIncrement);
+
+    // Offsets first go to 0, so the new size is always valid.
+    XI_RETURN errorCode = xiSetParamInt(_Camera, XI_PRM_OFFSET_X, 0);
+    if (errorCode == XI_OK) errorCode = xiSetParamInt(_Camera, XI_PRM_OFFSET_Y, 0);
+    if (errorCode == XI_OK) errorCode = xiSetParamInt(_Camera, XI_PRM_WIDTH, width);
+    if (errorCode == XI_OK) errorCode = xiSetParamInt(_Camera, XI_PRM_HEIGHT, height);
+    if (errorCode == XI_OK) errorCode = xiSetParamInt(_Camera, XI_PRM_OFFSET_X, offsetX);
+    if (errorCode == XI_OK) errorCode = xiSetParamInt(_Camera, XI_PRM_OFFSET_Y, offsetY);
+    if (errorCode != XI_OK)
+    {
+        sendLogMessage(1, "Setting the sensor ROI failed with code " + std::to_string(errorCode)
+                       + ". Cropping in software.");
+        xiSetParamInt(_Camera, XI_PRM_OFFSET_X, 0);
+        xiSetParamInt(_Camera, XI_PRM_OFFSET_Y, 0);
+        xiSetParamInt(_Camera, XI_PRM_WIDTH, maxWidth);
+        xiSetParamInt(_Camera, XI_PRM_HEIGHT, maxHeight);
+        return false;
+    }
+
+    sendLogMessage(0, "Sensor ROI " + std::to_string(width) + "x" + std::to_string(height)
+                   + " at " + std::to_string(offsetX) + "," + std::to_string(offsetY));
+    return true;
+}
+
 // This function starts the streaming from the camera
 bool XimeaCamThread::startCapture() {
     auto errorCode = xiStartAcquisition(_Camera);
@@ -294,6 +378,8 @@ bool XimeaCamThread::startCapture() {
 void XimeaCamThread::run() {
     char logfilepathFull[256];
 
+    ThreadPlacement::apply(ThreadPlacement::forCamera(_ID), "Cam " + std::to_string(_ID));
+
     SettingsIAC *set = SettingsIAC::getInstance();
     EncoderQualityConfig cfg = set->getBufferConf(_ID, 0);
     std::string logdir = set->getValueOfParam<std::string>(
@@ -330,30 +416,31 @@ void XimeaCamThread::run() {
         }
     }
     // The camera timestamp will be used to get a more accurate idea of when the image was taken.
-    // Software hangups (e.g. short CPU spikes) can thus be mitigated.
-    unsigned long lastCameraTimestampMicroseconds {0};
+    // Software hangups (e.g. short CPU spikes) and the drift of the camera clock are corrected by the model.
+    ClockModel clock("Cam " + std::to_string(_ID));
     unsigned long lastImageSequenceNumber {0};
-    boost::posix_time::ptime lastCameraTimestamp;
-
-    // Preallocate image buffer on stack in order to safe performance later.
-    std::array<unsigned char, 3008 * 4112> imageBuffer;
 
     for (size_t loopCount = 0; true; loopCount += 1)
     {
         _Dog->pulse(static_cast<int>(_ID));
 
+        // The image is captured straight into a pooled frame (XI_BP_SAFE), which then
+        // goes into the queues without a copy. The metadata is filled in below.
+        std::shared_ptr<beeCompress::ImageBuffer> full = _Pool->acquire(beeCompress::FrameMetadata());
+        full->width = _SensorWidth;
+
         XI_IMG image;
         image.size = sizeof(XI_IMG);
-        image.bp = static_cast<LPVOID> (&imageBuffer[0]);
-        image.bp_size = imageBuffer.size();
+        image.bp = static_cast<LPVOID> (full->data);
+        image.bp_size = static_cast<DWORD>(_Pool->slotSize());
 
         const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
         //Retrieve image and metadata
         auto returnCode = xiGetImage(_Camera, 1000 * 2, &image);
         //Get the timestamp
         const auto wallClockNow = boost::posix_time::microsec_clock::universal_time();
+        const uint64_t hostUtcNs = get_utc_time_ns();
         const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-        const unsigned long currentCameraTimestampMicroseconds = image.tsUSec;
 
         // Image sequence sanity check.
         if (lastImageSequenceNumber != 0 && image.nframe != lastImageSequenceNumber + 1)
@@ -366,41 +453,10 @@ void XimeaCamThread::run() {
             str.append(boost::posix_time::to_iso_extended_string(wallClockNow).c_str());
             std::cout << str.toStdString() << std::endl;
             generateLog(logfilepathFull, str);
-
-            for (auto &what : std::map<std::string, int> {{"Transport layer loss: ", XI_CNT_SEL_TRANSPORT_SKIPPED_FRAMES},
-                                {"API layer loss: ", XI_CNT_SEL_API_SKIPPED_FRAMES}})
-            {
-                xiSetParamInt(_Camera, XI_PRM_COUNTER_SELECTOR, what.second);
-                int result {0};
-                xiGetParamInt(_Camera, XI_PRM_COUNTER_VALUE, &result);
-                std::cout << what.first << result << std::endl;
-            }
-
+            // The transport and API skip counters are read by the telemetry sampler, off this thread.
         }
         lastImageSequenceNumber = image.nframe;
 
-        // Reset the camera timestamp?
-        if (lastCameraTimestampMicroseconds == 0 || (lastCameraTimestampMicroseconds > currentCameraTimestampMicroseconds))
-        {
-            if (lastCameraTimestampMicroseconds != 0 && lastCameraTimestamp > wallClockNow && loopCount > 10)
-            {
-                QString str("Warning: camera clock faster than wall time. Last camera time: ");
-                str.append(boost::posix_time::to_iso_extended_string(lastCameraTimestamp).c_str());
-                str.append(" wall clock: ");
-                str.append(boost::posix_time::to_iso_extended_string(wallClockNow).c_str());
-                std::cout << str.toStdString() << std::endl;
-                generateLog(logfilepathFull, str);
-            }
-            lastCameraTimestamp = wallClockNow;
-        }
-        else
-        {
-            const long microsecondDelta = static_cast<const long>(currentCameraTimestampMicroseconds - lastCameraTimestampMicroseconds);
-            assert (microsecondDelta >= 0);
-            lastCameraTimestamp += boost::posix_time::microseconds(microsecondDelta);
-        }
-        lastCameraTimestampMicroseconds = currentCameraTimestampMicroseconds;
-
         // Skip the first X images to allow the camera buffer to be flushed.
         if (loopCount < 10)
         {
@@ -427,6 +483,13 @@ void XimeaCamThread::run() {
             std::exit(1);
         }
 
+        const uint64_t cameraTimestampNs = static_cast<uint64_t>(image.tsSec) * 1000000000ULL
+                                           + static_cast<uint64_t>(image.tsUSec) * 1000ULL;
+        const uint64_t hostMonotonicNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end.time_since_epoch()).count());
+        const uint64_t frameUtcNs = clock.update(cameraTimestampNs, hostMonotonicNs, hostUtcNs);
+        _Telemetry->frameCaptured(image.nframe, static_cast<uint64_t>(duration));
+
 
         //converts the time in seconds to local time
         const std::time_t timestamp { image.tsSec };
@@ -437,21 +500,45 @@ void XimeaCamThread::run() {
 
         //Not in calibration mode. Move image to buffer for further procession
         if (!_Calibration->doCalibration) {
+            beeCompress::FrameMetadata meta;
+            meta.camId              = _ID;
+            meta.cameraTimestampNs  = cameraTimestampNs;
+            meta.wallClockNs        = frameUtcNs;
+            meta.sequence           = image.nframe;
+            meta.exposureUs         = image.exposure_time_us;
+            meta.gainDb             = image.gain_db;
+            full->meta   = meta;
+            full->camid  = meta.camId;
+
+            // Only an image the API wrote into the pooled frame, with a pitch the slot holds, is used in place.
+            const beeCompress::DeliveredImage delivered = {
+                static_cast<const uint8_t*>(image.bp), static_cast<int>(image.width),
+                static_cast<int>(image.height), static_cast<int>(image.width + image.padding_x)
+            };
+            if (!beeCompress::adoptDeliveredImage(*full, _Pool->slotSize(), delivered)) {
+                _Telemetry->frameCopied();
+            }
+
             // Crop the image to the expected size (e.g. 4000x3000).
             // This is necessary, because the encoder/codec requires the image sizes to be some multiple of X.
-            cv::Mat wholeImageMatrix(cv::Size(static_cast<int>(image.width), static_cast<int>(image.height)), CV_8UC1, image.bp, cv::Mat::AUTO_STEP);
-            const unsigned int marginToBeCroppedX = (image.width > vwidth) ? image.width - vwidth : 0;
-            const unsigned int marginToBeCroppedY = (image.height > vheight) ? image.height - vheight : 0;
+            // With a sensor ROI only the rounding to the ROI increments is left over.
+            // The crop is a view of the captured frame, nothing is copied.
+            const unsigned int marginToBeCroppedX = (static_cast<unsigned int>(full->width) > vwidth) ? full->width - vwidth : 0;
+            const unsigned int marginToBeCroppedY = (static_cast<unsigned int>(full->height) > vheight) ? full->height - vheight : 0;
+            std::shared_ptr<beeCompress::ImageBuffer> buf = full;
             if (marginToBeCroppedX > 0 || marginToBeCroppedY > 0)
             {
-                const int cropLeft = marginToBeCroppedX / 2;
-                const int cropTop = marginToBeCroppedY / 2;
-                cv::Mat croppedImageMatrix = wholeImageMatrix(cv::Rect(cropLeft, cropTop, static_cast<int>(vwidth), static_cast<int>(vheight)));
-                croppedImageMatrix.copyTo(wholeImageMatrix);
+                // Without a sensor ROI, the configured offsets (negative: centered) apply here.
+                const bool useOffsets = !_RoiApplied;
+                const int cropLeft = (useOffsets && cfg.offsetx >= 0)
+                                     ? std::min(static_cast<unsigned int>(cfg.offsetx), marginToBeCroppedX)
+                                     : marginToBeCroppedX / 2;
+                const int cropTop = (useOffsets && cfg.offsety >= 0)
+                                    ? std::min(static_cast<unsigned int>(cfg.offsety), marginToBeCroppedY)
+                                    : marginToBeCroppedY / 2;
+                buf = beeCompress::ImageBuffer::makeView(full, cropLeft, cropTop,
+                        static_cast<int>(vwidth), static_cast<int>(vheight));
             }
-            const std::string frameTimestamp = boost::posix_time::to_iso_extended_string(lastCameraTimestamp) + "Z";
-            auto buf = std::make_shared<beeCompress::ImageBuffer>(vwidth, vheight, _ID, frameTimestamp);
-            memcpy(buf.get()->data, wholeImageMatrix.data, vwidth * vheight);
 
 #ifndef USE_ENCODER
             _Buffer->push(buf);
@@ -460,6 +547,7 @@ void XimeaCamThread::run() {
 
 #ifdef WITH_DEBUG_IMAGE_OUTPUT
             {
+                cv::Mat wholeImageMatrix(cv::Size(full->width, full->height), CV_8UC1, full->data, static_cast<size_t>(full->stride));
                 cv::Mat smallMat;
                 cv::resize(wholeImageMatrix, smallMat, cv::Size(400, 300));
                 cv::imshow("Display window", smallMat );
@@ -6,7 +6,11 @@
 #include "CamThread.h"
 #include <xiApi.h>
 #include "Buffer/MutexBuffer.h"
+#include "Buffer/FramePool.h"
 #include "Watchdog.h"
+#include "CameraTelemetry.h"
+#include "settings/Settings.h"
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -25,7 +29,7 @@ public:
     /**
      * @brief Initialization of cameras and configuration
      *
-     * @param Virtual ID of the camera (0 to 3)
+     * @param Virtual ID of the camera (0 to number of cameras - 1)
      * @param Buffer shared with the encoder thread
      * @param Buffer shared with the shared memory thread
      * @param Pointer to calibration data storeage
@@ -33,7 +37,7 @@ public:
      */
     virtual bool                initialize(unsigned int id, beeCompress::MutexBuffer *pBuffer,
                                    beeCompress::MutexBuffer *pSharedMemBuffer, CalibrationInfo *calib,
-                                   Watchdog *dog) override;  //here goes the camera ID (from 0 to 3)
+                                   Watchdog *dog) override;
 
     //! Object has been initialized using "initialize"
     virtual bool isInitialized() const  override { return _initialized; }
@@ -58,6 +62,16 @@ private:
     bool                initCamera();
     bool                startCapture();
 
+    /**
+     * @brief Programs the sensor ROI to the video size and the configured offsets
+     *
+     * The ROI is rounded up to the increments of the sensor. A negative
+     * offset centers the ROI.
+     *
+     * @return false if the sensor is left uncropped
+     */
+    bool                applyRoi(const EncoderQualityConfig &cfg);
+
     //! @brief Just prints the camera's info
     //void                PrintCameraInfo(CameraInfo *pCamInfo);
 
@@ -132,6 +146,21 @@ private:
     //! Buffer shared with the shared memory thread
     beeCompress::MutexBuffer *_SharedMemBuffer;
 
+    //! Recycled storage for captured frames, sized for whole sensor images (set by initialize)
+    beeCompress::FramePool *_Pool;
+
+    //! Frame loss and latency counters (set by initialize)
+    std::unique_ptr<CameraTelemetry> _Telemetry;
+
+    //! The sensor crops to the video size (set by initCamera)
+    bool                _RoiApplied { false };
+
+    //! Size of the images delivered by the camera (set by initCamera)
+    int                 _SensorWidth { 0 };
+    int                 _SensorHeight { 0 };
+    //! Bytes from one row of those images to the next
+    int                 _SensorPitch { 0 };
+
 protected:
     void run(); //this is the function that will be iterated indefinitely
 
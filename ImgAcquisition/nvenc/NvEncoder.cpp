@@ -15,6 +15,7 @@
 #include "nvUtils.h"
 #include "NvEncoder.h"
 #include "nvFileIO.h"
+#include <algorithm>
 #include <new>
 #include <vector>
 
@@ -24,13 +25,10 @@
 #include <stdint.h>
 #endif
 #include "../settings/Settings.h"
+#include "../LumaConversion.h"
 
-#if HALIDE
-#include "halideYuv420Conv.h"
-#include "Halide.h"
-#endif
+#include <iostream>
 #include <memory>
-#include <opencv2/opencv.hpp>
 
 #define BITSTREAM_BUFFER_SIZE 2 * 1024 * 1024
 
@@ -73,10 +71,11 @@ void convertYUVpitchtoYUV444(unsigned char *yuv_luma, unsigned char *yuv_cb, uns
     }
 }
 
-CNvEncoder::CNvEncoder()
+CNvEncoder::CNvEncoder(MYPROC pfnCreateInstance)
 {
-    m_pNvHWEncoder = new CNvHWEncoder;
+    m_pNvHWEncoder = new CNvHWEncoder(pfnCreateInstance);
     m_pDevice = NULL;
+    m_bCreateDevice = pfnCreateInstance == NULL;
 #if defined (NV_WINDOWS)
     m_pD3D = NULL;
 #endif
@@ -87,10 +86,17 @@ CNvEncoder::CNvEncoder()
     memset(&m_stEOSOutputBfr, 0, sizeof(m_stEOSOutputBfr));
 
     memset(&m_stEncodeBuffer, 0, sizeof(m_stEncodeBuffer));
+
+    m_bSessionOpen = false;
+    memset(m_bChromaWritten, 0, sizeof(m_bChromaWritten));
+    m_bSegmentError = false;
+    m_bForceIDR = false;
 }
 
 CNvEncoder::~CNvEncoder()
 {
+    CloseSession();
+
     if (m_pNvHWEncoder)
     {
         delete m_pNvHWEncoder;
@@ -593,137 +599,63 @@ GUID getGUID(int id) {
     return NV_ENC_PRESET_DEFAULT_GUID;
 }
 
-std::shared_ptr<beeCompress::ImageBuffer> scaleImage(
-        beeCompress::ImageBuffer *img, EncodeConfig encodeConfig,
-        EncoderQualityConfig encPrevCfg) {
-    //beeCompress::ImageBuffer *newImage = new beeCompress::ImageBuffer(encodeConfig.width/2,encodeConfig.height/2,img->camid,img->timestamp);
-    std::shared_ptr<beeCompress::ImageBuffer> newImage = std::shared_ptr<
-            beeCompress::ImageBuffer>(
-            new beeCompress::ImageBuffer(encPrevCfg.width, encPrevCfg.height,
-                    img->camid, img->timestamp));
-
-    /*std::shared_ptr<beeCompress::ImageBuffer> newImage = std::shared_ptr<beeCompress::ImageBuffer>(new beeCompress::ImageBuffer(encodeConfig.width/2,encodeConfig.height/2,img->camid,img->timestamp));
-     //TODO: Put this in a function and do smart scaling
-     */
-    if (encPrevCfg.width == encPrevCfg.width / 2
-            && encPrevCfg.height == encPrevCfg.height / 2) {
-        unsigned int x = 0, y = 0;
-        for (y = 0; y < encodeConfig.height; y += 2) {
-            for (x = 0; x < encodeConfig.width; x += 2) {
-                newImage->data[y / 2 * encodeConfig.width / 2 + x / 2] =
-                        img->data[y * encodeConfig.width + x];
-            }
-        }
-    } else if (encPrevCfg.width == encPrevCfg.width / 4
-            && encPrevCfg.height == encPrevCfg.height / 4) {
-        unsigned int x = 0, y = 0;
-        for (y = 0; y < encodeConfig.height; y += 4) {
-            for (x = 0; x < encodeConfig.width; x += 4) {
-                newImage->data[y / 4 * encodeConfig.width / 4 + x / 4] =
-                        img->data[y * encodeConfig.width + x];
-            }
-        }
-    } else {
-
-        cv::Mat imageWithData = cv::Mat(
-                encodeConfig.width * encodeConfig.height, 1, 0 /*CV_8U*/,
-                img->data).clone();
-        cv::Mat reshapedImage = imageWithData.reshape(1, encodeConfig.height);
-        cv::Size size(encPrevCfg.width, encPrevCfg.height); //the dst image size,e.g.100x100
-        cv::Mat dst; //dst image
-        cv::resize(reshapedImage, dst, size); //resize image
-
-        int x = 0, y = 0;
-        for (y = 0; y < encPrevCfg.height; y += 1) {
-            for (x = 0; x < encPrevCfg.width; x += 1) {
-                newImage->data[y * encPrevCfg.width + x] = dst.at<uint8_t>(y,
-                        x);
-            }
-        }
-    }
-
-    return newImage;
-}
-
 int rawTo420NoHalide(uint8_t *outputImage, uint8_t* inputImage, int rows,
-        int cols) {
+        int cols, int inputStride) {
     /*  See: http://stackoverflow.com/questions/8349352/how-to-encode-grayscale-video-streams-with-ffmpeg */
 
-    int bytesRead = 0;
-    unsigned char *prtM = inputImage;
-    unsigned int stride = 1;
-
-    //Being lazy pays: conversion in 58.22ms (don't set all channels - Cb and Cr are a waste of time)
-    unsigned int x = 0, y = 0;
-    for (y = 0; y < rows; y++) {
-        for (x = 0; x < cols; x++) {
-            outputImage[y * cols + x] = (uint8_t) (0.895 * (*prtM) + 16);
-            prtM++;
-            bytesRead++;
-        }
-    }
+    //Only luma is set, Cb and Cr are a waste of time
+    beeCompress::convertLuma(outputImage, cols, inputImage, inputStride, cols, rows);
 
-    return bytesRead;
+    return rows * cols;
 }
 
-int rawTo420(uint8_t *outputImage, uint8_t* inputImage, int rows, int cols) {
-    /*  See: http://stackoverflow.com/questions/8349352/how-to-encode-grayscale-video-streams-with-ffmpeg */
+bool CNvEncoder::SessionMatches(const EncoderQualityConfig &encCfg) const {
+    const EncoderQualityConfig &cur = m_stSessionCfg;
+    return m_bSessionOpen && cur.width == encCfg.width && cur.height == encCfg.height
+           && cur.rcmode == encCfg.rcmode && cur.qp == encCfg.qp && cur.bitrate == encCfg.bitrate
+           && cur.preset == encCfg.preset && cur.fps == encCfg.fps && cur.idrinterval == encCfg.idrinterval;
+}
 
-    int bytesRead;
-#if HALIDE
-    unsigned long long time, time2;
-    unsigned char *prtM = inputImage;
-    unsigned int stride=1;
-
-    //Precompiled code gets run in 17.88ms. BAM!
-    buffer_t input_buf = {0}, output_buf = {0};
-
-    // The host pointers point to the start of the image data:
-    input_buf.host = prtM;
-    output_buf.host = outputImage;
-    //See the halide tutorial how to set these.
-    input_buf.stride[0] = output_buf.stride[0] = 1;
-    input_buf.stride[1] = output_buf.stride[1] = stride;
-    input_buf.extent[0] = output_buf.extent[0] = cols;
-    input_buf.extent[1] = output_buf.extent[1] = rows;
-    input_buf.elem_size = output_buf.elem_size = 1;
-
-    //do it
-    int error = halideYuv420Conv(&input_buf, &output_buf);
-    bytesRead=rows*cols*3;//fool the system. We never read/written or set Cb and Cr
-#else
-    return rawTo420NoHalide(outputImage, inputImage, rows, cols);
-#endif
+void CNvEncoder::CloseSession() {
+    if (!m_bSessionOpen) {
+        return;
+    }
+
+    Deinitialize(m_stEncoderInput.deviceType);
 
-    return bytesRead;
+    m_bSessionOpen = false;
 }
 
-int CNvEncoder::EncodeMain(double *elapsedTimeP, double *avgtimeP,
-        beeCompress::MutexBuffer *buffer, beeCompress::MutexBuffer *bufferPrev,
-        beeCompress::writeHandler *wh, EncoderQualityConfig encCfg,
-        EncoderQualityConfig encPrevCfg) {
-    HANDLE hInput;
-    uint8_t *yuv[3];
-    unsigned long long lStart, lEnd, lFreq;
-    int numFramesEncoded = 0;
+bool CNvEncoder::openSegment(const EncoderQualityConfig &encCfg,
+        beeCompress::writeHandler *wh) {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
-    bool bError = false;
-    EncodeConfig encodeConfig;
-    unsigned int fstart = 0;
-    unsigned int fsize = 0;
+    EncodeConfig &encodeConfig = m_stEncoderInput;
+
+    if (SessionMatches(encCfg)) {
+        //Keep device, encoder and IO buffers. Only the file changes.
+        encodeConfig.fOutput = wh->_video;
+        m_pNvHWEncoder->m_fOutput = wh->_video;
+        m_pNvHWEncoder->m_pWriteHandler = wh;
+        m_bSegmentError = false;
+        m_bForceIDR = true;
+        return true;
+    }
+
+    CloseSession();
 
     memset(&encodeConfig, 0, sizeof(EncodeConfig));
 
     //This is important. If these are higher than
     //4096 it may crash the entire system.
     if (encCfg.width > 4096 || encCfg.height > 4096) {
-        return -1;
+        return false;
     }
 
     encodeConfig.endFrameIdx = INT_MAX;
     encodeConfig.bitrate = encCfg.bitrate;
     encodeConfig.rcMode = getRcmode(encCfg.rcmode);
-    encodeConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
+    //Also the IDR period (see NvHWEncoder). Segments start with an IDR frame either way.
+    encodeConfig.gopLength = encCfg.idrinterval > 0 ? encCfg.idrinterval : NVENC_INFINITE_GOPLENGTH;
     encodeConfig.deviceType = NV_ENC_CUDA;
 #if defined(NV_WINDOWS)
     encodeConfig.deviceType = NV_ENC_HEVC;
@@ -740,8 +672,7 @@ int CNvEncoder::EncodeMain(double *elapsedTimeP, double *avgtimeP,
 
     encodeConfig.fOutput = wh->_video;
 
-    hInput = 0; /*nvOpenFile(encodeConfig.inputFileName);*/
-
+    if (m_bCreateDevice)
     switch (encodeConfig.deviceType) {
 #if defined(NV_WINDOWS)
     case NV_ENC_DX9:
@@ -768,130 +699,84 @@ int CNvEncoder::EncodeMain(double *elapsedTimeP, double *avgtimeP,
         nvStatus = m_pNvHWEncoder->Initialize(m_pDevice,
                 NV_ENC_DEVICE_TYPE_CUDA);
 
-    if (nvStatus != NV_ENC_SUCCESS)
-        return -1;
-
-    nvStatus = m_pNvHWEncoder->CreateEncoder(&encodeConfig);
-    if (nvStatus != NV_ENC_SUCCESS)
-        return 1;
+    if (nvStatus == NV_ENC_SUCCESS)
+        nvStatus = m_pNvHWEncoder->CreateEncoder(&encodeConfig);
 
     m_uEncodeBufferCount = encodeConfig.numB + 4; // min buffers is numb + 1 + 3 pipelining
 
     m_uPicStruct = encodeConfig.pictureStruct;
 
-    nvStatus = AllocateIOBuffers(encodeConfig.width, encodeConfig.height,
-            encodeConfig.isYuv444);
-    if (nvStatus != NV_ENC_SUCCESS)
-        return 1;
-
-    if (encodeConfig.isYuv444) {
-        yuv[0] = new uint8_t[encodeConfig.width * encodeConfig.height];
-        yuv[1] = new uint8_t[encodeConfig.width * encodeConfig.height];
-        yuv[2] = new uint8_t[encodeConfig.width * encodeConfig.height];
-    } else {
-        yuv[0] = new uint8_t[encodeConfig.width * encodeConfig.height];
-        yuv[1] = new uint8_t[encodeConfig.width * encodeConfig.height / 4];
-        yuv[2] = new uint8_t[encodeConfig.width * encodeConfig.height / 4];
-        //memset(yuv[0],128, encodeConfig.width*encodeConfig.height);
-        memset(yuv[1], 128, encodeConfig.width * encodeConfig.height / 4);
-        memset(yuv[2], 128, encodeConfig.width * encodeConfig.height / 4);
-    }
-    //To never ever write in used memory. Maybe unnecessary
-    std::vector<uint8_t> temporaryBuffer;
-    temporaryBuffer.resize(static_cast<size_t>(encodeConfig.width * encodeConfig.height));
-
-    NvQueryPerformanceCounter(&lStart);
-
-    for (int frm = 0; frm < encCfg.totalFrames; frm++) {
-        uint32_t numBytesRead = 0;
-
-        //Wait until there is a new image available (done by pop)
-        std::shared_ptr<beeCompress::ImageBuffer> imgptr = buffer->pop();
-        beeCompress::ImageBuffer *img = imgptr.get();
-        numBytesRead = static_cast<decltype(numBytesRead)>(img->width * img->height);
-
-        //Debug output TODO: remove?
-        if (frm % 100 == 0)
-            printf("Loaded frame %d \n", frm);
-
-        //This should not happen
-        if (numBytesRead == 0)
-            break;
-
-        EncodeFrameConfig stEncodeFrame;
-        memset(&stEncodeFrame, 0, sizeof(stEncodeFrame));
-
-        //Fill data structure for the encoder
-        rawTo420NoHalide(temporaryBuffer.data(), img->data, encodeConfig.height, encodeConfig.width);
-        stEncodeFrame.yuv[0] = temporaryBuffer.data();
-        //memcpy(stEncodeFrame.yuv[0], img->data, encodeConfig.height*encodeConfig.width);
-        //stEncodeFrame.yuv[0] = yuv[0];
-        stEncodeFrame.yuv[1] = yuv[1];
-        stEncodeFrame.yuv[2] = yuv[2];
-
-        stEncodeFrame.stride[0] = encodeConfig.width;
-        stEncodeFrame.stride[1] =
-                (encodeConfig.isYuv444) ?
-                        encodeConfig.width : encodeConfig.width / 2;
-        stEncodeFrame.stride[2] =
-                (encodeConfig.isYuv444) ?
-                        encodeConfig.width : encodeConfig.width / 2;
-        stEncodeFrame.width = encodeConfig.width;
-        stEncodeFrame.height = encodeConfig.height;
-
-        //Invoke the encoder
-        EncodeFrame(&stEncodeFrame, false, encodeConfig.width,
-                encodeConfig.height);
-        numFramesEncoded++;
-
-        //Log the progress to the writeHandler
-        wh->log(img->timestamp);
-
-        if (bufferPrev != NULL) {
-
-            std::shared_ptr<beeCompress::ImageBuffer> newImage = scaleImage(img,
-                    encodeConfig, encPrevCfg);
-            bufferPrev->push(newImage);
-        }
+    if (nvStatus == NV_ENC_SUCCESS)
+        nvStatus = AllocateIOBuffers(encodeConfig.width, encodeConfig.height,
+                encodeConfig.isYuv444);
 
-    }
-
-    nvStatus = EncodeFrame(NULL, true, encodeConfig.width, encodeConfig.height);
     if (nvStatus != NV_ENC_SUCCESS) {
+        //Release the device, the next segment tries again
         std::cout << "ENCODER ERROR: " << nvStatus << std::endl;
-        bError = true;
-        goto exit;
+        Deinitialize(encodeConfig.deviceType);
+        return false;
     }
 
-    if (numFramesEncoded > 0) {
-        NvQueryPerformanceCounter(&lEnd);
-        NvQueryPerformanceFrequency(&lFreq);
-        *elapsedTimeP = (double) (lEnd - lStart);
-        printf("Encoded %d frames in %6.2fms\n", numFramesEncoded,
-                ((*elapsedTimeP) * 1000.0) / lFreq);
-        printf("Average Encode Time : %6.2fms\n",
-                (((*elapsedTimeP) * 1000.0) / numFramesEncoded) / lFreq);
-        *avgtimeP = (((*elapsedTimeP) * 1000.0) / numFramesEncoded) / lFreq;
-    }
+    //The new surfaces get their constant chroma with their first frame
+    memset(m_bChromaWritten, 0, sizeof(m_bChromaWritten));
 
-    exit: fsize = ftell(encodeConfig.fOutput) - fstart;
+    m_stSessionCfg = encCfg;
+    m_bSessionOpen = true;
 
-    if (hInput) {
-        nvCloseFile(hInput);
-    }
+    m_pNvHWEncoder->m_pWriteHandler = wh;
+    m_bSegmentError = false;
+    m_bForceIDR = true;
+    return true;
+}
 
-    Deinitialize(encodeConfig.deviceType);
+bool CNvEncoder::submitFrame(const beeCompress::ImageBuffer &img) {
+    //The first frame of a segment starts a new decodable stream
+    NvEncPictureCommand stPicCommand;
+    memset(&stPicCommand, 0, sizeof(stPicCommand));
+    stPicCommand.bForceIDR = m_bForceIDR;
 
-    for (int i = 0; i < 3; i++) {
-        if (yuv[i]) {
-            delete[] yuv[i];
+    //Invoke the encoder
+    NVENCSTATUS nvStatus = EncodeLuma(img, &stPicCommand);
+    m_bForceIDR = false;
+    if (nvStatus != NV_ENC_SUCCESS) {
+        std::cout << "ENCODER ERROR: " << nvStatus << std::endl;
+        m_bSegmentError = true;
+        return false;
+    }
+    return true;
+}
+
+bool CNvEncoder::flush() {
+    //Without B frames every frame is complete on its own, so the pending
+    //frames are written without ending the stream (EOS) of the session.
+    EncodeBuffer *pEncodeBuffer = m_EncodeBufferQueue.GetPending();
+    while (pEncodeBuffer) {
+        NVENCSTATUS nvStatus = m_pNvHWEncoder->ProcessOutput(pEncodeBuffer);
+        if (nvStatus != NV_ENC_SUCCESS) {
+            std::cout << "ENCODER ERROR: " << nvStatus << std::endl;
+            m_bSegmentError = true;
         }
+        pEncodeBuffer = m_EncodeBufferQueue.GetPending();
+    }
+    return !m_bSegmentError;
+}
+
+long CNvEncoder::closeSegment() {
+    //Counted as passed on, the writer may not be done with it yet
+    beeCompress::writeHandler *wh = m_pNvHWEncoder->m_pWriteHandler;
+    long fsize = wh ? static_cast<long>(wh->_videoBytes) : 0;
+    m_pNvHWEncoder->m_pWriteHandler = NULL;
+
+    //Start from scratch after errors
+    if (m_bSegmentError) {
+        CloseSession();
     }
 
-    return bError ? -1 : fsize;
+    return m_bSegmentError ? -1 : fsize;
 }
 
-NVENCSTATUS CNvEncoder::EncodeFrame(EncodeFrameConfig *pEncodeFrame, bool bFlush, uint32_t width, uint32_t height)
+NVENCSTATUS CNvEncoder::EncodeFrame(EncodeFrameConfig *pEncodeFrame, bool bFlush, uint32_t width, uint32_t height,
+                                    NvEncPictureCommand *pEncPicCommand)
 {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
     uint32_t lockedPitch = 0;
@@ -936,8 +821,50 @@ NVENCSTATUS CNvEncoder::EncodeFrame(EncodeFrameConfig *pEncodeFrame, bool bFlush
     if (nvStatus != NV_ENC_SUCCESS)
         return nvStatus;
 
-    nvStatus = m_pNvHWEncoder->NvEncEncodeFrame(pEncodeBuffer, NULL, width, height, (NV_ENC_PIC_STRUCT)m_uPicStruct);
+    nvStatus = m_pNvHWEncoder->NvEncEncodeFrame(pEncodeBuffer, pEncPicCommand, width, height, (NV_ENC_PIC_STRUCT)m_uPicStruct);
     return nvStatus;
 }
 
+NVENCSTATUS CNvEncoder::EncodeLuma(const beeCompress::ImageBuffer &img, NvEncPictureCommand *pEncPicCommand)
+{
+    NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
+    uint32_t lockedPitch = 0;
+    EncodeBuffer *pEncodeBuffer = NULL;
+    uint32_t width = m_stEncoderInput.width;
+    uint32_t height = m_stEncoderInput.height;
+
+    pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
+    if(!pEncodeBuffer)
+    {
+        //A picture lost here breaks the segment as well
+        if (m_pNvHWEncoder->ProcessOutput(m_EncodeBufferQueue.GetPending()) != NV_ENC_SUCCESS)
+            m_bSegmentError = true;
+        pEncodeBuffer = m_EncodeBufferQueue.GetAvailable();
+    }
+
+    unsigned char *pInputSurface;
+
+    nvStatus = m_pNvHWEncoder->NvEncLockInputBuffer(pEncodeBuffer->stInputBfr.hInputSurface, (void**)&pInputSurface, &lockedPitch);
+    if (nvStatus != NV_ENC_SUCCESS)
+        return nvStatus;
+
+    //Range mapping and the copy into the pitched surface in one pass
+    beeCompress::convertLuma(pInputSurface, lockedPitch, img.data, img.stride, width, height);
 
+    //Grayscale images have neutral chroma. The surface keeps it between frames.
+    const size_t bufferIdx = pEncodeBuffer - m_stEncodeBuffer;
+    if (!m_bChromaWritten[bufferIdx])
+    {
+        unsigned char *pInputSurfaceCh = pInputSurface + (pEncodeBuffer->stInputBfr.dwHeight * lockedPitch);
+        size_t chromaRows = (pEncodeBuffer->stInputBfr.bufferFmt == NV_ENC_BUFFER_FORMAT_NV12_PL) ? height / 2 : 2 * pEncodeBuffer->stInputBfr.dwHeight;
+        memset(pInputSurfaceCh, 128, chromaRows * lockedPitch);
+        m_bChromaWritten[bufferIdx] = true;
+    }
+
+    nvStatus = m_pNvHWEncoder->NvEncUnlockInputBuffer(pEncodeBuffer->stInputBfr.hInputSurface);
+    if (nvStatus != NV_ENC_SUCCESS)
+        return nvStatus;
+
+    nvStatus = m_pNvHWEncoder->NvEncEncodeFrame(pEncodeBuffer, pEncPicCommand, width, height, (NV_ENC_PIC_STRUCT)m_uPicStruct);
+    return nvStatus;
+}
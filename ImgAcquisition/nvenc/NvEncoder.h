@@ -21,6 +21,7 @@
 
 #include "../Buffer/MutexBuffer.h"
 #include "../writeHandler.h"
+#include "../EncoderBackend.h"
 #include "../settings/Settings.h"
 
 #define MAX_ENCODE_QUEUE 32
@@ -54,6 +55,7 @@ public:
         m_uPendingCount = 0;
         m_uAvailableIdx = 0;
         m_uPendingndex = 0;
+        delete[] m_pBuffer;
         m_pBuffer = new T *[m_uSize];
         for (unsigned int i = 0; i < m_uSize; i++)
         {
@@ -106,22 +108,28 @@ typedef enum
     NV_ENC_DX10 = 3,
 } NvEncodeDeviceType;
 
-class CNvEncoder
+class CNvEncoder : public beeCompress::EncoderBackend
 {
 public:
-    CNvEncoder();
+    /**
+     * @param pfnCreateInstance NVENCODE API entry point to use instead of the
+     *                          driver's, e.g. a stub for checks. No CUDA device
+     *                          is created then.
+     */
+    explicit CNvEncoder(MYPROC pfnCreateInstance = NULL);
     virtual ~CNvEncoder();
 
     /**
-     * @brief Creates a video in HEVC format for passed configuration
+     * @brief Starts a segment in HEVC format.
      *
-     * This function wraps up the entire encoding process on GPU.
-     * Encoding details are passed as parameters.
+     * The encoding session stays open across segments: if the
+     * configuration equals the previous segment's, only the output file
+     * changes and the first frame is an IDR frame with VPS/SPS/PPS.
+     * Otherwise the session is set up anew.
      * The hardware slot is selected automatically. You may be able
      * to encode two videos simultaneously, but no more.
-     * Warning: The encoder will wait (sleep!) on buffer underrun.
      *
-     * @param rcmode		The rc (rate control) mode to use. <br>
+     * encCfg.rcmode	The rc (rate control) mode to use. <br>
      * 						0 = Constant quantizer parameter (default)<br>
      * 						1 = VBR mode<br>
      * 						2 = CBR mode<br>
@@ -129,7 +137,7 @@ public:
      * 						4 = 2-pass quality<br>
      * 						5 = 2-pass frame size cap<br>
      * 						6 = 2-pass VBR
-     * @param preset		NvEncoder preset. <br>
+     * encCfg.preset	NvEncoder preset. <br>
      * 						0 = Default<br>
      * 						1 = High performance<br>
      * 						2 = High quality<br>
@@ -141,28 +149,35 @@ public:
      * 						8 = Lossless high performance.<br>
      * 						Please see NvEncoder documentation for what
      * 						hardware is supporting lossless.
-     * @param qp			The quantizer parameter
-     * @param bitrate		Desired bitrate. Irrelevant for constant qp.
-     * @param elapsedTimeP	Output parameter. Returns used encoding time.
-     * @param avgtimeP		Output parameter. Returns used time per frame.
-     * @param buffer		Pointer to the ringbuffer which is used.
-     * @param f				Filehandle to write the raw encoded frames to.
-     * @param totalFrames	Total number of frames to encode.
-     * @param fps			Framerate of target video.
-     * @param width			Width of the input and output. No scaling is done.<br>
+     * encCfg.qp		The quantizer parameter
+     * encCfg.bitrate	Desired bitrate. Irrelevant for constant qp.
+     * encCfg.width		Width of the input and output. No scaling is done.<br>
      * 						Please note that NvEnc only supports up to 4096x4096.
-     * @param height		Height of the input and output. No scaling is done.<br>
+     * encCfg.height	Height of the input and output. No scaling is done.<br>
      * 						Please note that NvEnc only supports up to 4096x4096.
-     * @return 				The encoded file size or -1 in case of an error.
+     *
+     * @param encCfg		Configuration of the stream, see above
+     * @param wh			Handler of the file to write the raw encoded frames to.
+     * @return 				false in case of an error.
      */
-    int                                                  EncodeMain(double *elapsedTimeP, double *avgtimeP,beeCompress::MutexBuffer *buffer, beeCompress::MutexBuffer *bufferPrev,
-                                                                     beeCompress::writeHandler *wh, EncoderQualityConfig encCfg, EncoderQualityConfig encPrevCfg);
+    bool                                                 openSegment(const EncoderQualityConfig &encCfg, beeCompress::writeHandler *wh) override;
+
+    //! Writes the frame's luma straight into an input surface and passes it to the GPU.
+    bool                                                 submitFrame(const beeCompress::ImageBuffer &img) override;
+
+    //! Waits for the GPU to finish all frames and writes them.
+    bool                                                 flush() override;
+
+    //! Returns the size of the segment's file or -1. The session is only released on errors.
+    long                                                 closeSegment() override;
 
 protected:
     CNvHWEncoder                                        *m_pNvHWEncoder;
     uint32_t                                             m_uEncodeBufferCount;
     uint32_t                                             m_uPicStruct;
     void*                                                m_pDevice;
+    //! false if the encode API is not the driver's
+    bool                                                 m_bCreateDevice;
 #if defined(NV_WINDOWS)
     IDirect3D9                                          *m_pD3D;
 #endif
@@ -173,9 +188,21 @@ protected:
     CNvQueue<EncodeBuffer>                               m_EncodeBufferQueue;
     EncodeOutputBuffer                                   m_stEOSOutputBfr; 
 
+    //The session (device, encoder, IO buffers) outlives its segments
+    bool                                                 m_bSessionOpen;
+    EncoderQualityConfig                                 m_stSessionCfg;
+    //! Whether a surface of m_stEncodeBuffer holds its constant chroma
+    bool                                                 m_bChromaWritten[MAX_ENCODE_QUEUE];
+
+    //State of the open segment
+    bool                                                 m_bSegmentError;
+    bool                                                 m_bForceIDR;
+
 protected:
     NVENCSTATUS                                          Deinitialize(uint32_t devicetype);
-    NVENCSTATUS                                          EncodeFrame(EncodeFrameConfig *pEncodeFrame, bool bFlush=false, uint32_t width=0, uint32_t height=0);
+    NVENCSTATUS                                          EncodeFrame(EncodeFrameConfig *pEncodeFrame, bool bFlush=false, uint32_t width=0, uint32_t height=0,
+                                                                     NvEncPictureCommand *pEncPicCommand=NULL);
+    NVENCSTATUS                                          EncodeLuma(const beeCompress::ImageBuffer &img, NvEncPictureCommand *pEncPicCommand);
     NVENCSTATUS                                          InitD3D9(uint32_t deviceID = 0);
     NVENCSTATUS                                          InitD3D11(uint32_t deviceID = 0);
     NVENCSTATUS                                          InitD3D10(uint32_t deviceID = 0);
@@ -184,8 +211,7 @@ protected:
     NVENCSTATUS                                          ReleaseIOBuffers();
     unsigned char*                                       LockInputBuffer(void * hInputSurface, uint32_t *pLockedPitch);
     NVENCSTATUS                                          FlushEncoder();
+    bool                                                 SessionMatches(const EncoderQualityConfig &encCfg) const;
+    void                                                 CloseSession();
     NVENCSTATUS                                          RunMotionEstimationOnly(MEOnlyConfig *pMEOnly, bool bFlush);
 };
-
-// NVEncodeAPI entry point
-typedef NVENCSTATUS (NVENCAPI *MYPROC)(NV_ENCODE_API_FUNCTION_LIST*); 
@@ -10,6 +10,7 @@
  */
 
 #include "NvHWEncoder.h"
+#include "../writeHandler.h"
 
 NVENCSTATUS CNvHWEncoder::NvEncOpenEncodeSession(void* device, uint32_t deviceType)
 {
@@ -465,12 +466,14 @@ NVENCSTATUS CNvHWEncoder::NvEncDestroyEncoder()
 {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
 
-    if (m_bEncoderInitialized)
+    //Also ends sessions whose encoder failed to initialize
+    if (m_hEncoder)
     {
         nvStatus = m_pEncodeAPI->nvEncDestroyEncoder(m_hEncoder);
 
-        m_bEncoderInitialized = false;
+        m_hEncoder = NULL;
     }
+    m_bEncoderInitialized = false;
 
     return nvStatus;
 }
@@ -592,13 +595,15 @@ NVENCSTATUS CNvHWEncoder::NvEncReconfigureEncoder(const NvEncPictureCommand *pEn
     return nvStatus;
 }
 
-CNvHWEncoder::CNvHWEncoder()
+CNvHWEncoder::CNvHWEncoder(MYPROC pfnCreateInstance)
 {
     m_hEncoder = NULL;
     m_bEncoderInitialized = false;
     m_pEncodeAPI = NULL;
     m_hinstLib = NULL;
+    m_pfnCreateInstance = pfnCreateInstance;
     m_fOutput = NULL;
+    m_pWriteHandler = NULL;
     m_EncodeIdx = 0;
     m_uCurWidth = 0;
     m_uCurHeight = 0;
@@ -1013,8 +1018,18 @@ NVENCSTATUS CNvHWEncoder::ProcessOutput(const EncodeBuffer *pEncodeBuffer)
     nvStatus = m_pEncodeAPI->nvEncLockBitstream(m_hEncoder, &lockBitstreamData);
     if (nvStatus == NV_ENC_SUCCESS)
     {
-        fwrite(lockBitstreamData.bitstreamBufferPtr, 1, lockBitstreamData.bitstreamSizeInBytes, m_fOutput);
+        bool written = true;
+        if (m_pWriteHandler)
+            written = m_pWriteHandler->writeVideo(static_cast<const uint8_t*>(lockBitstreamData.bitstreamBufferPtr),
+                                                  lockBitstreamData.bitstreamSizeInBytes);
+        else
+            fwrite(lockBitstreamData.bitstreamBufferPtr, 1, lockBitstreamData.bitstreamSizeInBytes, m_fOutput);
         nvStatus = m_pEncodeAPI->nvEncUnlockBitstream(m_hEncoder, pEncodeBuffer->stOutputBfr.hBitstreamBuffer);
+        if (!written)
+        {
+            PRINTERR("writing the bitstream failed \n");
+            nvStatus = NV_ENC_ERR_GENERIC;
+        }
     }
     else
     {
@@ -1027,25 +1042,32 @@ NVENCSTATUS CNvHWEncoder::ProcessOutput(const EncodeBuffer *pEncodeBuffer)
 NVENCSTATUS CNvHWEncoder::Initialize(void* device, NV_ENC_DEVICE_TYPE deviceType)
 {
     NVENCSTATUS nvStatus = NV_ENC_SUCCESS;
-    MYPROC nvEncodeAPICreateInstance; // function pointer to create instance in nvEncodeAPI
+    MYPROC nvEncodeAPICreateInstance = m_pfnCreateInstance; // function pointer to create instance in nvEncodeAPI
 
+    //Every session after the first reuses the function list
+    if (m_pEncodeAPI)
+        return NvEncOpenEncodeSessionEx(device, deviceType);
+
+    if (nvEncodeAPICreateInstance == NULL)
+    {
 #if defined(NV_WINDOWS)
 #if defined (_WIN64)
-    m_hinstLib = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
+        m_hinstLib = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
 #else
-    m_hinstLib = LoadLibrary(TEXT("nvEncodeAPI.dll"));
+        m_hinstLib = LoadLibrary(TEXT("nvEncodeAPI.dll"));
 #endif
 #else
-    m_hinstLib = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
+        m_hinstLib = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
 #endif
-    if (m_hinstLib == NULL)
-        return NV_ENC_ERR_OUT_OF_MEMORY;
+        if (m_hinstLib == NULL)
+            return NV_ENC_ERR_OUT_OF_MEMORY;
 
 #if defined(NV_WINDOWS)
-    nvEncodeAPICreateInstance = (MYPROC)GetProcAddress(m_hinstLib, "NvEncodeAPICreateInstance");
+        nvEncodeAPICreateInstance = (MYPROC)GetProcAddress(m_hinstLib, "NvEncodeAPICreateInstance");
 #else
-    nvEncodeAPICreateInstance = (MYPROC)dlsym(m_hinstLib, "NvEncodeAPICreateInstance");
+        nvEncodeAPICreateInstance = (MYPROC)dlsym(m_hinstLib, "NvEncodeAPICreateInstance");
 #endif
+    }
 
     if (nvEncodeAPICreateInstance == NULL)
         return NV_ENC_ERR_OUT_OF_MEMORY;
@@ -1058,7 +1080,11 @@ NVENCSTATUS CNvHWEncoder::Initialize(void* device, NV_ENC_DEVICE_TYPE deviceType
     m_pEncodeAPI->version = NV_ENCODE_API_FUNCTION_LIST_VER;
     nvStatus = nvEncodeAPICreateInstance(m_pEncodeAPI);
     if (nvStatus != NV_ENC_SUCCESS)
+    {
+        delete m_pEncodeAPI;
+        m_pEncodeAPI = NULL;
         return nvStatus;
+    }
 
     nvStatus = NvEncOpenEncodeSessionEx(device, deviceType);
     if (nvStatus != NV_ENC_SUCCESS)
@@ -1094,7 +1120,8 @@ NVENCSTATUS CNvHWEncoder::NvEncEncodeFrame(EncodeBuffer *pEncodeBuffer, NvEncPic
     {
         if (encPicCommand->bForceIDR)
         {
-            encPicParams.encodePicFlags |= NV_ENC_PIC_FLAG_FORCEIDR;
+            //Repeat the parameter sets, so the stream can be decoded from this IDR on
+            encPicParams.encodePicFlags |= NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS;
         }
 
         if (encPicCommand->bForceIntraRefresh)
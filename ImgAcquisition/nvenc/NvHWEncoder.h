@@ -143,11 +143,20 @@ struct MEOnlyConfig
     unsigned int referenceFrameIndex;
 };
 
+namespace beeCompress {
+class writeHandler;
+}
+
+// NVEncodeAPI entry point
+typedef NVENCSTATUS (NVENCAPI *MYPROC)(NV_ENCODE_API_FUNCTION_LIST*); 
+
 class CNvHWEncoder
 {
 public:
     uint32_t                                             m_EncodeIdx;
     FILE                                                *m_fOutput;
+    //! Receives the bitstream if set, instead of m_fOutput
+    beeCompress::writeHandler                           *m_pWriteHandler;
     uint32_t                                             m_uMaxWidth;
     uint32_t                                             m_uMaxHeight;
     uint32_t                                             m_uCurWidth;
@@ -159,6 +168,8 @@ protected:
 
     NV_ENCODE_API_FUNCTION_LIST*                         m_pEncodeAPI;
     HINSTANCE                                            m_hinstLib;
+    //! Entry point to use instead of the one of the driver library
+    MYPROC                                               m_pfnCreateInstance;
     void                                                *m_hEncoder;
     NV_ENC_INITIALIZE_PARAMS                             m_stCreateEncodeParams;
     NV_ENC_CONFIG                                        m_stEncodeConfig;
@@ -200,7 +211,7 @@ public:
     NVENCSTATUS NvEncReconfigureEncoder(const NvEncPictureCommand *pEncPicCommand);
     NVENCSTATUS NvEncFlushEncoderQueue(void *hEOSEvent);
 
-    CNvHWEncoder();
+    explicit CNvHWEncoder(MYPROC pfnCreateInstance = NULL);
     virtual ~CNvHWEncoder();
     NVENCSTATUS                                          Initialize(void* device, NV_ENC_DEVICE_TYPE deviceType);
     NVENCSTATUS                                          Deinitialize();
@@ -216,5 +227,3 @@ public:
     NVENCSTATUS                                          ValidatePresetGUID(GUID presetCodecGuid, GUID inputCodecGuid);
     static NVENCSTATUS                                   ParseArguments(EncodeConfig *encodeConfig, int argc, char *argv[]);
 };
-
-typedef NVENCSTATUS (NVENCAPI *MYPROC)(NV_ENCODE_API_FUNCTION_LIST*); 
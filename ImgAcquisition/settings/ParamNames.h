@@ -22,6 +22,15 @@ namespace IMACQUISITION {
 	static const std::string VIDEO_HEIGHT 			= "VIDEO_HEIGHT";
 	static const std::string FRAMESPERVIDEO			= "FRAMESPERVIDEO";
 	static const std::string FPS 					= "FPS";
+	static const std::string POOLSIZE				= "POOLSIZE";
+	static const std::string QUEUETYPE				= "QUEUETYPE";
+	static const std::string QUEUECAPACITY			= "QUEUECAPACITY";
+	static const std::string OVERFLOWPOLICY			= "OVERFLOWPOLICY";
+	static const std::string OVERFLOWBLOCKMS		= "OVERFLOWBLOCKMS";
+	static const std::string SPILLDIR				= "SPILLDIR";
+	static const std::string SPILLFRAMES			= "SPILLFRAMES";
+	static const std::string SPILLHIGHWATERMARK		= "SPILLHIGHWATERMARK";
+	static const std::string IDRINTERVAL			= "IDRINTERVAL";
 
 	static const std::string OFFSETX				= "OFFSETX";
 	static const std::string OFFSETY				= "OFFSETY";
@@ -41,6 +50,21 @@ namespace IMACQUISITION {
 	static const std::string HWTRIGGER				= "HWTRIGGER";
 	static const std::string HWTRIGGERPARAM			= "HWTRIGGERPARAM";
 	static const std::string HWTRIGGERSOURCE		= "HWTRIGGERSOURCE";
+
+	static const std::string CAMTYPE				= "CAMTYPE";
+	static const std::string SYNTHETIC_SOURCE		= "SYNTHETIC_SOURCE";
+	static const std::string SYNTHETIC_PATH			= "SYNTHETIC_PATH";
+	static const std::string SYNTHETIC_NOISE		= "SYNTHETIC_NOISE";
+	static const std::string SYNTHETIC_DROPRATE		= "SYNTHETIC_DROPRATE";
+	static const std::string SYNTHETIC_DRIFTPPM		= "SYNTHETIC_DRIFTPPM";
+
+	static const std::string CPUS					= "CPUS";
+	}
+
+	namespace THREADCONF{
+	static const std::string CPUS 					= "CPUS";
+	static const std::string POLICY 				= "POLICY";
+	static const std::string PRIORITY 				= "PRIORITY";
 	}
 
 static const std::string BUFFER						= "IMACQUISITION.BUFFER";
@@ -54,8 +78,30 @@ static const std::string EXCHANGEDIR 				= "IMACQUISITION.EXCHANGEDIR";
 static const std::string EXCHANGEDIRPREVIEW         = "IMACQUISITION.EXCHANGEDIRPREVIEW";
 static const std::string SLACKPOST                  = "IMACQUISITION.SLACKPOST";
 static const std::string CAMCOUNT                   = "IMACQUISITION.CAMCOUNT";
+static const std::string ENCODERCOUNT               = "IMACQUISITION.ENCODERCOUNT";
 static const std::string POSTLEVEL1                 = "IMACQUISITION.POSTLEVEL1";
 static const std::string POSTLEVEL2                 = "IMACQUISITION.POSTLEVEL2";
+static const std::string FRAMEPOOL_PREFAULT         = "IMACQUISITION.FRAMEPOOL_PREFAULT";
+static const std::string FRAMEPOOL_MLOCK            = "IMACQUISITION.FRAMEPOOL_MLOCK";
+static const std::string BUFFER_BUDGET_MB           = "IMACQUISITION.BUFFER_BUDGET_MB";
+static const std::string ENCODER_BACKEND            = "IMACQUISITION.ENCODER_BACKEND";
+static const std::string LIBAV_CODEC                = "IMACQUISITION.LIBAV.CODEC";
+static const std::string LIBAV_PRESET               = "IMACQUISITION.LIBAV.PRESET";
+static const std::string LIBAV_THREADS              = "IMACQUISITION.LIBAV.THREADS";
+static const std::string WRITER_BATCH_KB            = "IMACQUISITION.WRITER.BATCH_KB";
+static const std::string WRITER_QUEUE_DEPTH         = "IMACQUISITION.WRITER.QUEUE_DEPTH";
+static const std::string PREVIEW_THREADS            = "IMACQUISITION.PREVIEW.THREADS";
+static const std::string PREVIEW_QUEUE              = "IMACQUISITION.PREVIEW.QUEUE";
+static const std::string PREVIEW_MODE               = "IMACQUISITION.PREVIEW.MODE";
+static const std::string SIDECAR_FLUSH_MS           = "IMACQUISITION.SIDECAR.FLUSH_MS";
+static const std::string SIDECAR_FLUSH_KB           = "IMACQUISITION.SIDECAR.FLUSH_KB";
+static const std::string SIDECAR_BINARY             = "IMACQUISITION.SIDECAR.BINARY";
+static const std::string SIDECAR_INDEX              = "IMACQUISITION.SIDECAR.INDEX";
+
+static const std::string THREADS_CAPTURE            = "IMACQUISITION.THREADS.CAPTURE";
+static const std::string THREADS_ENCODER            = "IMACQUISITION.THREADS.ENCODER";
+static const std::string THREADS_SHAREDMEMORY       = "IMACQUISITION.THREADS.SHAREDMEMORY";
+static const std::string THREADS_ANALYSIS           = "IMACQUISITION.THREADS.ANALYSIS";
 }
 
 
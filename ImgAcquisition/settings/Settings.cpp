@@ -11,6 +11,7 @@ const boost::property_tree::ptree SettingsIAC::getDefaultParams() {
 	boost::property_tree::ptree pt;
 	std::string app = SettingsIAC::setConf("");
 
+	//The default configuration describes four cameras; add BUFFER entries for more
 	for (int i=0; i<4; i++){
 
 		boost::property_tree::ptree hd;
@@ -27,8 +28,17 @@ const boost::property_tree::ptree SettingsIAC::getDefaultParams() {
 		hd.put(IMACQUISITION::BUFFERCONF::FRAMESPERVIDEO, 	500		);
 		hd.put(IMACQUISITION::BUFFERCONF::FPS, 				3		);
 		hd.put(IMACQUISITION::BUFFERCONF::PRESET, 			2		);
-		hd.put(IMACQUISITION::BUFFERCONF::OFFSETX, 			0		);
-		hd.put(IMACQUISITION::BUFFERCONF::OFFSETY, 			0		);
+		hd.put(IMACQUISITION::BUFFERCONF::POOLSIZE, 		16		);
+		hd.put(IMACQUISITION::BUFFERCONF::QUEUETYPE, 		"list"	);
+		hd.put(IMACQUISITION::BUFFERCONF::QUEUECAPACITY, 	400		);
+		hd.put(IMACQUISITION::BUFFERCONF::OVERFLOWPOLICY, 	"droppreviewfirst");
+		hd.put(IMACQUISITION::BUFFERCONF::OVERFLOWBLOCKMS, 	100		);
+		hd.put(IMACQUISITION::BUFFERCONF::SPILLDIR, 		""		);
+		hd.put(IMACQUISITION::BUFFERCONF::SPILLFRAMES, 		1000	);
+		hd.put(IMACQUISITION::BUFFERCONF::SPILLHIGHWATERMARK, 100	);
+		hd.put(IMACQUISITION::BUFFERCONF::IDRINTERVAL,		0		);
+		hd.put(IMACQUISITION::BUFFERCONF::OFFSETX, 			-1		);
+		hd.put(IMACQUISITION::BUFFERCONF::OFFSETY, 			-1		);
 		hd.put(IMACQUISITION::BUFFERCONF::HWBUFSIZE,		0		);
 		hd.put(IMACQUISITION::BUFFERCONF::BRIGHTNESSONOFF, 	1		);
 		hd.put(IMACQUISITION::BUFFERCONF::BRIGHTNESSAUTO,	0		);
@@ -45,6 +55,13 @@ const boost::property_tree::ptree SettingsIAC::getDefaultParams() {
 		hd.put(IMACQUISITION::BUFFERCONF::HWTRIGGER,		0		);
 		hd.put(IMACQUISITION::BUFFERCONF::HWTRIGGERPARAM,	0		);
 		hd.put(IMACQUISITION::BUFFERCONF::HWTRIGGERSOURCE,	0		);
+		hd.put(IMACQUISITION::BUFFERCONF::CAMTYPE,			"hardware");
+		hd.put(IMACQUISITION::BUFFERCONF::SYNTHETIC_SOURCE,	"pattern");
+		hd.put(IMACQUISITION::BUFFERCONF::SYNTHETIC_PATH,	""		);
+		hd.put(IMACQUISITION::BUFFERCONF::SYNTHETIC_NOISE,	4		);
+		hd.put(IMACQUISITION::BUFFERCONF::SYNTHETIC_DROPRATE, 0.0	);
+		hd.put(IMACQUISITION::BUFFERCONF::SYNTHETIC_DRIFTPPM, 0.0	);
+		hd.put(IMACQUISITION::BUFFERCONF::CPUS,				""		);
 
 		boost::property_tree::ptree ld;
 		ld.put(IMACQUISITION::BUFFERCONF::CAMID,	 		i		);
@@ -60,6 +77,15 @@ const boost::property_tree::ptree SettingsIAC::getDefaultParams() {
 		ld.put(IMACQUISITION::BUFFERCONF::FRAMESPERVIDEO, 	500		);
 		ld.put(IMACQUISITION::BUFFERCONF::FPS, 				3		);
 		ld.put(IMACQUISITION::BUFFERCONF::PRESET, 			2		);
+		ld.put(IMACQUISITION::BUFFERCONF::POOLSIZE, 		8		);
+		ld.put(IMACQUISITION::BUFFERCONF::QUEUETYPE, 		"list"	);
+		ld.put(IMACQUISITION::BUFFERCONF::QUEUECAPACITY, 	400		);
+		ld.put(IMACQUISITION::BUFFERCONF::OVERFLOWPOLICY, 	"dropoldest");
+		ld.put(IMACQUISITION::BUFFERCONF::OVERFLOWBLOCKMS, 	100		);
+		ld.put(IMACQUISITION::BUFFERCONF::SPILLDIR, 		""		);
+		ld.put(IMACQUISITION::BUFFERCONF::SPILLFRAMES, 		1000	);
+		ld.put(IMACQUISITION::BUFFERCONF::SPILLHIGHWATERMARK, 100	);
+		ld.put(IMACQUISITION::BUFFERCONF::IDRINTERVAL,		0		);
 	    pt.add_child(IMACQUISITION::BUFFER, hd);
 	    pt.add_child(IMACQUISITION::BUFFER, ld);
 	}
@@ -75,6 +101,31 @@ const boost::property_tree::ptree SettingsIAC::getDefaultParams() {
     pt.put(IMACQUISITION::POSTLEVEL1,            "@moenck ");
     pt.put(IMACQUISITION::POSTLEVEL2,            "@channel ");
     pt.put(IMACQUISITION::CAMCOUNT,             2);
+    pt.put(IMACQUISITION::ENCODERCOUNT,         2);
+    pt.put(IMACQUISITION::FRAMEPOOL_PREFAULT,   1);
+    pt.put(IMACQUISITION::FRAMEPOOL_MLOCK,      0);
+    pt.put(IMACQUISITION::BUFFER_BUDGET_MB,     5000);
+    pt.put(IMACQUISITION::ENCODER_BACKEND,      "nvenc");
+    pt.put(IMACQUISITION::LIBAV_CODEC,          "libx265");
+    pt.put(IMACQUISITION::LIBAV_PRESET,         "fast");
+    pt.put(IMACQUISITION::LIBAV_THREADS,        0);
+    pt.put(IMACQUISITION::WRITER_BATCH_KB,      4096);
+    pt.put(IMACQUISITION::WRITER_QUEUE_DEPTH,   8);
+    pt.put(IMACQUISITION::PREVIEW_THREADS,      2);
+    pt.put(IMACQUISITION::PREVIEW_QUEUE,        32);
+    pt.put(IMACQUISITION::PREVIEW_MODE,         "queue");
+    pt.put(IMACQUISITION::SIDECAR_FLUSH_MS,     1000);
+    pt.put(IMACQUISITION::SIDECAR_FLUSH_KB,     64);
+    pt.put(IMACQUISITION::SIDECAR_BINARY,       0);
+    pt.put(IMACQUISITION::SIDECAR_INDEX,        1);
+
+    //Empty CPU sets and the "other" policy leave the placement to the kernel
+    for (const std::string &threads : {IMACQUISITION::THREADS_CAPTURE, IMACQUISITION::THREADS_ENCODER,
+                                       IMACQUISITION::THREADS_SHAREDMEMORY, IMACQUISITION::THREADS_ANALYSIS}) {
+        pt.put(threads + "." + IMACQUISITION::THREADCONF::CPUS,     "");
+        pt.put(threads + "." + IMACQUISITION::THREADCONF::POLICY,   "other");
+        pt.put(threads + "." + IMACQUISITION::THREADCONF::PRIORITY, 0);
+    }
 
 
 	return pt;
@@ -97,6 +148,17 @@ EncoderQualityConfig SettingsIAC::setFromNode(boost::property_tree::ptree node){
 	cfg.width 				= node.get<int>(IMACQUISITION::BUFFERCONF::VIDEO_WIDTH);
 	cfg.height 				= node.get<int>(IMACQUISITION::BUFFERCONF::VIDEO_HEIGHT);
 	cfg.fps 				= node.get<int>(IMACQUISITION::BUFFERCONF::FPS);
+	//Optional, so older configuration files keep working
+	cfg.poolsize 			= node.get<int>(IMACQUISITION::BUFFERCONF::POOLSIZE, cfg.isPreview ? 8 : 16);
+	cfg.queuetype 			= node.get<std::string>(IMACQUISITION::BUFFERCONF::QUEUETYPE, "list");
+	cfg.queuecapacity 		= node.get<int>(IMACQUISITION::BUFFERCONF::QUEUECAPACITY, 400);
+	cfg.overflowpolicy 		= node.get<std::string>(IMACQUISITION::BUFFERCONF::OVERFLOWPOLICY,
+									cfg.isPreview ? "dropoldest" : "droppreviewfirst");
+	cfg.overflowblockms 	= node.get<int>(IMACQUISITION::BUFFERCONF::OVERFLOWBLOCKMS, 100);
+	cfg.spilldir 			= node.get<std::string>(IMACQUISITION::BUFFERCONF::SPILLDIR, "");
+	cfg.spillframes 		= node.get<int>(IMACQUISITION::BUFFERCONF::SPILLFRAMES, 1000);
+	cfg.spillhighwatermark 	= node.get<int>(IMACQUISITION::BUFFERCONF::SPILLHIGHWATERMARK, 100);
+	cfg.idrinterval 		= node.get<int>(IMACQUISITION::BUFFERCONF::IDRINTERVAL, 0);
 
 	if (cfg.isPreview==0){
 		cfg.offsetx 		= node.get<int>(IMACQUISITION::BUFFERCONF::OFFSETX);
@@ -117,6 +179,14 @@ EncoderQualityConfig SettingsIAC::setFromNode(boost::property_tree::ptree node){
 		cfg.hwtrigger 		= node.get<int>(IMACQUISITION::BUFFERCONF::HWTRIGGER);
 		cfg.hwtriggerparam	= node.get<int>(IMACQUISITION::BUFFERCONF::HWTRIGGER);
 		cfg.hwtriggersrc	= node.get<int>(IMACQUISITION::BUFFERCONF::HWTRIGGER);
+		//Optional, so older configuration files keep working
+		cfg.camtype				= node.get<std::string>(IMACQUISITION::BUFFERCONF::CAMTYPE, "hardware");
+		cfg.syntheticsource		= node.get<std::string>(IMACQUISITION::BUFFERCONF::SYNTHETIC_SOURCE, "pattern");
+		cfg.syntheticpath		= node.get<std::string>(IMACQUISITION::BUFFERCONF::SYNTHETIC_PATH, "");
+		cfg.syntheticnoise		= node.get<int>(IMACQUISITION::BUFFERCONF::SYNTHETIC_NOISE, 4);
+		cfg.syntheticdroprate	= node.get<double>(IMACQUISITION::BUFFERCONF::SYNTHETIC_DROPRATE, 0.0);
+		cfg.syntheticdriftppm	= node.get<double>(IMACQUISITION::BUFFERCONF::SYNTHETIC_DRIFTPPM, 0.0);
+		cfg.cpus				= node.get<std::string>(IMACQUISITION::BUFFERCONF::CPUS, "");
 	}
 	return cfg;
 }
@@ -149,4 +219,17 @@ EncoderQualityConfig SettingsIAC::getBufferConf(int camid, int preview){
 	return cfg;
 }
 
+int SettingsIAC::getCameraCount(){
+	int count = 0;
 
+	BOOST_FOREACH(boost::property_tree::ptree::value_type &v,
+			_ptree.get_child("IMACQUISITION")){
+		if(v.first =="BUFFER"){
+			boost::optional<int> camid = v.second.get_optional<int>(IMACQUISITION::BUFFERCONF::CAMID);
+			if (camid && camid.get() + 1 > count) {
+				count = camid.get() + 1;
+			}
+		}
+	}
+	return count;
+}
@@ -43,6 +43,39 @@
 	* 						Please note that NvEnc only supports up to 4096x4096.
 	* height		Height of the input and output. No scaling is done.<br>
 	* 						Please note that NvEnc only supports up to 4096x4096.
+	* poolsize		Number of frame buffers to preallocate for this stream.
+	* queuetype		Buffer implementation feeding the encoder.<br>
+	* 						"list" = MutexLinkedList (default)<br>
+	* 						"spsc" = lock-free SpscRingBuffer
+	* queuecapacity	Maximum number of frames in a "spsc" buffer.
+	* overflowpolicy	What to do when BUFFER_BUDGET_MB is exhausted.<br>
+	* 						"droppreviewfirst" = drop queued preview frames, then the oldest frame<br>
+	* 						"dropoldest" = drop the oldest queued frame<br>
+	* 						"dropnewest" = drop the incoming frame<br>
+	* 						"block" = wait up to overflowblockms, then drop the incoming frame
+	* overflowblockms	Maximum time in ms a producer is blocked ("block" only).
+	* spilldir		Directory for the spill file of a "list" buffer. Empty disables spilling.
+	* spillframes	Number of frames the spill file can hold.
+	* spillhighwatermark	Number of frames held in RAM before frames are spilled.
+	* idrinterval	Frames from one IDR frame to the next, so a video can be decoded<br>
+	* 						from the middle (see SegmentIndex). 0 = only the first frame<br>
+	* 						of a video (default, smallest files).
+	* offsetx		Left edge of the sensor ROI. Negative centers the ROI horizontally.
+	* offsety		Top edge of the sensor ROI. Negative centers the ROI vertically.
+	* camtype		Where the frames of a camera slot come from.<br>
+	* 						"hardware" = the Ximea or Flea3 camera with the configured serial (default)<br>
+	* 						"synthetic" = SyntheticCamThread, no camera required
+	* syntheticsource	Frame source of a synthetic camera.<br>
+	* 						"pattern" = moving test pattern with sensor noise<br>
+	* 						"directory" = PNG/PGM/raw frames in syntheticpath, looped<br>
+	* 						"video" = frames decoded from the recording syntheticpath, looped
+	* syntheticpath	Directory or video file for the "directory" and "video" sources.
+	* syntheticnoise	Standard deviation of the noise added to the pattern (grey levels).
+	* syntheticdroprate	Probability in [0,1] that a synthetic frame is lost.
+	* syntheticdriftppm	How much faster the synthetic camera clock runs than the host clock.
+	* cpus			CPUs the capture thread of this camera may run on, e.g. "0-3,8".<br>
+	* 						Empty uses IMACQUISITION.THREADS.CAPTURE.CPUS. The frame<br>
+	* 						buffers are allocated on the NUMA node of these CPUs.
 	* TODO: More parameters
 	*/
 typedef struct _EncoderQualityConfig
@@ -60,6 +93,15 @@ typedef struct _EncoderQualityConfig
 	int width;
 	int height;
 	int fps;
+	int poolsize;
+	std::string queuetype;
+	int queuecapacity;
+	std::string overflowpolicy;
+	int overflowblockms;
+	std::string spilldir;
+	int spillframes;
+	int spillhighwatermark;
+	int idrinterval;
 	int offsetx;
 	int offsety;
 	int hwbuffersize;
@@ -78,6 +120,13 @@ typedef struct _EncoderQualityConfig
 	int hwtrigger;
 	int hwtriggerparam;
 	int hwtriggersrc;
+	std::string camtype;
+	std::string syntheticsource;
+	std::string syntheticpath;
+	int syntheticnoise;
+	double syntheticdroprate;
+	double syntheticdriftppm;
+	std::string cpus;
 }EncoderQualityConfig;
 
 
@@ -232,6 +281,12 @@ public:
 
 	EncoderQualityConfig getBufferConf(int camid, int preview);
 
+	/**
+	 * Gets the number of camera slots: one more than the highest CAMID
+	 * of the buffer entries.
+	 */
+	int getCameraCount();
+
 private:
 
 	EncoderQualityConfig setFromNode(boost::property_tree::ptree node);
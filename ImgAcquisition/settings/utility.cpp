@@ -25,6 +25,7 @@
 #include <boost/date_time.hpp>
 
 #include<cstdlib>
+#include <chrono>
 
 void slackpost(std::string what, int level){
     SettingsIAC *set = SettingsIAC::getInstance();
@@ -47,6 +48,27 @@ std::string get_utc_time() {
     return boost::posix_time::to_iso_extended_string(boost::posix_time::microsec_clock::universal_time())+"Z";
 }
 
+uint64_t get_utc_time_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::string format_utc_time(uint64_t ns) {
+    const time_t seconds = static_cast<time_t>(ns / 1000000000ULL);
+    const unsigned int micros = static_cast<unsigned int>((ns % 1000000000ULL) / 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+
+    //Same layout as boost's to_iso_extended_string, which omits zero fractions
+    char result[40];
+    size_t len = strftime(result, sizeof(result), "%Y-%m-%dT%H:%M:%S", &utc);
+    if (micros != 0) {
+        len += snprintf(result + len, sizeof(result) - len, ".%06u", micros);
+    }
+    snprintf(result + len, sizeof(result) - len, "Z");
+    return result;
+}
+
 boost::posix_time::time_duration get_utc_offset() {
     using namespace boost::posix_time;
 
@@ -8,9 +8,16 @@
 #ifndef UTILITY_H_
 #define UTILITY_H_
 
+#include <cstdint>
 #include <string>
 
 std::string get_utc_time();
+
+//! Current time as ns since the UNIX epoch (UTC)
+uint64_t get_utc_time_ns();
+
+//! Formats ns since the UNIX epoch like get_utc_time, e.g. 2016-02-04T12:00:00.123456Z
+std::string format_utc_time(uint64_t ns);
 std::string get_utc_offset_string();
 std::string getTimestamp();
 void slackpost(std::string what, int level);
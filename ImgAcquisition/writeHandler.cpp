@@ -6,8 +6,12 @@
  */
 
 #include "writeHandler.h"
+#include "BitstreamWriter.h"
 #include "settings/utility.h"
-#include <sstream>
+#include "settings/Settings.h"
+#include "settings/ParamNames.h"
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <boost/filesystem.hpp>
 #include <sys/stat.h>
@@ -15,12 +19,28 @@
 namespace beeCompress {
 
 writeHandler::writeHandler(std::string imdir, int currentCam,
-                           std::string edir) {
+                           std::string edir, BitstreamWriter *writer) {
 
     //Create assemble file name and create a file handle to pass the encoder.
     std::string timestamp    = get_utc_time();
     _basename                = imdir;
     _camId                   = currentCam;
+    _firstTimestampNs        = 0;
+    _lastTimestampNs         = 0;
+    _hasFrames               = false;
+    _writer                  = writer;
+    _videoBytes              = 0;
+    _framesBinary            = nullptr;
+    _index                   = nullptr;
+    _codec                   = VideoCodec::HEVC;
+
+    SettingsIAC *set = SettingsIAC::getInstance();
+    _flushInterval = std::chrono::milliseconds(std::max(
+            set->maybeGetValueOfParam<int>(IMACQUISITION::SIDECAR_FLUSH_MS).get_value_or(1000), 0));
+    _flushBytes = static_cast<size_t>(std::max(
+            set->maybeGetValueOfParam<int>(IMACQUISITION::SIDECAR_FLUSH_KB).get_value_or(64), 0)) * 1024;
+    bool binary = set->maybeGetValueOfParam<int>(IMACQUISITION::SIDECAR_BINARY).get_value_or(0) == 1;
+    bool index = set->maybeGetValueOfParam<int>(IMACQUISITION::SIDECAR_INDEX).get_value_or(1) == 1;
 
     //For file writing
     char filepath[512];
@@ -35,6 +55,8 @@ writeHandler::writeHandler(std::string imdir, int currentCam,
     _lockfile        = tmp + ".lck";
     _videofile       = tmp + ".avi";
     _framesfile      = tmp + ".txt";
+    _framesbinaryfile = binary ? tmp + ".bin" : "";
+    _indexfile       = index ? tmp + ".idx" : "";
 
     //Open for writing
     _lock    = fopen(_lockfile.c_str(), "wb");
@@ -58,44 +80,187 @@ writeHandler::writeHandler(std::string imdir, int currentCam,
         assert(false);
         exit(1);
     }
+    if (binary) {
+        _framesBinary = openBinarySidecar(_framesbinaryfile, SIDECAR_MAGIC, sizeof(SidecarRecord), _framesRecords);
+    }
+    if (index) {
+        _index = openBinarySidecar(_indexfile, INDEX_MAGIC, sizeof(IndexRecord), _indexRecords);
+    }
+    _lastFlush = std::chrono::steady_clock::now();
+}
+
+FILE *writeHandler::openBinarySidecar(const std::string &path, const char *magic, uint32_t recordBytes,
+                                      std::string &buffer) {
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        std::cout << "Sidecar " << path << " could not be opened!" << std::endl;
+        assert(false);
+        exit(1);
+    }
+    SidecarHeader header;
+    std::copy(magic, magic + sizeof(header.magic), header.magic);
+    header.version = SIDECAR_VERSION;
+    header.recordBytes = recordBytes;
+    header.codec = static_cast<uint32_t>(_codec);
+    header.reserved = 0;
+    buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    return file;
 }
 
-void writeHandler::log(std::string timestamp) {
+void writeHandler::log(const FrameMetadata &meta) {
+
+    if (!_hasFrames) {
+        _firstTimestampNs = meta.wallClockNs;
+        _hasFrames = true;
+    }
+    _lastTimestampNs = meta.wallClockNs;
+    _framesText += "Cam_" + std::to_string(_camId) + "_" + format_utc_time(meta.wallClockNs) + "\n";
+
+    if (_framesBinary || _index) {
+        SidecarRecord record = { meta.sequence, meta.cameraTimestampNs, meta.wallClockNs, SIDECAR_NO_OFFSET };
+        if (_awaitingFrame.empty()) {
+            _awaitingPicture.push_back(record);
+        } else {
+            addFrame(record, _awaitingFrame.front());
+            _awaitingFrame.pop_front();
+        }
+    }
+
+    //One write per interval instead of one per frame
+    if (_framesText.size() + _framesRecords.size() + _indexRecords.size() >= _flushBytes
+            || std::chrono::steady_clock::now() - _lastFlush >= _flushInterval) {
+        flushSidecars();
+    }
+}
+
+void writeHandler::setCodec(VideoCodec codec) {
+    if (codec == _codec) {
+        return;
+    }
+    _codec = codec;
+    if (codec == VideoCodec::Unknown && _index) {
+        std::cout << "Warning: the index can only be written for HEVC and H.264 videos. "
+                  << _indexfile << " is dropped." << std::endl;
+        fclose(_index);
+        remove(_indexfile.c_str());
+        _index = nullptr;
+        _indexfile.clear();
+        _indexRecords.clear();
+    }
 
-    if (_firstTimestamp == "") {
-        _firstTimestamp = timestamp;
+    //The headers hold the codec known when the sidecars were opened
+    flushSidecars();
+    const uint32_t value = static_cast<uint32_t>(codec);
+    for (FILE *file : { _framesBinary, _index }) {
+        if (file) {
+            fseek(file, offsetof(SidecarHeader, codec), SEEK_SET);
+            fwrite(&value, sizeof(value), 1, file);
+            fseek(file, 0, SEEK_END);
+            fflush(file);
+        }
     }
-    _lastTimestamp = timestamp;
-    std::stringstream line;
-    line << "Cam_" << _camId << "_" << timestamp << "\n";
-    fwrite(line.str().c_str(), sizeof(char), line.str().size(), _frames);
-    fflush(_frames);
+}
+
+void writeHandler::flushSidecars() {
+    if (!_framesText.empty()) {
+        fwrite(_framesText.data(), sizeof(char), _framesText.size(), _frames);
+        fflush(_frames);
+        _framesText.clear();
+    }
+    if (_framesBinary && !_framesRecords.empty()) {
+        fwrite(_framesRecords.data(), sizeof(char), _framesRecords.size(), _framesBinary);
+        fflush(_framesBinary);
+        _framesRecords.clear();
+    }
+    if (_index && !_indexRecords.empty()) {
+        fwrite(_indexRecords.data(), sizeof(char), _indexRecords.size(), _index);
+        fflush(_index);
+        _indexRecords.clear();
+    }
+    _lastFlush = std::chrono::steady_clock::now();
+}
+
+void writeHandler::addFrame(SidecarRecord frame, IndexRecord picture) {
+    frame.videoOffset = picture.videoOffset;
+    picture.wallClockNs = frame.wallClockNs;
+    if (_framesBinary) {
+        _framesRecords.append(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    }
+    if (_index) {
+        _indexRecords.append(reinterpret_cast<const char*>(&picture), sizeof(picture));
+    }
+}
+
+bool writeHandler::writeVideo(const uint8_t *data, size_t size) {
+    if (_framesBinary || _index) {
+        uint8_t type = pictureType(_codec, data, size);
+        IndexRecord picture = { _videoBytes, 0, static_cast<uint32_t>(size), type,
+                                static_cast<uint8_t>(isKeyframe(_codec, type) ? 1 : 0), 0 };
+        if (_awaitingPicture.empty()) {
+            _awaitingFrame.push_back(picture);
+        } else {
+            addFrame(_awaitingPicture.front(), picture);
+            _awaitingPicture.pop_front();
+        }
+    }
+    _videoBytes += size;
+    if (_writer != nullptr) {
+        return _writer->write(_video, data, size);
+    }
+    return fwrite(data, 1, size, _video) == size;
 }
 
 writeHandler::~writeHandler() {
+    //Frames the encoder never wrote a picture for keep SIDECAR_NO_OFFSET
+    if (_framesBinary) {
+        for (const SidecarRecord &record : _awaitingPicture) {
+            _framesRecords.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+    }
+    //and pictures without a logged frame a wall clock time of 0
+    if (_index) {
+        for (const IndexRecord &record : _awaitingFrame) {
+            _indexRecords.append(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+    }
+    flushSidecars();
+
     //Always be a good citizen and close your file handles.
     if (_video) fclose(_video);
     if (_lock) fclose(_lock);
     if (_frames) fclose(_frames);
+    if (_framesBinary) fclose(_framesBinary);
+    if (_index) fclose(_index);
 
     //For filling the basepath
     char filepath[512];
 
-    //assemble final file name
-    sprintf(filepath, _basename.c_str(), _camId, _camId, _firstTimestamp.c_str(),
-            _lastTimestamp.c_str(), 0);
+    //assemble final file name. Without frames both timestamps are empty as before.
+    std::string firstTimestamp = _hasFrames ? format_utc_time(_firstTimestampNs) : "";
+    std::string lastTimestamp  = _hasFrames ? format_utc_time(_lastTimestampNs) : "";
+    sprintf(filepath, _basename.c_str(), _camId, _camId, firstTimestamp.c_str(),
+            lastTimestamp.c_str(), 0);
 
     //Rename the temporary files to their final names:
     std::string tmp = filepath;
     std::string newvideofile = tmp + ".avi";
     std::string newframesfile = tmp + ".txt";
+    std::string newframesbinaryfile = tmp + ".bin";
+    std::string newindexfile = tmp + ".idx";
     boost::filesystem::path video(newvideofile);
     newvideofile = _exchangedir + video.filename().string();
     boost::filesystem::path frames(newframesfile);
     newframesfile = _exchangedir + frames.filename().string();
+    boost::filesystem::path framesbinary(newframesbinaryfile);
+    newframesbinaryfile = _exchangedir + framesbinary.filename().string();
+    boost::filesystem::path index(newindexfile);
+    newindexfile = _exchangedir + index.filename().string();
 
     rename(_videofile.c_str(), newvideofile.c_str());
     rename(_framesfile.c_str(), newframesfile.c_str());
+    if (!_framesbinaryfile.empty()) rename(_framesbinaryfile.c_str(), newframesbinaryfile.c_str());
+    if (!_indexfile.empty()) rename(_indexfile.c_str(), newindexfile.c_str());
 
     // This process runs as root. Set correct rights so others can work with the files.
     // We are generous with the permissions.
@@ -106,6 +271,16 @@ writeHandler::~writeHandler() {
     error_value = chmod(newvideofile.c_str(), S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
     if (error_value != 0)
         perror("chmod");
+    if (!_framesbinaryfile.empty()) {
+        error_value = chmod(newframesbinaryfile.c_str(), S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+        if (error_value != 0)
+            perror("chmod");
+    }
+    if (!_indexfile.empty()) {
+        error_value = chmod(newindexfile.c_str(), S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP|S_IROTH|S_IWOTH);
+        if (error_value != 0)
+            perror("chmod");
+    }
 
     //Remove the lockfile, so others will be allowed to grab the video
     remove(_lockfile.c_str());
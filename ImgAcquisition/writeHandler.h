@@ -7,10 +7,34 @@
 
 #ifndef WRITEHANDLER_H_
 #define WRITEHANDLER_H_
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <string>
+#include "Buffer/MutexBuffer.h"
+#include "SidecarFormat.h"
 
 namespace beeCompress {
 
+class BitstreamWriter;
+
+/**
+ * @brief Files of one video segment: the video, its lock and the frame sidecars.
+ *
+ * The text sidecar (.txt) lists the frames, the optional binary one (.bin,
+ * see SidecarFormat.h) also holds the sequence number, camera clock and
+ * position in the video of each frame. The index (.idx) holds position,
+ * size, type and capture time of each coded picture as it is written,
+ * so readers can seek in the video (see SegmentIndex). All are buffered
+ * and written at most every SIDECAR.FLUSH_MS ms or SIDECAR.FLUSH_KB KB,
+ * whatever comes first, so a crash loses at most that much of them.
+ *
+ * Settings (IMACQUISITION.SIDECAR.*):
+ * FLUSH_MS  Longest time frames stay buffered. Default 1000. 0 flushes every frame.
+ * FLUSH_KB  Largest amount buffered. Default 64.
+ * BINARY    1 writes the binary sidecar. Default 0.
+ * INDEX     1 writes the index. Default 1. Only HEVC and H.264 videos can be indexed.
+ */
 class writeHandler {
 
 //All public policy
@@ -22,9 +46,46 @@ public:
     //! lock file, so no one grabs the unfinished video
     FILE        *_lock;
 
+    //! Writes the video on its own thread. nullptr: written by the caller of writeVideo.
+    BitstreamWriter *_writer;
+
+    //! Bytes passed to writeVideo
+    uint64_t    _videoBytes;
+
     //! text file holding the names of the frames
     FILE        *_frames;
 
+    //! Binary sidecar. nullptr unless SIDECAR.BINARY is set.
+    FILE        *_framesBinary;
+
+    //! Lines of _frames not written yet
+    std::string _framesText;
+
+    //! Records of _framesBinary not written yet
+    std::string _framesRecords;
+
+    //! Index of the video. nullptr unless SIDECAR.INDEX is set.
+    FILE        *_index;
+
+    //! Records of _index not written yet
+    std::string _indexRecords;
+
+    //! Codec of the pictures passed to writeVideo. HEVC unless set by setCodec.
+    VideoCodec  _codec;
+
+    //! Time of the last flush of the sidecars
+    std::chrono::steady_clock::time_point _lastFlush;
+
+    //! Flush policy (SIDECAR.FLUSH_MS, SIDECAR.FLUSH_KB)
+    std::chrono::milliseconds _flushInterval;
+    size_t      _flushBytes;
+
+    //! Logged frames whose picture was not written yet
+    std::deque<SidecarRecord> _awaitingPicture;
+
+    //! Pictures written before their frame was logged
+    std::deque<IndexRecord> _awaitingFrame;
+
     //! Lockfile which is created in temp dirs. Deprecated
     std::string _lockfile;
 
@@ -34,14 +95,23 @@ public:
     //! Frames textfile to create
     std::string _framesfile;
 
+    //! Binary sidecar to create. Empty unless SIDECAR.BINARY is set.
+    std::string _framesbinaryfile;
+
+    //! Index to create. Empty unless SIDECAR.INDEX is set.
+    std::string _indexfile;
+
     //! The path to the tmp dir
     std::string _basename;
 
-    //! Timestamp of the start of the video
-    std::string _firstTimestamp;
+    //! Timestamp of the start of the video in ns since the UNIX epoch (UTC)
+    uint64_t    _firstTimestampNs;
 
-    //! Timestamp of the end of the video
-    std::string _lastTimestamp;
+    //! Timestamp of the end of the video in ns since the UNIX epoch (UTC)
+    uint64_t    _lastTimestampNs;
+
+    //! Whether a frame was logged yet
+    bool        _hasFrames;
 
     //! The path to the out dir
     std::string _exchangedir;
@@ -50,11 +120,25 @@ public:
     int         _camId;
 
     /**
-     * @brief Writes a line to the textfile
+     * @brief Adds a frame to the sidecars
+     *
+     * Frames are logged in the order they were passed to the encoder.
+     *
+     * @param Metadata of the frame. Its wall clock time is written.
+     */
+    void log(const FrameMetadata &meta);
+
+    /**
+     * @brief Appends encoded data to the video file.
      *
-     * @param Timestamp of the line to write
+     * Each call is one coded picture. The backends encode without
+     * B-frames, so the n-th call holds the n-th logged frame, whichever
+     * comes first. With a BitstreamWriter the data is only copied here
+     * and written later.
+     *
+     * @return false if writing failed (with a writer: an earlier write of this file)
      */
-    void log(std::string timestamp);
+    bool writeVideo(const uint8_t *data, size_t size);
 
     /**
      * @brief Constructor. Assembles pathes and creates file handles.
@@ -62,14 +146,35 @@ public:
      * @param Sets the path to the tmp dir
      * @param Sets the camera ID
      * @param Sets the path to the out dir
+     * @param Writer for the video, or nullptr to write it directly
+     */
+    writeHandler(std::string imdir, int currentCam, std::string exchangedir,
+                 BitstreamWriter *writer = nullptr);
+
+    /**
+     * @brief Sets the codec of the pictures, before the first writeVideo.
+     *
+     * It is stored in the headers of the binary sidecar and the index. The
+     * index is dropped with a warning for a codec it can not type.
      */
-    writeHandler(std::string imdir, int currentCam, std::string exchangedir);
+    void setCodec(VideoCodec codec);
+
+    //! Writes the buffered sidecar data and flushes the sidecars
+    void flushSidecars();
+
+    //! Adds the records of a frame and its coded picture to the binary sidecar and the index
+    void addFrame(SidecarRecord frame, IndexRecord picture);
+
+    //! Creates a binary sidecar and puts its header into the buffer
+    FILE *openBinarySidecar(const std::string &path, const char *magic, uint32_t recordBytes,
+                            std::string &buffer);
 
     /**
      * @brief Destructor. Finalizes writing.
      *
      * Closes file handles, moves files to the exchangedirs and
-     * deletes eventual locks.
+     * deletes eventual locks. With a writer, pass the handler to
+     * BitstreamWriter::close instead, so the video is complete first.
      */
     virtual ~writeHandler();
 };
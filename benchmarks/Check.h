@@ -0,0 +1,35 @@
+#ifndef BENCHMARKS_CHECK_H_
+#define BENCHMARKS_CHECK_H_
+
+#include <cstdio>
+#include <string>
+
+/*
+ * Reporting of the checks run by ctest. A check calls expect for every
+ * condition and returns checkResult() from main.
+ */
+
+//Number of failed expectations so far
+inline int &checkFailures() {
+	static int failures = 0;
+	return failures;
+}
+
+inline void expect(bool ok, const std::string &what) {
+	if (!ok) {
+		std::printf("FAILED: %s\n", what.c_str());
+		checkFailures()++;
+	}
+}
+
+//Prints the summary. 1 if an expectation failed, 0 otherwise.
+inline int checkResult() {
+	if (checkFailures() > 0) {
+		std::printf("%d checks failed\n", checkFailures());
+		return 1;
+	}
+	std::printf("All checks passed\n");
+	return 0;
+}
+
+#endif /* BENCHMARKS_CHECK_H_ */
@@ -0,0 +1,91 @@
+#include "Check.h"
+#include "BitstreamWriter.h"
+#include "settings/Settings.h"
+#include "writeHandler.h"
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Write errors of the BitstreamWriter belong to the file they happened on.
+ * Two segments are open at once, as while NvEncGlue rotates segments. The
+ * video of one of them is /dev/full. Only writes to that file may report
+ * the error, closing the other segment must not clear it, and closing its
+ * own segment must.
+ *
+ * Usage: bitstreamWriterCheck
+ * Exits with 1 if a check fails.
+ */
+
+static const size_t BATCH_BYTES = 4096;
+
+//The settings exit without a config file
+static void useCheckConfig(const boost::filesystem::path &dir) {
+	const std::string path = (dir / "bitstreamWriterCheckConfig.json").string();
+	std::ofstream conf(path.c_str());
+	conf << "{ \"IMACQUISITION\": { \"BUFFER_BUDGET_MB\": \"64\" } }" << std::endl;
+	conf.close();
+	SettingsIAC::setConf(path);
+	SettingsIAC::getInstance();
+}
+
+//Until the writer thread has done all jobs queued
+static void waitIdle(BitstreamWriter &writer) {
+	while (writer.takeStats().queueDepth > 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+int main() {
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path()
+			/ boost::filesystem::unique_path("bitstreamWriterCheck-%%%%%%%%");
+	for (const char *cam : {"Cam_0", "Cam_1"}) {
+		boost::filesystem::create_directories(dir / "tmp" / cam);
+		boost::filesystem::create_directories(dir / "out" / cam);
+	}
+	useCheckConfig(dir);
+	const std::string imdir = (dir / "tmp" / "Cam_%u" / "Cam_%u_%s--%s").string();
+	const std::string exchangedir = (dir / "out" / "Cam_%u").string() + "/";
+
+	BitstreamWriter writer(BATCH_BYTES, 4, "bitstreamWriterCheck");
+	std::unique_ptr<writeHandler> good(new writeHandler(imdir, 0, exchangedir, &writer));
+	std::unique_ptr<writeHandler> full(new writeHandler(imdir, 1, exchangedir, &writer));
+	fclose(full->_video);
+	full->_video = fopen("/dev/full", "wb");
+	expect(full->_video != nullptr, "/dev/full can not be opened");
+	if (full->_video == nullptr) {
+		boost::filesystem::remove_all(dir);
+		return 1;
+	}
+	setvbuf(full->_video, nullptr, _IONBF, 0);
+	FILE *goodVideo = good->_video;
+
+	//A full batch is handed to the writer thread, which fails on it
+	const std::vector<uint8_t> data(BATCH_BYTES, 0x42);
+	writer.write(full->_video, data.data(), data.size());
+	waitIdle(writer);
+	expect(!writer.write(full->_video, data.data(), 1), "failed file: error not reported");
+	expect(writer.write(goodVideo, data.data(), 1), "other file: error of the failed file reported");
+
+	//Closing the other segment keeps the error
+	writer.close(std::move(good));
+	waitIdle(writer);
+	expect(!writer.write(full->_video, data.data(), 1), "failed file: error cleared by closing another file");
+
+	//Closing the failed segment clears it. The next segment may get the same FILE*.
+	writer.close(std::move(full));
+	waitIdle(writer);
+	std::unique_ptr<writeHandler> next(new writeHandler(imdir, 1, exchangedir, &writer));
+	expect(writer.write(next->_video, data.data(), data.size()), "next segment: error of the closed file reported");
+	writer.close(std::move(next));
+	waitIdle(writer);
+
+	boost::filesystem::remove_all(dir);
+	return checkResult();
+}
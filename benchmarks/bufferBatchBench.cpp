@@ -0,0 +1,115 @@
+#include "Buffer/MutexLinkedList.h"
+#include "Buffer/SpscRingBuffer.h"
+#include "settings/ParamNames.h"
+#include "settings/Settings.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Frames per second through the frame buffers with pushBatch/popBatch
+ * moving 1, 4 and 16 frames per call.
+ *
+ * Streaming: a producer and a consumer thread, as camera and encoder.
+ * Drain: a backlog of queued frames is popped by a consumer that fell
+ * behind, with nobody pushing.
+ *
+ * Usage: bufferBatchBench [frames]
+ * Only pointers are queued, so the frame size does not matter.
+ */
+
+static const int DEFAULT_FRAMES = 1000000;
+//Frames the producer keeps in flight. Also the capacity of the ring.
+static const int IN_FLIGHT = 256;
+
+//The buffers take their byte budget from the settings, which exit without a config file
+static void useBenchConfig() {
+	const std::string path = "./bufferBatchBenchConfig.json";
+	std::ofstream conf(path.c_str());
+	conf << "{ \"IMACQUISITION\": { \"BUFFER_BUDGET_MB\": \"1024\" } }" << std::endl;
+	conf.close();
+	SettingsIAC::setConf(path);
+	SettingsIAC::getInstance();
+}
+
+static std::vector<std::shared_ptr<ImageBuffer>> makeBatch(size_t batch) {
+	FrameMetadata meta = {};
+	std::vector<std::shared_ptr<ImageBuffer>> frames;
+	for (size_t i = 0; i < batch; i++) {
+		frames.push_back(std::make_shared<ImageBuffer>(8, 8, meta));
+	}
+	return frames;
+}
+
+static double streaming(MutexBuffer &buffer, int frames, size_t batch) {
+	const std::vector<std::shared_ptr<ImageBuffer>> frameBatch = makeBatch(batch);
+	const int rounds = frames / static_cast<int>(batch);
+	std::atomic<int> popped(0);
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread consumer([&]() {
+		int total = 0;
+		while (total < rounds * static_cast<int>(batch)) {
+			total += static_cast<int>(buffer.popBatch(batch, -1).size());
+			popped.store(total, std::memory_order_release);
+		}
+	});
+	for (int i = 0; i < rounds; i++) {
+		while (static_cast<int>((i + 1) * batch) - popped.load(std::memory_order_acquire) > IN_FLIGHT) {
+			std::this_thread::yield();
+		}
+		buffer.pushBatch(frameBatch);
+	}
+	consumer.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return rounds * batch / seconds;
+}
+
+static double drain(MutexBuffer &buffer, int frames, size_t batch) {
+	const std::vector<std::shared_ptr<ImageBuffer>> backlog = makeBatch(IN_FLIGHT);
+	double seconds = 0;
+	for (int done = 0; done < frames; done += IN_FLIGHT) {
+		buffer.pushBatch(backlog);
+		auto start = std::chrono::steady_clock::now();
+		size_t left = backlog.size();
+		while (left > 0) {
+			left -= buffer.popBatch(batch, 0).size();
+		}
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return frames / seconds;
+}
+
+int main(int argc, char **argv) {
+	int frames = argc > 1 ? std::stoi(argv[1]) : DEFAULT_FRAMES;
+	useBenchConfig();
+
+	struct Candidate {
+		std::string						name;
+		std::function<MutexBuffer*()>	create;
+	};
+	std::vector<Candidate> candidates = {
+		{"MutexLinkedList", []() -> MutexBuffer* { return new MutexLinkedList(); }},
+		{"SpscRingBuffer", []() -> MutexBuffer* { return new SpscRingBuffer(IN_FLIGHT); }},
+	};
+	const size_t batches[] = {1, 4, 16};
+
+	std::printf("%d frames, %d in flight\n", frames, IN_FLIGHT);
+	std::printf("%-18s %6s %20s %16s\n", "", "batch", "streaming Mframes/s", "drain Mframes/s");
+	for (const Candidate &candidate : candidates) {
+		for (size_t batch : batches) {
+			std::unique_ptr<MutexBuffer> buffer(candidate.create());
+			double stream = streaming(*buffer, frames, batch);
+			double drained = drain(*buffer, frames, batch);
+			std::printf("%-18s %6zu %20.2f %16.2f\n", candidate.name.c_str(), batch, stream / 1e6, drained / 1e6);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,355 @@
+#include "Check.h"
+#include "EncoderBackend.h"
+#include "nvenc/NvEncoder.h"
+#include "settings/Settings.h"
+#include "writeHandler.h"
+#include <boost/filesystem.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Reuse of the encoding session across segments (see CNvEncoder::openSegment)
+ * against a stub of the NVENCODE API function list instead of the driver.
+ *
+ * The stub returns one Annex B unit per picture: VPS, SPS and PPS followed
+ * by an IDR slice if the picture was forced to be an IDR picture with its
+ * parameter sets, a trailing slice otherwise. Every segment file has to
+ * start decodable, so holds exactly one IDR picture, the first one.
+ * It further checks that segments of the same configuration share one
+ * session, that another configuration opens a new one, and that a failing
+ * segment releases the session with all its buffers.
+ *
+ * The same reuse runs through the SyntheticEncoder backend, which needs no
+ * stub: one IDR picture per segment.
+ *
+ * Usage: encoderSessionCheck
+ * Exits with 1 if a check fails.
+ */
+
+static const int WIDTH = 64;
+static const int HEIGHT = 48;
+static const int FRAMES = 10;
+
+//HEVC NAL unit types
+static const uint8_t NAL_TRAIL_R = 1;
+static const uint8_t NAL_IDR_W_RADL = 19;
+static const uint8_t NAL_VPS = 32;
+static const uint8_t NAL_SPS = 33;
+static const uint8_t NAL_PPS = 34;
+
+//The driver as far as CNvEncoder uses it
+struct StubDriver {
+	int						sessionsOpened = 0;
+	int						sessionsDestroyed = 0;
+	int						liveBuffers = 0;
+	//Calls to fail before the next one succeeds again
+	int						failInitialize = 0;
+	int						failLockBitstream = 0;
+	//encodePicFlags of every picture
+	std::vector<uint32_t>	picFlags;
+};
+static StubDriver driver;
+
+static int sessionToken;
+
+struct StubInput {
+	std::vector<uint8_t>	data;
+};
+
+struct StubBitstream {
+	std::vector<uint8_t>	data;
+};
+
+static void appendUnit(std::vector<uint8_t> &out, uint8_t nalType) {
+	const uint8_t unit[] = { 0, 0, 0, 1, static_cast<uint8_t>(nalType << 1), 1, 0xAA, 0xAA };
+	out.insert(out.end(), unit, unit + sizeof(unit));
+}
+
+static NVENCSTATUS NVENCAPI stubOpenEncodeSessionEx(NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS *, void **encoder) {
+	driver.sessionsOpened++;
+	*encoder = &sessionToken;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubGetEncodeGUIDCount(void *, uint32_t *count) {
+	*count = 1;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubGetEncodeGUIDs(void *, GUID *guids, uint32_t size, uint32_t *count) {
+	*count = size > 0 ? 1 : 0;
+	if (size > 0) {
+		guids[0] = NV_ENC_CODEC_HEVC_GUID;
+	}
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubGetEncodePresetConfig(void *, GUID, GUID, NV_ENC_PRESET_CONFIG *) {
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubInitializeEncoder(void *, NV_ENC_INITIALIZE_PARAMS *) {
+	if (driver.failInitialize > 0) {
+		driver.failInitialize--;
+		return NV_ENC_ERR_GENERIC;
+	}
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubCreateInputBuffer(void *, NV_ENC_CREATE_INPUT_BUFFER *params) {
+	StubInput *input = new StubInput();
+	input->data.resize(static_cast<size_t>(params->width) * params->height * 3 / 2);
+	params->inputBuffer = input;
+	driver.liveBuffers++;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubDestroyInputBuffer(void *, NV_ENC_INPUT_PTR buffer) {
+	delete static_cast<StubInput*>(buffer);
+	driver.liveBuffers--;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubCreateBitstreamBuffer(void *, NV_ENC_CREATE_BITSTREAM_BUFFER *params) {
+	params->bitstreamBuffer = new StubBitstream();
+	driver.liveBuffers++;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubDestroyBitstreamBuffer(void *, NV_ENC_OUTPUT_PTR buffer) {
+	delete static_cast<StubBitstream*>(buffer);
+	driver.liveBuffers--;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubLockInputBuffer(void *, NV_ENC_LOCK_INPUT_BUFFER *params) {
+	params->bufferDataPtr = static_cast<StubInput*>(params->inputBuffer)->data.data();
+	params->pitch = WIDTH;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubUnlockInputBuffer(void *, NV_ENC_INPUT_PTR) {
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubEncodePicture(void *, NV_ENC_PIC_PARAMS *params) {
+	driver.picFlags.push_back(params->encodePicFlags);
+	std::vector<uint8_t> &out = static_cast<StubBitstream*>(params->outputBitstream)->data;
+	out.clear();
+	if (params->encodePicFlags & NV_ENC_PIC_FLAG_OUTPUT_SPSPPS) {
+		appendUnit(out, NAL_VPS);
+		appendUnit(out, NAL_SPS);
+		appendUnit(out, NAL_PPS);
+	}
+	appendUnit(out, (params->encodePicFlags & NV_ENC_PIC_FLAG_FORCEIDR) ? NAL_IDR_W_RADL : NAL_TRAIL_R);
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubLockBitstream(void *, NV_ENC_LOCK_BITSTREAM *params) {
+	if (driver.failLockBitstream > 0) {
+		driver.failLockBitstream--;
+		return NV_ENC_ERR_GENERIC;
+	}
+	std::vector<uint8_t> &data = static_cast<StubBitstream*>(params->outputBitstream)->data;
+	params->bitstreamBufferPtr = data.data();
+	params->bitstreamSizeInBytes = static_cast<uint32_t>(data.size());
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubUnlockBitstream(void *, NV_ENC_OUTPUT_PTR) {
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubDestroyEncoder(void *) {
+	driver.sessionsDestroyed++;
+	return NV_ENC_SUCCESS;
+}
+
+static NVENCSTATUS NVENCAPI stubCreateInstance(NV_ENCODE_API_FUNCTION_LIST *api) {
+	api->nvEncOpenEncodeSessionEx = stubOpenEncodeSessionEx;
+	api->nvEncGetEncodeGUIDCount = stubGetEncodeGUIDCount;
+	api->nvEncGetEncodeGUIDs = stubGetEncodeGUIDs;
+	api->nvEncGetEncodePresetConfig = stubGetEncodePresetConfig;
+	api->nvEncInitializeEncoder = stubInitializeEncoder;
+	api->nvEncCreateInputBuffer = stubCreateInputBuffer;
+	api->nvEncDestroyInputBuffer = stubDestroyInputBuffer;
+	api->nvEncCreateBitstreamBuffer = stubCreateBitstreamBuffer;
+	api->nvEncDestroyBitstreamBuffer = stubDestroyBitstreamBuffer;
+	api->nvEncLockInputBuffer = stubLockInputBuffer;
+	api->nvEncUnlockInputBuffer = stubUnlockInputBuffer;
+	api->nvEncEncodePicture = stubEncodePicture;
+	api->nvEncLockBitstream = stubLockBitstream;
+	api->nvEncUnlockBitstream = stubUnlockBitstream;
+	api->nvEncDestroyEncoder = stubDestroyEncoder;
+	return NV_ENC_SUCCESS;
+}
+
+//The settings exit without a config file
+static void useCheckConfig(const boost::filesystem::path &dir) {
+	const std::string path = (dir / "encoderSessionCheckConfig.json").string();
+	std::ofstream conf(path.c_str());
+	conf << "{ \"IMACQUISITION\": { \"BUFFER_BUDGET_MB\": \"64\" } }" << std::endl;
+	conf.close();
+	SettingsIAC::setConf(path);
+	SettingsIAC::getInstance();
+}
+
+static EncoderQualityConfig segmentConfig(int qp) {
+	EncoderQualityConfig cfg = EncoderQualityConfig();
+	cfg.width = WIDTH;
+	cfg.height = HEIGHT;
+	cfg.fps = 10;
+	cfg.qp = qp;
+	cfg.idrinterval = 0;
+	return cfg;
+}
+
+//NAL unit types in the order of the file
+static std::vector<uint8_t> nalTypes(const std::string &file) {
+	std::ifstream in(file.c_str(), std::ios::binary);
+	const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	std::vector<uint8_t> types;
+	for (size_t i = 0; i + 3 < data.size(); i++) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			types.push_back((data[i + 3] >> 1) & 0x3F);
+			i += 3;
+		}
+	}
+	return types;
+}
+
+//Exactly one IDR picture per segment, the first picture, preceded by the parameter sets if required
+static void expectOneIdr(const std::string &name, const std::vector<uint8_t> &types, bool parameterSets) {
+	std::vector<uint8_t> pictures;
+	for (uint8_t type : types) {
+		if (type < 32) {
+			pictures.push_back(type);
+		}
+	}
+	int idr = 0;
+	for (uint8_t type : pictures) {
+		idr += type == NAL_IDR_W_RADL ? 1 : 0;
+	}
+	expect(pictures.size() == static_cast<size_t>(FRAMES),
+			name + ": " + std::to_string(pictures.size()) + " pictures written");
+	expect(idr == 1, name + ": " + std::to_string(idr) + " IDR pictures");
+	expect(!pictures.empty() && pictures.front() == NAL_IDR_W_RADL, name + ": does not start with an IDR picture");
+	if (parameterSets) {
+		expect(types.size() >= 4 && types[0] == NAL_VPS && types[1] == NAL_SPS && types[2] == NAL_PPS,
+				name + ": no VPS, SPS and PPS before the IDR picture");
+	}
+}
+
+/*
+ * Runs one segment as NvEncGlue does and returns the NAL unit types of its file.
+ * @param Result of closeSegment
+ */
+static std::vector<uint8_t> runSegment(EncoderBackend &encoder, const EncoderQualityConfig &cfg,
+		const std::string &imdir, const std::string &exchangedir, bool *opened, long *closed) {
+	writeHandler wh(imdir, 0, exchangedir);
+	*opened = encoder.openSegment(cfg, &wh);
+	*closed = -1;
+	if (!*opened) {
+		return std::vector<uint8_t>();
+	}
+	FrameMetadata meta = {};
+	ImageBuffer frame(WIDTH, HEIGHT, meta);
+	for (int i = 0; i < FRAMES; i++) {
+		encoder.submitFrame(frame);
+	}
+	encoder.flush();
+	*closed = encoder.closeSegment();
+	fflush(wh._video);
+	return nalTypes(wh._videofile);
+}
+
+static void checkNvEncoder(const std::string &imdir, const std::string &exchangedir) {
+	bool opened;
+	long closed;
+	{
+		CNvEncoder encoder(stubCreateInstance);
+
+		//Same configuration: one session, one IDR picture with parameter sets per segment
+		for (int segment = 0; segment < 3; segment++) {
+			const std::string name = "nvenc segment " + std::to_string(segment);
+			const size_t firstPicture = driver.picFlags.size();
+			std::vector<uint8_t> types = runSegment(encoder, segmentConfig(25), imdir, exchangedir, &opened, &closed);
+			expect(opened && closed > 0, name + ": failed");
+			expectOneIdr(name, types, true);
+			expect(driver.picFlags.size() == firstPicture + FRAMES, name + ": pictures not encoded");
+			for (size_t i = firstPicture; i < driver.picFlags.size(); i++) {
+				const uint32_t want = i == firstPicture ? (NV_ENC_PIC_FLAG_FORCEIDR | NV_ENC_PIC_FLAG_OUTPUT_SPSPPS) : 0;
+				expect(driver.picFlags[i] == want, name + ": picture " + std::to_string(i - firstPicture)
+						+ " has flags " + std::to_string(driver.picFlags[i]));
+			}
+		}
+		expect(driver.sessionsOpened == 1, "same configuration: " + std::to_string(driver.sessionsOpened) + " sessions");
+		expect(driver.sessionsDestroyed == 0, "same configuration: session destroyed");
+
+		//Another configuration needs another session
+		std::vector<uint8_t> types = runSegment(encoder, segmentConfig(30), imdir, exchangedir, &opened, &closed);
+		expect(opened && closed > 0, "other configuration: failed");
+		expectOneIdr("other configuration", types, true);
+		expect(driver.sessionsOpened == 2 && driver.sessionsDestroyed == 1, "other configuration: session not replaced");
+
+		//An error during the segment releases the session and all its buffers
+		driver.failLockBitstream = 1;
+		runSegment(encoder, segmentConfig(30), imdir, exchangedir, &opened, &closed);
+		expect(opened && closed == -1, "failing segment: closeSegment did not report the error");
+		expect(driver.sessionsDestroyed == driver.sessionsOpened, "failing segment: session kept");
+		expect(driver.liveBuffers == 0, "failing segment: " + std::to_string(driver.liveBuffers) + " buffers kept");
+
+		//as does a failing setup
+		driver.failInitialize = 1;
+		runSegment(encoder, segmentConfig(30), imdir, exchangedir, &opened, &closed);
+		expect(!opened, "failing setup: openSegment succeeded");
+		expect(driver.sessionsDestroyed == driver.sessionsOpened, "failing setup: session kept");
+		expect(driver.liveBuffers == 0, "failing setup: " + std::to_string(driver.liveBuffers) + " buffers kept");
+
+		//The next segment starts over
+		const int sessions = driver.sessionsOpened;
+		types = runSegment(encoder, segmentConfig(30), imdir, exchangedir, &opened, &closed);
+		expect(opened && closed > 0, "after errors: failed");
+		expectOneIdr("after errors", types, true);
+		expect(driver.sessionsOpened == sessions + 1, "after errors: no new session");
+	}
+	expect(driver.sessionsDestroyed == driver.sessionsOpened, "destructor: session kept");
+	expect(driver.liveBuffers == 0, "destructor: " + std::to_string(driver.liveBuffers) + " buffers kept");
+}
+
+static void checkSyntheticEncoder(const std::string &imdir, const std::string &exchangedir) {
+	std::unique_ptr<EncoderBackend> encoder = EncoderBackend::create("synthetic");
+	expect(encoder != nullptr, "synthetic backend not available");
+	if (!encoder) {
+		return;
+	}
+	for (int segment = 0; segment < 3; segment++) {
+		const std::string name = "synthetic segment " + std::to_string(segment);
+		bool opened;
+		long closed;
+		std::vector<uint8_t> types = runSegment(*encoder, segmentConfig(25), imdir, exchangedir, &opened, &closed);
+		expect(opened && closed > 0, name + ": failed");
+		expectOneIdr(name, types, false);
+	}
+}
+
+int main() {
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path()
+			/ boost::filesystem::unique_path("encoderSessionCheck-%%%%%%%%");
+	boost::filesystem::create_directories(dir / "tmp" / "Cam_0");
+	boost::filesystem::create_directories(dir / "out" / "Cam_0");
+	useCheckConfig(dir);
+	const std::string imdir = (dir / "tmp" / "Cam_%u" / "Cam_%u_%s--%s").string();
+	const std::string exchangedir = (dir / "out" / "Cam_%u").string() + "/";
+
+	checkNvEncoder(imdir, exchangedir);
+	checkSyntheticEncoder(imdir, exchangedir);
+
+	boost::filesystem::remove_all(dir);
+	return checkResult();
+}
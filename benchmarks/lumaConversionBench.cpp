@@ -0,0 +1,118 @@
+#include "LumaConversion.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Time per frame to fill the NV12 input surface of the encoder, compared
+ * to the path CNvEncoder used before: the float formula 0.895 * x + 16
+ * into a temporary luma buffer, then convertYUVpitchtoNV12 copying it and
+ * interleaving the constant chroma into the surface on every frame.
+ * convertLuma writes straight into the surface; the chroma is written once
+ * per surface, so not per frame.
+ *
+ * Also checks that every path gives the bytes of the float formula.
+ *
+ * Usage: lumaConversionBench [width height [iterations]]
+ * Defaults to 4000x3000. The surface pitch is the width rounded up to 256 bytes.
+ */
+
+static const int DEFAULT_ITERATIONS = 50;
+static const int SURFACE_ALIGNMENT = 256;
+
+//As NvEncoder.cpp had it
+static void convertYUVpitchtoNV12(unsigned char *yuv_luma, unsigned char *yuv_cb, unsigned char *yuv_cr,
+		unsigned char *nv12_luma, unsigned char *nv12_chroma, int width, int height, int srcStride, int dstStride) {
+	for (int y = 0; y < height; y++) {
+		memcpy(nv12_luma + (dstStride * y), yuv_luma + (srcStride * y), width);
+	}
+	for (int y = 0; y < height / 2; y++) {
+		for (int x = 0; x < width; x = x + 2) {
+			nv12_chroma[(y * dstStride) + x] = yuv_cb[((srcStride / 2) * y) + (x >> 1)];
+			nv12_chroma[(y * dstStride) + (x + 1)] = yuv_cr[((srcStride / 2) * y) + (x >> 1)];
+		}
+	}
+}
+
+//As rawTo420NoHalide had it
+static void lumaFloat(uint8_t *dst, const uint8_t *src, int width, int height, int srcStride) {
+	for (int y = 0; y < height; y++) {
+		const uint8_t *row = src + static_cast<size_t>(y) * srcStride;
+		for (int x = 0; x < width; x++) {
+			dst[y * width + x] = (uint8_t) (0.895 * row[x] + 16);
+		}
+	}
+}
+
+//Average ms per call
+static double measure(const std::function<void()> &run, int iterations) {
+	run();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		run();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+	int width = 4000, height = 3000;
+	if (argc > 2) {
+		width = std::stoi(argv[1]);
+		height = std::stoi(argv[2]);
+	}
+	int iterations = argc > 3 ? std::stoi(argv[3]) : DEFAULT_ITERATIONS;
+	const int pitch = (width + SURFACE_ALIGNMENT - 1) / SURFACE_ALIGNMENT * SURFACE_ALIGNMENT;
+
+	std::vector<uint8_t> src(static_cast<size_t>(width) * height);
+	for (size_t i = 0; i < src.size(); i++) {
+		src[i] = static_cast<uint8_t>(i * 7 + i / width);
+	}
+	std::vector<uint8_t> surface(static_cast<size_t>(pitch) * height * 3 / 2);
+	uint8_t *surfaceChroma = surface.data() + static_cast<size_t>(pitch) * height;
+
+	//What the old path kept per session
+	std::vector<uint8_t> luma(static_cast<size_t>(width) * height);
+	std::vector<uint8_t> chroma(static_cast<size_t>(width) * height / 4, 128);
+
+	std::vector<uint8_t> expected(static_cast<size_t>(width) * height);
+	lumaFloat(expected.data(), src.data(), width, height, width);
+
+	struct Conversion {
+		std::string				name;
+		std::function<void()>	run;
+	};
+	std::vector<Conversion> conversions = {
+		{"float + convertYUVpitchtoNV12", [&]() {
+			lumaFloat(luma.data(), src.data(), width, height, width);
+			convertYUVpitchtoNV12(luma.data(), chroma.data(), chroma.data(), surface.data(), surfaceChroma,
+					width, height, width, pitch);
+		}},
+		{std::string("convertLuma (") + lumaConversionIsa() + ")", [&]() {
+			convertLuma(surface.data(), pitch, src.data(), width, width, height);
+		}},
+		{"convertLumaScalar", [&]() {
+			convertLumaScalar(surface.data(), pitch, src.data(), width, width, height);
+		}},
+	};
+
+	bool allExact = true;
+	std::printf("%dx%d, surface pitch %d, %d iterations\n", width, height, pitch, iterations);
+	std::printf("%-34s %10s %10s\n", "", "ms/frame", "exact");
+	for (const Conversion &conversion : conversions) {
+		std::fill(surface.begin(), surface.end(), 0);
+		double ms = measure(conversion.run, iterations);
+		bool exact = true;
+		for (int y = 0; y < height && exact; y++) {
+			exact = memcmp(surface.data() + static_cast<size_t>(y) * pitch,
+					expected.data() + static_cast<size_t>(y) * width, width) == 0;
+		}
+		allExact = allExact && exact;
+		std::printf("%-34s %10.2f %10s\n", conversion.name.c_str(), ms, exact ? "yes" : "NO");
+	}
+	return allExact ? 0 : 1;
+}
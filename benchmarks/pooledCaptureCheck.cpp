@@ -0,0 +1,105 @@
+#include "Check.h"
+#include "Buffer/FramePool.h"
+#include "PooledCapture.h"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Capture into pooled frames against an SDK shim standing in for
+ * FlyCapture2 and xiAPI. The shim writes a test pattern into the buffer
+ * it is given if the image fits, and into memory of its own otherwise,
+ * as the drivers do. adoptDeliveredImage has to use the frame in place
+ * only in the first case and copy the image in all others.
+ *
+ * Usage: pooledCaptureCheck
+ * Exits with 1 if a check fails.
+ */
+
+static uint8_t pattern(int x, int y) {
+	return static_cast<uint8_t>(x * 7 + y * 13 + 1);
+}
+
+class SdkShim {
+public:
+	//! @param Pitch of the delivered rows. Padding bytes are set to 0xEE.
+	//! @param Whether to deliver into own memory even if the buffer is large enough
+	SdkShim(int width, int height, int pitch, bool reallocate) :
+		_Width(width), _Height(height), _Pitch(pitch), _Reallocate(reallocate) {
+	}
+
+	DeliveredImage capture(uint8_t *supplied, size_t suppliedSize) {
+		const size_t bytes = static_cast<size_t>(_Pitch) * _Height;
+		uint8_t *target = supplied;
+		if (_Reallocate || bytes > suppliedSize) {
+			_Own.assign(bytes, 0);
+			target = _Own.data();
+		}
+		for (int y = 0; y < _Height; y++) {
+			for (int x = 0; x < _Pitch; x++) {
+				target[static_cast<size_t>(y) * _Pitch + x] = x < _Width ? pattern(x, y) : 0xEE;
+			}
+		}
+		return DeliveredImage { target, _Width, _Height, _Pitch };
+	}
+
+private:
+	const int				_Width;
+	const int				_Height;
+	const int				_Pitch;
+	const bool				_Reallocate;
+	std::vector<uint8_t>	_Own;
+};
+
+/*
+ * Captures one frame through the shim into a frame of the given pool.
+ * The frame should then hold the centered region of the image, black
+ * where the image does not cover it.
+ */
+static void check(const std::string &name, FramePool *pool, int frameWidth, SdkShim shim,
+		int imageWidth, int imageHeight, bool expectInPlace) {
+	std::shared_ptr<ImageBuffer> frame = pool->acquire(FrameMetadata());
+	frame->width = frameWidth;
+	const DeliveredImage image = shim.capture(frame->data, pool->slotSize());
+	const bool inPlace = adoptDeliveredImage(*frame, pool->slotSize(), image);
+
+	expect(inPlace == expectInPlace, name + ": " + (inPlace ? "used in place" : "copied"));
+	expect(frame->width == frameWidth && frame->height == pool->height(), name + ": frame size changed");
+	expect(static_cast<size_t>(frame->stride) * frame->height <= pool->slotSize(), name + ": stride overflows the slot");
+	expect(inPlace || frame->isContiguous(), name + ": copy is not contiguous");
+
+	const int offsetX = (imageWidth - frame->width) / 2;
+	const int offsetY = (imageHeight - frame->height) / 2;
+	int wrong = 0;
+	for (int y = 0; y < frame->height; y++) {
+		for (int x = 0; x < frame->width; x++) {
+			const int sx = x + offsetX;
+			const int sy = y + offsetY;
+			const bool covered = sx >= 0 && sx < imageWidth && sy >= 0 && sy < imageHeight;
+			const uint8_t want = covered ? pattern(sx, sy) : 0;
+			if (frame->data[static_cast<size_t>(y) * frame->stride + x] != want) {
+				wrong++;
+			}
+		}
+	}
+	expect(wrong == 0, name + ": " + std::to_string(wrong) + " wrong pixels");
+}
+
+int main() {
+	const int width = 64, height = 48, padding = 16;
+
+	//Slot of exactly one image, as FlyCapture2 and the encoder size
+	FramePool *tight = FramePool::getPool(width, height);
+	//Slot including the row padding, as sized from the Ximea payload
+	FramePool *padded = FramePool::getPool(width + padding, height);
+
+	check("in place", tight, width, SdkShim(width, height, width, false), width, height, true);
+	check("in place, padded rows", padded, width, SdkShim(width, height, width + padding, false), width, height, true);
+	check("padded rows, slot too small", tight, width, SdkShim(width, height, width + padding, false), width, height, false);
+	check("driver reallocated", tight, width, SdkShim(width, height, width, true), width, height, false);
+	check("larger video mode", tight, width, SdkShim(width + 20, height + 10, width + 20, true), width + 20, height + 10, false);
+	check("smaller video mode", tight, width, SdkShim(width - 20, height - 10, width - 20, false), width - 20, height - 10, false);
+
+	return checkResult();
+}
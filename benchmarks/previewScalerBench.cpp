@@ -0,0 +1,88 @@
+#include "ImageScaling.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+using namespace beeCompress;
+
+/*
+ * Time per frame of the preview downscalers, compared to the OpenCV
+ * path the encoder thread used before (copy, resize, copy per pixel).
+ *
+ * Usage: previewScalerBench [width height previewWidth previewHeight [iterations]]
+ * Defaults to 4000x3000 to 2000x1500.
+ */
+
+static const int DEFAULT_ITERATIONS = 50;
+
+//Average ms per call
+static double measure(const std::function<void()> &run, int iterations) {
+	run();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		run();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+	int width = 4000, height = 3000, previewWidth = 2000, previewHeight = 1500;
+	if (argc > 4) {
+		width = std::stoi(argv[1]);
+		height = std::stoi(argv[2]);
+		previewWidth = std::stoi(argv[3]);
+		previewHeight = std::stoi(argv[4]);
+	}
+	int iterations = argc > 5 ? std::stoi(argv[5]) : DEFAULT_ITERATIONS;
+
+	std::vector<uint8_t> src(static_cast<size_t>(width) * height);
+	for (size_t i = 0; i < src.size(); i++) {
+		src[i] = static_cast<uint8_t>(i * 7 + i / width);
+	}
+	std::vector<uint8_t> dst(static_cast<size_t>(previewWidth) * previewHeight);
+	cv::Mat frame(height, width, CV_8U, src.data());
+	cv::Mat preview(previewHeight, previewWidth, CV_8U, dst.data());
+
+	struct Scaler {
+		std::string				name;
+		std::function<void()>	run;
+	};
+	std::vector<Scaler> scalers = {
+		{std::string("downscale (") + imageScalingIsa() + ")", [&]() {
+			downscale(dst.data(), previewWidth, previewWidth, previewHeight, src.data(), width, width, height);
+		}},
+		{"area filter", [&]() {
+			downscaleArea(dst.data(), previewWidth, previewWidth, previewHeight, src.data(), width, width, height);
+		}},
+		{"cv::resize INTER_AREA", [&]() {
+			cv::resize(frame, preview, preview.size(), 0, 0, cv::INTER_AREA);
+		}},
+		{"previous scaleImage", [&]() {
+			cv::Mat copy = frame.clone();
+			cv::Mat resized;
+			cv::resize(copy, resized, preview.size());
+			for (int y = 0; y < previewHeight; y++) {
+				for (int x = 0; x < previewWidth; x++) {
+					dst[static_cast<size_t>(y) * previewWidth + x] = resized.at<uint8_t>(y, x);
+				}
+			}
+		}},
+	};
+	if (width / 2 == previewWidth && height / 2 == previewHeight) {
+		scalers.push_back({"box 2x, plain C", [&]() {
+			downscale2xScalar(dst.data(), previewWidth, src.data(), width, width, height);
+		}});
+	} else if (width / 4 == previewWidth && height / 4 == previewHeight) {
+		scalers.push_back({"box 4x, plain C", [&]() {
+			downscale4xScalar(dst.data(), previewWidth, src.data(), width, width, height);
+		}});
+	}
+
+	std::printf("%dx%d to %dx%d, %d iterations\n", width, height, previewWidth, previewHeight, iterations);
+	for (const Scaler &scaler : scalers) {
+		std::printf("%-28s %8.3f ms/frame\n", scaler.name.c_str(), measure(scaler.run, iterations));
+	}
+	return 0;
+}
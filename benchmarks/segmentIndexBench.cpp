@@ -0,0 +1,126 @@
+#include "SegmentIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Latency of fetching the bitstream needed to decode a random frame of a
+ * recorded video, with the index (keyframe before the frame up to the
+ * frame) and without it (scanning the stream from the start, as a
+ * sequential decoder has to). Decoding itself is not included; its cost
+ * grows with the number of pictures fed, which is printed as well.
+ *
+ * Usage: segmentIndexBench video.avi [lookups]
+ * The .idx is expected next to the video. Record with IDRINTERVAL set;
+ * ENCODER_BACKEND "synthetic" and CAMTYPE "synthetic" need no hardware.
+ */
+
+static const int DEFAULT_LOOKUPS = 1000;
+
+//Keeps the scan from being optimized away
+static volatile size_t scanned;
+
+struct Latency {
+	double	avgUs;
+	double	p99Us;
+	double	maxUs;
+};
+
+static Latency summarize(std::vector<double> &us) {
+	std::sort(us.begin(), us.end());
+	double sum = 0;
+	for (double u : us) {
+		sum += u;
+	}
+	return Latency { sum / us.size(), us[us.size() * 99 / 100], us.back() };
+}
+
+//Offset of the n-th picture found by walking the start codes, i.e. without an index
+static size_t scanToPicture(VideoCodec codec, const uint8_t *data, size_t size, size_t picture) {
+	//The first bit after the NAL unit header: first_slice_segment_in_pic_flag in HEVC,
+	//first_mb_in_slice == 0 (ue(v) coded as a single 1) in H.264
+	const size_t headerBytes = codec == VideoCodec::H264 ? 1 : 2;
+	size_t seen = 0;
+	for (size_t i = 0; i + 3 + headerBytes < size; i++) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			uint8_t type = nalUnitType(codec, data[i + 3]);
+			//Set on the first slice of a picture
+			if (isSliceNal(codec, type) && (data[i + 3 + headerBytes] & 0x80) && seen++ == picture) {
+				return i;
+			}
+			i += 3;
+		}
+	}
+	return size;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::printf("Usage: %s video.avi [lookups]\n", argv[0]);
+		return 1;
+	}
+	int lookups = argc > 2 ? std::stoi(argv[2]) : DEFAULT_LOOKUPS;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::unique_ptr<SegmentIndex> index = SegmentIndex::open(argv[1]);
+	if (!index) {
+		return 1;
+	}
+	double openUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+	size_t keyframes = 0;
+	for (size_t i = 0; i < index->pictures(); i++) {
+		keyframes += index->record(i).keyframe;
+	}
+	const IndexRecord &last = index->record(index->pictures() - 1);
+	size_t videoBytes = last.videoOffset + last.videoBytes;
+	std::printf("%zu pictures, %zu keyframes, %.1f MB, index opened in %.1f us\n",
+			index->pictures(), keyframes, videoBytes / 1024.0 / 1024.0, openUs);
+
+	//The video is mapped by the index; read it once so both methods find it in the page cache
+	std::vector<uint8_t> video;
+	index->read(0, index->pictures(), video);
+
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<size_t> pick(0, index->pictures() - 1);
+	std::vector<double> indexedUs, scanUs;
+	std::vector<uint8_t> bitstream;
+	double pictures = 0, bytes = 0, scanPictures = 0;
+	for (int i = 0; i < lookups; i++) {
+		size_t picture = pick(rng);
+
+		start = std::chrono::steady_clock::now();
+		size_t key = index->keyframeBefore(picture);
+		index->read(key, picture + 1, bitstream);
+		indexedUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		pictures += picture + 1 - key;
+		bytes += bitstream.size();
+
+		start = std::chrono::steady_clock::now();
+		scanned = scanToPicture(index->codec(), video.data(), video.size(), picture + 1);
+		scanUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		scanPictures += picture + 1;
+	}
+
+	Latency indexed = summarize(indexedUs);
+	Latency scan = summarize(scanUs);
+	std::printf("%d random frames\n", lookups);
+	std::printf("%-10s %10.1f us avg %10.1f us p99 %10.1f us max, %6.1f pictures %8.1f KB to decode\n", "indexed",
+			indexed.avgUs, indexed.p99Us, indexed.maxUs, pictures / lookups, bytes / lookups / 1024);
+	std::printf("%-10s %10.1f us avg %10.1f us p99 %10.1f us max, %6.1f pictures to decode\n", "scan",
+			scan.avgUs, scan.p99Us, scan.maxUs, scanPictures / lookups);
+
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<SegmentIndex::Chunk> chunks = index->chunks(cores);
+	std::printf("%zu chunks for %u cores:", chunks.size(), cores);
+	for (const SegmentIndex::Chunk &chunk : chunks) {
+		std::printf(" %zu", chunk.end - chunk.first);
+	}
+	std::printf("\n");
+	return 0;
+}
@@ -0,0 +1,140 @@
+#include "Buffer/MutexLinkedList.h"
+#include "Buffer/SpscRingBuffer.h"
+#include "settings/ParamNames.h"
+#include "settings/Settings.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Push/pop cost of the frame buffers between a camera thread and an
+ * encoder thread: SpscRingBuffer against MutexLinkedList.
+ *
+ * Throughput: one producer and one consumer thread move frames as fast
+ * as they can. The producer keeps at most "capacity" frames in flight so
+ * the ring never drops.
+ * Latency: the producer pushes one frame at a time and waits until it is
+ * popped, so every pop has to wake up the consumer (the usual case at
+ * camera frame rates). Reported is the time from push to pop returning.
+ *
+ * Usage: spscBench [frames [capacity]]
+ * Only pointers are queued, so the frame size does not matter.
+ */
+
+static const int DEFAULT_FRAMES 	= 1000000;
+static const int DEFAULT_CAPACITY 	= 64;
+static const int LATENCY_FRAMES 	= 20000;
+
+//The buffers take their byte budget from the settings, which exit without a config file
+static void useBenchConfig() {
+	const std::string path = "./spscBenchConfig.json";
+	std::ofstream conf(path.c_str());
+	conf << "{ \"IMACQUISITION\": { \"BUFFER_BUDGET_MB\": \"1024\" } }" << std::endl;
+	conf.close();
+	SettingsIAC::setConf(path);
+	SettingsIAC::getInstance();
+}
+
+static uint64_t nowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::shared_ptr<ImageBuffer> makeFrame() {
+	FrameMetadata meta = {};
+	return std::make_shared<ImageBuffer>(8, 8, meta);
+}
+
+//Frames per second through the buffer
+static double throughput(MutexBuffer &buffer, int frames, int capacity) {
+	std::vector<std::shared_ptr<ImageBuffer>> pool;
+	for (int i = 0; i < capacity; i++) {
+		pool.push_back(makeFrame());
+	}
+	std::atomic<int> popped(0);
+
+	auto start = std::chrono::steady_clock::now();
+	std::thread consumer([&]() {
+		for (int i = 0; i < frames; i++) {
+			buffer.pop();
+			popped.store(i + 1, std::memory_order_release);
+		}
+	});
+	for (int i = 0; i < frames; i++) {
+		while (i - popped.load(std::memory_order_acquire) >= capacity) {
+			std::this_thread::yield();
+		}
+		buffer.push(pool[i % capacity]);
+	}
+	consumer.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return frames / seconds;
+}
+
+struct Latency {
+	double	medianUs;
+	double	p99Us;
+	double	maxUs;
+};
+
+//Time from push to pop returning, one frame in flight
+static Latency latency(MutexBuffer &buffer, int frames) {
+	std::vector<double> us(frames);
+	std::atomic<int> popped(0);
+
+	std::thread consumer([&]() {
+		for (int i = 0; i < frames; i++) {
+			std::shared_ptr<ImageBuffer> img = buffer.pop();
+			us[i] = (nowNs() - img->meta.cameraTimestampNs) / 1000.0;
+			popped.store(i + 1, std::memory_order_release);
+		}
+	});
+	for (int i = 0; i < frames; i++) {
+		std::shared_ptr<ImageBuffer> img = makeFrame();
+		//Give the consumer time to go to sleep, as between camera frames
+		std::this_thread::sleep_for(std::chrono::microseconds(20));
+		img->meta.cameraTimestampNs = nowNs();
+		buffer.push(img);
+		while (popped.load(std::memory_order_acquire) <= i) {
+			std::this_thread::yield();
+		}
+	}
+	consumer.join();
+
+	std::sort(us.begin(), us.end());
+	return Latency { us[us.size() / 2], us[us.size() * 99 / 100], us.back() };
+}
+
+int main(int argc, char **argv) {
+	int frames = argc > 1 ? std::stoi(argv[1]) : DEFAULT_FRAMES;
+	int capacity = argc > 2 ? std::stoi(argv[2]) : DEFAULT_CAPACITY;
+	useBenchConfig();
+
+	struct Candidate {
+		std::string						name;
+		std::function<MutexBuffer*()>	create;
+	};
+	std::vector<Candidate> candidates = {
+		{"MutexLinkedList", []() -> MutexBuffer* { return new MutexLinkedList(); }},
+		{"SpscRingBuffer", [capacity]() -> MutexBuffer* { return new SpscRingBuffer(capacity); }},
+	};
+
+	std::printf("%d frames, %d in flight, latency over %d frames\n", frames, capacity, LATENCY_FRAMES);
+	std::printf("%-18s %14s %12s %12s %12s\n", "", "Mframes/s", "median us", "p99 us", "max us");
+	for (const Candidate &candidate : candidates) {
+		std::unique_ptr<MutexBuffer> buffer(candidate.create());
+		double rate = throughput(*buffer, frames, capacity);
+		Latency lat = latency(*buffer, LATENCY_FRAMES);
+		std::printf("%-18s %14.2f %12.2f %12.2f %12.2f\n", candidate.name.c_str(),
+				rate / 1e6, lat.medianUs, lat.p99Us, lat.maxUs);
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include "HalideKernels.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+using namespace beeCompress;
+
+/*
+ * Runs every AOT compiled Halide kernel with every variant this CPU
+ * supports and prints its throughput in Gpixel/s. Before that every
+ * variant is compared with the C++ versions (HalideKernels::check).
+ *
+ * Usage: halideKernelsBench [width height [iterations]]
+ * Exits with 1 if a variant differs.
+ */
+
+static const int DEFAULT_WIDTH = 4000;
+static const int DEFAULT_HEIGHT = 3000;
+static const int DEFAULT_ITERATIONS = 50;
+
+//Gpixel/s of kernel, pixels counted on its input. 0 if it failed.
+static double measure(const std::function<bool()> &kernel, double pixels, int iterations) {
+	//Warm up: thread pool, caches
+	if (!kernel()) {
+		return 0;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		kernel();
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return pixels * iterations / seconds / 1e9;
+}
+
+int main(int argc, char **argv) {
+	int width = argc > 2 ? std::stoi(argv[1]) : DEFAULT_WIDTH;
+	int height = argc > 2 ? std::stoi(argv[2]) : DEFAULT_HEIGHT;
+	int iterations = argc > 3 ? std::stoi(argv[3]) : DEFAULT_ITERATIONS;
+	double pixels = static_cast<double>(width) * height;
+
+	std::vector<uint8_t> src(width * height), dst(width * height);
+	for (size_t i = 0; i < src.size(); i++) {
+		src[i] = static_cast<uint8_t>(i * 7);
+	}
+	uint32_t hist[256];
+
+	struct Kernel {
+		const char				*name;
+		double					pixels;
+		std::function<bool()>	run;
+	};
+	const std::vector<Kernel> kernels = {
+		{"lumaRange", pixels, [&]() {
+			return HalideKernels::lumaRange(dst.data(), width, src.data(), width, width, height);
+		}},
+		{"downscale2x", pixels, [&]() {
+			return HalideKernels::downscale(dst.data(), width / 2, src.data(), width, width, height, 2);
+		}},
+		{"downscale4x", pixels, [&]() {
+			return HalideKernels::downscale(dst.data(), width / 4, src.data(), width, width, height, 4);
+		}},
+		{"frameStats", pixels, [&]() {
+			return HalideKernels::frameStats(src.data(), width, width, height, hist);
+		}},
+	};
+
+	std::vector<std::string> isas = HalideKernels::supportedIsas();
+	if (isas.empty()) {
+		std::printf("This CPU runs none of the Halide variants (needs SSE4.1)\n");
+		return 1;
+	}
+
+	bool allMatch = true;
+	for (const std::string &isa : isas) {
+		std::vector<std::string> failed = HalideKernels::check(isa);
+		std::printf("%-16s", isa.c_str());
+		for (const std::string &kernel : failed) {
+			std::printf(" %s", kernel.c_str());
+		}
+		std::printf(failed.empty() ? " matches the C++ versions\n" : " differ from the C++ versions\n");
+		allMatch = allMatch && failed.empty();
+	}
+
+	std::printf("%dx%d, %d iterations, Gpixel/s\n%-16s", width, height, iterations, "kernel");
+	for (const std::string &isa : isas) {
+		std::printf("%10s", isa.c_str());
+	}
+	std::printf("\n");
+	for (const Kernel &kernel : kernels) {
+		std::printf("%-16s", kernel.name);
+		for (const std::string &isa : isas) {
+			HalideKernels::useIsa(isa);
+			std::printf("%10.2f", measure(kernel.run, kernel.pixels, iterations));
+		}
+		std::printf("\n");
+	}
+	return allMatch ? 0 : 1;
+}
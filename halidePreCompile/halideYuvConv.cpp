@@ -1,26 +1,110 @@
-
-
 #include "Halide.h"
+#include <string>
 #include <vector>
 using namespace Halide;
 
+/*
+ * Ahead-of-time compiles the Halide kernels of the image acquisition.
+ *
+ * Every kernel works on images of any size and stride and is compiled
+ * once per CPU variant below into <kernel>_<variant>.h/.o. The kernels
+ * do not contain the Halide runtime; it is compiled once into
+ * halideRuntime.o. ImgAcquisition/HalideKernels picks the variant at
+ * runtime.
+ */
+
+//Names and features of the CPU variants, best last
+struct Variant {
+	std::string name;
+	std::vector<Target::Feature> features;
+};
+
+static const std::vector<Variant> VARIANTS = {
+	{"sse41",  {Target::SSE41}},
+	{"avx2",   {Target::SSE41, Target::AVX, Target::AVX2, Target::FMA}},
+	{"avx512", {Target::SSE41, Target::AVX, Target::AVX2, Target::FMA, Target::AVX512, Target::AVX512_Skylake}},
+};
+
+//(uint8_t)(0.895*x+16) in fixed point, exact for all inputs
+static Expr lumaRange(Expr value) {
+	return cast<uint8_t>((cast<uint32_t>(value) * 58656) >> 16) + cast<uint8_t>(16);
+}
+
+//Vectorized along rows, rows in parallel
+static void scheduleImage(Func f, Var x, Var y, const Target &target) {
+	f.vectorize(x, target.natural_vector_size<uint8_t>()).parallel(y, 16);
+}
+
+static void compile(Func f, const std::vector<Argument> &args, const std::string &kernel,
+		const Variant &variant, const Target &target) {
+	std::string name = kernel + "_" + variant.name;
+	f.compile_to_file(name, args, name, target);
+}
+
+static void compileVariant(const Variant &variant) {
+	Target host = get_host_target();
+	Target target(host.os, Target::X86, 64, variant.features);
+	target = target.with_feature(Target::NoRuntime);
+	Var x("x"), y("y"), i("i");
+
+	//Range conversion
+	{
+		ImageParam in(UInt(8), 2, "in");
+		Func f("lumaRange");
+		f(x, y) = lumaRange(in(x, y));
+		scheduleImage(f, x, y, target);
+		compile(f, {in}, "halideLumaRange", variant, target);
+	}
+
+	//2x2 box downscale, rounded
+	{
+		ImageParam in(UInt(8), 2, "in");
+		Func f("downscale2x");
+		Expr total = cast<uint16_t>(in(2 * x, 2 * y)) + in(2 * x + 1, 2 * y)
+				+ in(2 * x, 2 * y + 1) + in(2 * x + 1, 2 * y + 1);
+		f(x, y) = cast<uint8_t>((total + 2) / 4);
+		scheduleImage(f, x, y, target);
+		compile(f, {in}, "halideDownscale2x", variant, target);
+	}
+
+	//4x4 box downscale, rounded
+	{
+		ImageParam in(UInt(8), 2, "in");
+		Func f("downscale4x");
+		RDom r(0, 4, 0, 4);
+		Expr total = sum(cast<uint16_t>(in(4 * x + r.x, 4 * y + r.y)));
+		f(x, y) = cast<uint8_t>((total + 8) / 16);
+		scheduleImage(f, x, y, target);
+		compile(f, {in}, "halideDownscale4x", variant, target);
+	}
+
+	//Frame statistics: histogram of the 256 gray values. Mean, variance,
+	//minimum and maximum follow from it.
+	{
+		ImageParam in(UInt(8), 2, "in");
+		Func hist("frameStats");
+		RDom r(0, in.width(), 0, in.height());
+		hist(i) = cast<uint32_t>(0);
+		hist(cast<int32_t>(in(r.x, r.y))) += cast<uint32_t>(1);
+
+		//Partial histograms of row blocks in parallel, then their sum
+		RVar ryOuter("ryOuter"), ryInner("ryInner");
+		Var u("u");
+		hist.update().split(r.y, ryOuter, ryInner, 64);
+		Func partial = hist.update().rfactor(ryOuter, u);
+		partial.compute_root().update().parallel(u);
+		hist.bound(i, 0, 256);
+		compile(hist, {in}, "halideFrameStats", variant, target);
+	}
+}
+
 int main(){
-	int w=4000,h=3000;
-	uint8_t *inDummy;
-	uint8_t *outDummy;
-	Func halideYuvConv("halideYuv420Conv");
-	Image<uint8_t> in(Buffer(UInt(8), w, h, 0, 0, inDummy));
-	Image<uint8_t> out(Buffer(UInt(8), w, h, 0, 0, outDummy));
-
-	Var x,y;
-	Expr value = in(x, y);
-	value = Halide::cast<float>(value);
-	value = 0.895f * value + 16.0f;
-	value = Halide::cast<uint8_t>(value);
-	halideYuvConv(x, y) = value;
-	halideYuvConv.vectorize(x, 32).parallel(y);
-
-	std::vector<Argument> args = {in};
-	halideYuvConv.compile_to_file("halideYuv420Conv", args);
+	for (const Variant &variant : VARIANTS) {
+		compileVariant(variant);
+	}
+
+	//One runtime (thread pool, buffers) for all kernels
+	Target host = get_host_target();
+	compile_standalone_runtime("halideRuntime.o", Target(host.os, Target::X86, 64, {Target::SSE41}));
 	return 0;
 }